@@ -41,6 +41,14 @@ void console_put_char(uint8_t char_ascii)
     console_release();
 }
 
+/* 终端中输出buf中的count个字符，不需要以0结尾 */
+void console_write(const char *buf, uint32_t count)
+{
+    console_acquire();
+    while (count-- > 0) put_char(*buf++);
+    console_release();
+}
+
 /* 在终端中输出数字 */
 void console_put_int(uint32_t num)
 {
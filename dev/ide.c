@@ -38,6 +38,7 @@
 #define CMD_IDENTIFY        0xec        // identify指令
 #define CMD_READ_SECTOR     0x20        // 读取扇区指令
 #define CMD_WRITE_SECTOR    0x30        // 写入扇区指令
+#define CMD_FLUSH_CACHE     0xe7        // 把硬盘写缓存中的数据写入盘片
 
 /* 定义可读取最大扇区数，debug用 */
 #define max_lba ((80*1024*1024/512) - 1)    // 80M
@@ -229,6 +230,17 @@ void ide_write(struct disk *hd, uint32_t lba, void *buf, uint32_t sec_cnt)
     lock_release(&hd->my_channel->lock);
 }
 
+/* 等待硬盘把写缓存中的数据写入盘片，之前写入的数据在此之后才真正持久 */
+void ide_flush(struct disk *hd)
+{
+    lock_acquire(&hd->my_channel->lock);
+    select_disk(hd);
+    cmd_out(hd->my_channel, CMD_FLUSH_CACHE);
+    /* 完成后硬盘发出中断，此命令没有数据要传输 */
+    sema_down(&hd->my_channel->disk_done);
+    lock_release(&hd->my_channel->lock);
+}
+
 /* 将dst中len个相邻的字节交换位置存入buf */
 static void swap_pairs_bytes(const char *dst, char *buf, uint32_t len)
 {
@@ -4,8 +4,8 @@
 #include "interrupt.h"
 #include "thread.h"
 #include "debug.h"
+#include "vdso.h"
 
-#define IRQ0_FREQUENCY      100
 #define INPUT_FREQUENCY     1193180
 #define COUNTER0_VALUE      INPUT_FREQUENCY / IRQ0_FREQUENCY
 #define COUNTER0_PORT       0x40
@@ -39,6 +39,8 @@ static void intr_timer_handler(void)
 
     cur_thread->elapsed_ticks++;                        // 线程占用的cpu时间
     ticks++;
+    /* 只有正在运行的进程能读到自己的vdso页，所以只更新当前进程的 */
+    if (cur_thread->vdso) cur_thread->vdso->ticks = ticks;
 
     if (cur_thread->ticks == 0) schedule(); // 如果cpu时间片到了就切换任务
     else cur_thread->ticks--;
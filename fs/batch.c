@@ -0,0 +1,57 @@
+#include "batch.h"
+#include "fs.h"
+#include "global.h"
+#include "stdio_kern.h"
+
+/* 执行一个提交队列项，返回值即该操作对应系统调用的返回值 */
+static int32_t batch_do_sqe(struct batch_sqe *sqe)
+{
+    switch (sqe->opcode)
+    {
+        case BATCH_OP_NOP:
+            return 0;
+        case BATCH_OP_READ:
+            return sys_read(sqe->fd, sqe->addr, sqe->len);
+        case BATCH_OP_WRITE:
+            return sys_write(sqe->fd, sqe->addr, sqe->len);
+        case BATCH_OP_OPEN:
+            return sys_open(sqe->addr, (uint8_t)sqe->len);
+        case BATCH_OP_CLOSE:
+            return sys_close(sqe->fd);
+        case BATCH_OP_STAT:
+            return sys_stat(sqe->addr, sqe->buf);
+        case BATCH_OP_LSEEK:
+            return sys_lseek(sqe->fd, sqe->off, (uint8_t)sqe->len);
+        default:
+            printk("batch: unknown opcode %d\n", sqe->opcode);
+            return -1;
+    }
+}
+
+/* 在当前线程中依次同步执行ring中最多to_submit个提交队列项，结果写入完成队列，
+   一次陷入即可完成一批操作。完成队列满时停止提交，返回执行的项数，失败返回-1 */
+int32_t sys_batch_enter(struct batch_ring *ring, uint32_t to_submit)
+{
+    if (ring == NULL || (uint32_t)ring >= 0xc0000000)
+    {
+        printk("sys_batch_enter: ring error\n");
+        return -1;
+    }
+
+    uint32_t submitted = 0;
+    while (submitted < to_submit && ring->sq_head != ring->sq_tail)
+    {
+        /* 完成队列满了，等用户取走后再提交 */
+        if (ring->cq_tail - ring->cq_head == BATCH_ENTRIES) break;
+
+        struct batch_sqe *sqe = &ring->sqes[ring->sq_head & BATCH_MASK];
+        struct batch_cqe *cqe = &ring->cqes[ring->cq_tail & BATCH_MASK];
+        cqe->user_data = sqe->user_data;
+        cqe->res = batch_do_sqe(sqe);
+        ring->sq_head++;
+        ring->cq_tail++;
+        submitted++;
+    }
+
+    return submitted;
+}
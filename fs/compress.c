@@ -0,0 +1,337 @@
+#include "compress.h"
+#include "inode.h"
+#include "file.h"
+#include "fs.h"
+#include "super_block.h"
+#include "part_bitmap.h"
+#include "global.h"
+#include "debug.h"
+#include "memory.h"
+#include "string.h"
+#include "sync.h"
+#include "stdio_kern.h"
+#include "journal.h"
+#include "lz4.h"
+#include "bitmap.h"
+
+/* 保护块表和数据流，写入一块时要先读出块表再改写，期间会等待硬盘 */
+static struct lock compress_lock;
+
+/* 初始化文件压缩 */
+void compress_init(void)
+{
+    lock_init(&compress_lock);
+}
+
+/* 获取inode的块表，第一次访问时读入内存，create为1且还没有块表时分配一个，失败返回NULL。
+   读入的块表可能来自还没有提交的事务，按最后一次写入在当前事务中处理 */
+static struct chunk_table *chunk_table_get(struct inode *inode, int create)
+{
+    if (inode->i_chunks != NULL) return inode->i_chunks;
+    if (inode->i_ctable == 0 && !create) return NULL;
+
+    /* 块表被所有打开此文件的进程共享，要在内核空间中 */
+    struct chunk_table *table = get_kernel_pages(1);
+    if (table == NULL) return NULL;
+
+    if (inode->i_ctable != 0)
+    {
+        journal_read(cur_part->my_disk, inode->i_ctable, table, cur_part->sb->block_sects);
+    }
+    else
+    {
+        int32_t block_lba = block_bitmap_alloc_near(cur_part, block_goal_of_inode(cur_part, inode->i_no));
+        if (block_lba == -1)
+        {
+            printk("chunk_table_get: block_bitmap_alloc for chunk table failed\n");
+            mfree_page(PF_KERNEL, table, 1);
+            return NULL;
+        }
+        bitmap_sync(cur_part, block_bitmap_idx_of(cur_part, block_lba), BLOCK_BITMAP);
+        inode->i_ctable = block_lba;
+        journal_write(cur_part->my_disk, inode->i_ctable, table, cur_part->sb->block_sects);
+    }
+    inode->i_chunks = table;
+    inode->i_ctable_seq = journal_txn_seq();
+    return table;
+}
+
+/* 对数据流中从sect_off开始的sec_cnt个扇区调用io读写，LBA连续的块合并为一次传输 */
+static void stream_io(uint32_t *all_blocks, uint32_t sect_off, uint8_t *buf, uint32_t sec_cnt,
+                      void (*io)(struct disk *, uint32_t, void *, uint32_t))
+{
+    uint32_t block_sects = cur_part->sb->block_sects;
+    while (sec_cnt > 0)
+    {
+        uint32_t blk_idx = sect_off / block_sects;
+        uint32_t blk_lba = all_blocks[blk_idx];
+        uint32_t cnt = block_sects - sect_off % block_sects;
+        uint32_t blk_cnt = 1;
+        while (cnt < sec_cnt && all_blocks[blk_idx + blk_cnt] == blk_lba + blk_cnt * block_sects)
+        {
+            cnt += block_sects;
+            blk_cnt++;
+        }
+        if (cnt > sec_cnt) cnt = sec_cnt;
+
+        ASSERT(blk_lba != 0);
+        io(cur_part->my_disk, blk_lba + sect_off % block_sects, buf, cnt);
+        buf += cnt * SECTOR_SIZE;
+        sect_off += cnt;
+        sec_cnt -= cnt;
+    }
+}
+
+/* 为数据流分配块直到能容纳sec_cnt个扇区，新块接在已有的块之后，
+   分配的块在块位图中的下标范围记录在first_bit和last_bit中，成功返回0，失败返回-1 */
+static int32_t stream_grow(struct inode *inode, uint32_t *all_blocks, uint32_t sec_cnt,
+                           uint32_t *first_bit, uint32_t *last_bit)
+{
+    uint32_t block_sects = cur_part->sb->block_sects;
+    uint32_t need_blocks = DIV_ROUND_UP(sec_cnt, block_sects);
+    if (need_blocks > INODE_BLOCKS_MAX(cur_part->sb))
+    {
+        printk("stream_grow: compressed stream of inode %d is full\n", inode->i_no);
+        return -1;
+    }
+
+    uint32_t block_idx = 0;
+    while (block_idx < need_blocks && all_blocks[block_idx] != 0) block_idx++;
+    uint32_t prev_lba = block_idx == 0 ? block_goal_of_inode(cur_part, inode->i_no) : all_blocks[block_idx - 1] + block_sects;
+
+    int32_t block_lba;
+    uint32_t bit_idx;
+    while (block_idx < need_blocks)
+    {
+        /* 需要新建一级间接表，放在已有数据之后 */
+        if (block_idx == 12 && inode->i_sectors[12] == 0)
+        {
+            block_lba = block_bitmap_alloc_near(cur_part, prev_lba);
+            if (block_lba == -1) goto fail;
+            inode->i_sectors[12] = block_lba;
+            prev_lba = block_lba + block_sects;
+            bit_idx = block_bitmap_idx_of(cur_part, block_lba);
+            if (bit_idx < *first_bit) *first_bit = bit_idx;
+            if (bit_idx > *last_bit) *last_bit = bit_idx;
+        }
+
+        block_lba = block_bitmap_alloc_near(cur_part, prev_lba);
+        if (block_lba == -1) goto fail;
+        if (block_idx < 12) inode->i_sectors[block_idx] = block_lba;
+        all_blocks[block_idx++] = block_lba;
+        prev_lba = block_lba + block_sects;
+        bit_idx = block_bitmap_idx_of(cur_part, block_lba);
+        if (bit_idx < *first_bit) *first_bit = bit_idx;
+        if (bit_idx > *last_bit) *last_bit = bit_idx;
+    }
+    return 0;
+
+fail:
+    printk("stream_grow: block_bitmap_alloc failed\n");
+    return -1;
+}
+
+/* 读出inode的第chunk_idx块并解压到buf，buf至少COMPRESS_CHUNK_SIZE字节，文件末尾之后填0，
+   成功返回块中有效数据的字节数，数据损坏返回-1 */
+int32_t compress_read_chunk(struct inode *inode, uint32_t chunk_idx, uint8_t *buf)
+{
+    memset(buf, 0, COMPRESS_CHUNK_SIZE);
+    uint32_t chunk_start = chunk_idx * COMPRESS_CHUNK_SIZE;
+    if (chunk_start >= inode->i_size) return 0;
+    uint32_t len = inode->i_size - chunk_start < COMPRESS_CHUNK_SIZE ? inode->i_size - chunk_start : COMPRESS_CHUNK_SIZE;
+
+    int32_t ret = len;
+    lock_acquire(&compress_lock);
+    struct chunk_table *table = chunk_table_get(inode, 0);
+    if (table == NULL || table->chunks[chunk_idx].stored_len == 0)
+    {
+        lock_release(&compress_lock);
+        return table == NULL ? -1 : ret;
+    }
+    struct chunk_entry *entry = &table->chunks[chunk_idx];
+    uint32_t sec_cnt = DIV_ROUND_UP(entry->stored_len, SECTOR_SIZE);
+
+    uint32_t *all_blocks = (uint32_t *)sys_malloc(INODE_BLOCKS_MAX(cur_part->sb) * sizeof(uint32_t));
+    uint8_t *stored = entry->flags & CHUNK_LZ4 ? get_kernel_pages(1) : buf;
+    if (all_blocks == NULL || stored == NULL)
+    {
+        printk("compress_read_chunk: alloc memory failed\n");
+        ret = -1;
+        goto out;
+    }
+    inode_collect_blocks(cur_part, inode, all_blocks);
+
+    /* 原样存放的块直接读入buf，压缩的块读入后再解压 */
+    stream_io(all_blocks, entry->sect_off, stored, sec_cnt, ide_read);
+    if (entry->flags & CHUNK_LZ4 && lz4_decompress(stored, entry->stored_len, buf, COMPRESS_CHUNK_SIZE) != (int32_t)len)
+    {
+        printk("compress_read_chunk: chunk %d of inode %d is corrupted\n", chunk_idx, inode->i_no);
+        memset(buf, 0, COMPRESS_CHUNK_SIZE);
+        ret = -1;
+    }
+
+out:
+    if (all_blocks != NULL) sys_free(all_blocks);
+    if (stored != NULL && stored != buf) mfree_page(PF_KERNEL, stored, 1);
+    lock_release(&compress_lock);
+    return ret;
+}
+
+/* 在used中标记数据流中被块表引用的扇区，位图长度按数据流最大的扇区数 */
+static void stream_used_init(struct chunk_table *table, struct bitmap *used)
+{
+    used->btmp_bytes_len = DIV_ROUND_UP(INODE_BLOCKS_MAX(cur_part->sb) * cur_part->sb->block_sects, 8);
+    bitmap_init(used);
+    uint32_t chunk_idx = 0;
+    while (chunk_idx < COMPRESS_CHUNKS_MAX(cur_part->sb))
+    {
+        struct chunk_entry *entry = &table->chunks[chunk_idx++];
+        uint32_t sect = entry->sect_off;
+        uint32_t sect_end = sect + DIV_ROUND_UP(entry->stored_len, SECTOR_SIZE);
+        while (sect < sect_end) bitmap_set(used, sect++, 1);
+    }
+}
+
+/* 压缩chunk中len字节的数据作为inode的第chunk_idx块写入数据流，压缩后至少省下一个扇区才存放压缩数据。
+   新数据从不覆盖原来的扇区，硬盘上已提交的块表在新块表提交前仍然引用它们，
+   used不为NULL时放在其中第一段足够大的空闲扇区，否则追加到流的末尾，成功返回0，失败返回-1 */
+static int32_t chunk_store(struct inode *inode, struct chunk_table *table, uint32_t *all_blocks, uint32_t chunk_idx,
+                           uint8_t *chunk, uint32_t len, uint8_t *out, uint16_t *hash_table, struct bitmap *used,
+                           uint32_t *first_bit, uint32_t *last_bit)
+{
+    uint32_t raw_sects = DIV_ROUND_UP(len, SECTOR_SIZE);
+    int32_t out_len = -1;
+    if (raw_sects > 1) out_len = lz4_compress(chunk, len, out, (raw_sects - 1) * SECTOR_SIZE, hash_table);
+
+    uint8_t *data = out_len == -1 ? chunk : out;
+    uint32_t stored_len = out_len == -1 ? len : (uint32_t)out_len;
+    uint32_t sec_cnt = DIV_ROUND_UP(stored_len, SECTOR_SIZE);
+    memset(data + stored_len, 0, sec_cnt * SECTOR_SIZE - stored_len);
+
+    uint32_t sect_off = table->stream_sects;
+    if (used != NULL)
+    {
+        int32_t free_off = bitmap_scan(used, sec_cnt);
+        if (free_off != -1) sect_off = free_off;
+    }
+
+    if (sect_off + sec_cnt > table->stream_sects && stream_grow(inode, all_blocks, sect_off + sec_cnt, first_bit, last_bit) == -1)
+        return -1;
+    stream_io(all_blocks, sect_off, data, sec_cnt, ide_write);
+
+    /* 原来的扇区在used中保持占用，本次写入不会再用，块表提交之后的写入才能重新使用 */
+    if (used != NULL)
+    {
+        uint32_t sect = sect_off;
+        while (sect < sect_off + sec_cnt) bitmap_set(used, sect++, 1);
+    }
+    if (sect_off + sec_cnt > table->stream_sects) table->stream_sects = sect_off + sec_cnt;
+    struct chunk_entry *entry = &table->chunks[chunk_idx];
+    entry->sect_off = sect_off;
+    entry->stored_len = stored_len;
+    entry->flags = out_len == -1 ? 0 : CHUNK_LZ4;
+    return 0;
+}
+
+/* 把buf中的count个字节写入压缩的文件inode从pos开始的位置，覆盖已有的数据，超出文件末尾的部分追加，
+   pos不能超过文件大小，涉及的每一块都要重新压缩，块表和块映射作为元数据经过日志写入，
+   由调用者保证同一文件的写入互斥，成功返回字节数，失败返回-1 */
+int32_t compress_write(struct inode *inode, uint32_t pos, const void *buf, uint32_t count)
+{
+    ASSERT(inode->i_flags & INODE_COMPRESSED && pos <= inode->i_size);
+    if (DIV_ROUND_UP(pos + count, COMPRESS_CHUNK_SIZE) > COMPRESS_CHUNKS_MAX(cur_part->sb))
+    {
+        printk("compress_write: exceed max compressed file size\n");
+        return -1;
+    }
+
+    int32_t ret = count;
+    lock_acquire(&compress_lock);
+    struct chunk_table *table = chunk_table_get(inode, 1);
+    uint32_t *all_blocks = (uint32_t *)sys_malloc(INODE_BLOCKS_MAX(cur_part->sb) * sizeof(uint32_t));
+    uint8_t *chunk = get_kernel_pages(1);
+    uint8_t *out = get_kernel_pages(1);
+    uint16_t *hash_table = get_kernel_pages(1);
+    if (table == NULL || all_blocks == NULL || chunk == NULL || out == NULL || hash_table == NULL)
+    {
+        printk("compress_write: alloc memory failed\n");
+        ret = -1;
+        goto out;
+    }
+    inode_collect_blocks(cur_part, inode, all_blocks);
+
+    /* 块表上次的修改已经提交时，硬盘上的块表与内存中的相同，它没有引用的扇区都可以重新使用；
+       否则只追加到流的末尾，分配位图的内存失败时也一样 */
+    struct bitmap used_map;
+    struct bitmap *used = NULL;
+    if (journal_committed(cur_part, inode->i_ctable_seq) && (used_map.bits = get_kernel_pages(1)) != NULL)
+    {
+        stream_used_init(table, &used_map);
+        used = &used_map;
+    }
+
+    const uint8_t *src = buf;
+    uint32_t first_bit = 0xffffffff, last_bit = 0;
+    while (count > 0)
+    {
+        uint32_t chunk_idx = pos / COMPRESS_CHUNK_SIZE;
+        uint32_t chunk_start = chunk_idx * COMPRESS_CHUNK_SIZE;
+        uint32_t chunk_off = pos % COMPRESS_CHUNK_SIZE;
+        uint32_t chunk_size = COMPRESS_CHUNK_SIZE - chunk_off < count ? COMPRESS_CHUNK_SIZE - chunk_off : count;
+
+        /* 块中已有的数据没有被全部覆盖时，先读出原来的内容 */
+        uint32_t old_len = 0;
+        if (chunk_start < inode->i_size)
+            old_len = inode->i_size - chunk_start < COMPRESS_CHUNK_SIZE ? inode->i_size - chunk_start : COMPRESS_CHUNK_SIZE;
+        if (old_len > 0 && (chunk_off > 0 || chunk_size < old_len))
+        {
+            if (compress_read_chunk(inode, chunk_idx, chunk) == -1)
+            {
+                ret = -1;
+                break;
+            }
+        }
+        else
+        {
+            memset(chunk, 0, COMPRESS_CHUNK_SIZE);
+        }
+        memcpy(chunk + chunk_off, src, chunk_size);
+
+        uint32_t len = chunk_off + chunk_size > old_len ? chunk_off + chunk_size : old_len;
+        if (chunk_store(inode, table, all_blocks, chunk_idx, chunk, len, out, hash_table, used, &first_bit, &last_bit) == -1)
+        {
+            ret = -1;
+            break;
+        }
+
+        src += chunk_size;
+        pos += chunk_size;
+        count -= chunk_size;
+        if (pos > inode->i_size) inode->i_size = pos;
+    }
+
+    /* 本次分配的块所在的位图扇区统一同步一次，再写入一级间接表、块表和inode */
+    if (first_bit <= last_bit) bitmap_sync_range(cur_part, first_bit, last_bit, BLOCK_BITMAP);
+    if (first_bit <= last_bit && inode->i_sectors[12] != 0)
+        journal_write(cur_part->my_disk, inode->i_sectors[12], all_blocks + 12, cur_part->sb->block_sects);
+    journal_write(cur_part->my_disk, inode->i_ctable, table, cur_part->sb->block_sects);
+    inode->i_ctable_seq = journal_txn_seq();
+    inode_mark_dirty(cur_part, inode);
+    if (used != NULL) mfree_page(PF_KERNEL, used->bits, 1);
+
+out:
+    if (all_blocks != NULL) sys_free(all_blocks);
+    if (chunk != NULL) mfree_page(PF_KERNEL, chunk, 1);
+    if (out != NULL) mfree_page(PF_KERNEL, out, 1);
+    if (hash_table != NULL) mfree_page(PF_KERNEL, hash_table, 1);
+    lock_release(&compress_lock);
+    return ret;
+}
+
+/* inode最后一次关闭时释放缓存的块表 */
+void compress_release(struct inode *inode)
+{
+    if (inode->i_chunks == NULL) return;
+    mfree_page(PF_KERNEL, inode->i_chunks, 1);
+    inode->i_chunks = NULL;
+}
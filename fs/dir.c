@@ -10,6 +10,7 @@
 #include "string.h"
 #include "interrupt.h"
 #include "super_block.h"
+#include "journal.h"
 
 struct dir root_dir;            // 根目录
 
@@ -18,6 +19,7 @@ void open_root_dir(struct partition *part)
 {
     root_dir.inode = inode_open(part, part->sb->root_inode_no);
     root_dir.dir_pos = 0;
+    root_dir.dir_blk_idx = root_dir.dir_blk_ent = root_dir.dir_cursor_pos = 0;
 }
 
 /* 在分区part上打开i节点为inode_no的目录并返回目录指针 */
@@ -26,6 +28,7 @@ struct dir *dir_open(struct partition *part, uint32_t inode_no)
     struct dir *pdir = (struct dir *)sys_malloc(sizeof(struct dir));
     pdir->inode = inode_open(part, inode_no);
     pdir->dir_pos = 0;
+    pdir->dir_blk_idx = pdir->dir_blk_ent = pdir->dir_cursor_pos = 0;
     return pdir;
 }
 
@@ -33,10 +36,10 @@ struct dir *dir_open(struct partition *part, uint32_t inode_no)
    找到返回1，并将其目录项存入dir_e，否则返回0 */
 int search_dir_entry(struct partition *part, struct dir *pdir, const char *name, struct dir_entry *dir_e)
 {
-    uint32_t block_cnt = 140;       // 12个直接块+128个一级间接块
+    uint32_t block_cnt = INODE_BLOCKS_MAX(part->sb);       // 12个直接块+一级间接块
     
-    /* 12个直接块大小+128个一级间接块大小 */
-    uint32_t *all_blocks = (uint32_t *)sys_malloc(48 + 512);
+    /* 12个直接块大小+一级间接块表大小 */
+    uint32_t *all_blocks = (uint32_t *)sys_malloc(48 + part->sb->block_size);
     if (all_blocks == NULL) 
     {
         printk("search_dir_entry: sys_malloc for all_blocks failed");
@@ -44,23 +47,15 @@ int search_dir_entry(struct partition *part, struct dir *pdir, const char *name,
     }
 
     uint32_t block_idx = 0;
-    while (block_idx < 12)
-    {
-        all_blocks[block_idx] = pdir->inode->i_sectors[block_idx];
-        block_idx++;
-    }
-    block_idx = 0;
-
-    if (pdir->inode->i_sectors[12] != 0)        // 若还有一级间接表 
-        ide_read(part->my_disk, pdir->inode->i_sectors[12], all_blocks + 12, 1);
+    inode_collect_blocks(part, pdir->inode, all_blocks);
 
    /* 此时all_block存储的是pdir的所有目录项的扇区lba地址 */ 
     
-    /* 写目录项的时候已保证目录项不会跨扇区 */
-    uint8_t *buf = (uint8_t *)sys_malloc(SECTOR_SIZE);
+    /* 写目录项的时候已保证目录项不会跨块 */
+    uint8_t *buf = (uint8_t *)sys_malloc(part->sb->block_size);
     struct dir_entry *p_de = (struct dir_entry *)buf;
     uint32_t dir_entry_size = part->sb->dir_entry_size;
-    uint32_t dir_entry_cnt = SECTOR_SIZE / dir_entry_size;  // 1扇区可容纳的目录项
+    uint32_t dir_entry_cnt = part->sb->block_size / dir_entry_size;  // 1块可容纳的目录项
     
     /* 开始在所有块中查找符合条件的目录 */
     while (block_idx < block_cnt)
@@ -71,10 +66,10 @@ int search_dir_entry(struct partition *part, struct dir *pdir, const char *name,
             block_idx++;
             continue;
         }
-        ide_read(part->my_disk, all_blocks[block_idx], buf, 1);
+        inode_block_read(part, pdir->inode, all_blocks[block_idx], buf);
         
         uint32_t dir_entry_idx = 0;
-        /* 遍历一个扇区的目录项 */
+        /* 遍历一个块的目录项 */
         while (dir_entry_idx < dir_entry_cnt)
         {
             /* 找到了直接复制这个目录项 */
@@ -92,7 +87,7 @@ int search_dir_entry(struct partition *part, struct dir *pdir, const char *name,
         
         block_idx++;
         p_de = (struct dir_entry *)buf;         // 从新让p_de指向buf开头，进行下一个block的遍历
-        memset(buf, 0, SECTOR_SIZE);            // 清空缓冲区
+        memset(buf, 0, part->sb->block_size);   // 清空缓冲区
     }
 
     sys_free(buf);   
@@ -121,43 +116,32 @@ void create_dir_entry(char *filename, uint32_t inode_no, uint8_t file_type, stru
     p_de->f_type = file_type;
 }
 
-/* 将目录项p_de写入到父目录parent_dir中 */
-int sync_dir_entry(struct dir* parent_dir, struct dir_entry *p_de, void *io_buf)
+/* 在目录dir_inode的块中找空位写入目录项p_de，all_blocks是目录的全部块地址，
+   io_buf至少能容纳一个块 */
+static int sync_dir_entry_blocks(struct inode *dir_inode, struct dir_entry *p_de, void *io_buf, uint32_t *all_blocks)
 {
-    struct inode *dir_inode = parent_dir->inode;
-    uint32_t dir_size = dir_inode->i_size;
     uint32_t dir_entry_size = cur_part->sb->dir_entry_size;
-
-    /* dir_size应该是dir_entry_size的整数倍 */
-    ASSERT(dir_size % dir_entry_size == 0);
-    
-    uint32_t dir_entrys_per_sec = (512 / dir_entry_size);        // 每扇区容纳的目录项数
+    uint32_t block_sects = cur_part->sb->block_sects;
+    uint32_t dir_entrys_per_blk = (cur_part->sb->block_size / dir_entry_size);     // 每块容纳的目录项数
+    uint32_t block_cnt = INODE_BLOCKS_MAX(cur_part->sb);
     int32_t block_lba = -1;
-
-    /* 记录父目录的内容所在扇区 */
-    uint8_t block_idx = 0;
-    uint32_t all_blocks[140] = {0, };
-
-    /* 复制前12个直接项 */
-    while (block_idx < 12)
-    {
-        all_blocks[block_idx] = dir_inode->i_sectors[block_idx];
-        block_idx++;
-    }
     
     struct dir_entry *dir_e = (struct dir_entry *)io_buf;
     int32_t block_bitmap_idx = -1;
 
     /* 开始遍历所有块寻找目录项空位，
-       若扇区中没有空位在不超过文件大小的情况下申请新的扇区存放新的目录项 */
-    block_idx = 0;
-    while (block_idx < 140)
+       若块中没有空位在不超过文件大小的情况下申请新的块存放新的目录项 */
+    uint32_t block_idx = 0;
+    while (block_idx < block_cnt)
     {
         block_bitmap_idx = -1;
         if (all_blocks[block_idx] == 0)
         {
             // 之前的block都满了，但是该目录还有空闲的block
-            block_lba = block_bitmap_alloc(cur_part);
+            /* 目录的数据块尽量接在上一块之后，第一块放在目录inode对应的位置附近 */
+            uint32_t goal_lba = block_idx > 0 && all_blocks[block_idx - 1] ? \
+                                all_blocks[block_idx - 1] + block_sects : block_goal_of_inode(cur_part, dir_inode->i_no);
+            block_lba = block_bitmap_alloc_near(cur_part, goal_lba);
             if (block_lba == -1) 
             {
                 printk("alloc block bitmap for sync_dir_entry failed\n");
@@ -165,7 +149,7 @@ int sync_dir_entry(struct dir* parent_dir, struct dir_entry *p_de, void *io_buf)
             }
 
             /* 每分配一个块就同步一次bitmap */   
-            block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
+            block_bitmap_idx = block_bitmap_idx_of(cur_part, block_lba);
             ASSERT(block_bitmap_idx != -1);
             bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
 
@@ -175,58 +159,58 @@ int sync_dir_entry(struct dir* parent_dir, struct dir_entry *p_de, void *io_buf)
                 // 直接块
                 dir_inode->i_sectors[block_idx] = all_blocks[block_idx] = block_lba;
             }
-            else if (block_idx == 12)
+            else if (dir_inode->i_sectors[12] == 0)
             {
                 // 直接块全部分配完毕，所以必须分配一级间接块
                 dir_inode->i_sectors[12] = block_lba;           // 之前分配的块作为一级间接表的位置
                 block_lba = -1;
-                block_lba = block_bitmap_alloc(cur_part);       // 在分配一个块作为目录的数据块  
+                block_lba = block_bitmap_alloc_near(cur_part, dir_inode->i_sectors[12] + block_sects);   // 在分配一个块作为目录的数据块  
                 if (block_lba == -1)
                 {
                     /* 如果分配失败释放一级块的地址 */
-                    block_bitmap_idx = dir_inode->i_sectors[12] - cur_part->sb->data_start_lba;
-                    bitmap_set(&cur_part->block_bitmap, block_bitmap_idx, 0);
+                    block_bitmap_idx = block_bitmap_idx_of(cur_part, dir_inode->i_sectors[12]);
+                    part_bitmap_set(cur_part, BLOCK_BITMAP, block_bitmap_idx, 0);
                     dir_inode->i_sectors[12] = 0;
                     printk("alloc block bitmap for sync_dir_entry failed!\n");
                     return 0;
                 }
                 
                 /* 同步block_bitmap到磁盘 */
-                block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
+                block_bitmap_idx = block_bitmap_idx_of(cur_part, block_lba);
                 ASSERT(block_bitmap_idx != -1);
                 bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
                 
                 all_blocks[12] = block_lba;
                 /* 把分配的第0个间接块地址写入到磁盘的一级块表中 */
-                ide_write(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
+                journal_write(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, block_sects);
             }
             else
             {
                 /* 间接块没有分配 */
                 all_blocks[block_idx] = block_lba;
                 /* 把新分配的第block_idx-12间接块写入一级间接表 */
-                ide_write(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
+                journal_write(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, block_sects);
             }
 
             /* 将新的目录向p_de写入到新分配的间接表块 */
-            memset(io_buf, 0, 512);
+            memset(io_buf, 0, cur_part->sb->block_size);
             memcpy(io_buf, p_de, dir_entry_size);   
-            ide_write(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
+            journal_write(cur_part->my_disk, all_blocks[block_idx], io_buf, block_sects);
             dir_inode->i_size += dir_entry_size;
             return 1;
         }
 
         /* 如果block_idx块已经存在，将其读进入内存中，然后在该块中查找空位 */
-        ide_read(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
-        /* 在扇区内查找空目录项 */
-        uint8_t dir_entry_idx = 0;
-        while (dir_entry_idx < dir_entrys_per_sec)
+        journal_read(cur_part->my_disk, all_blocks[block_idx], io_buf, block_sects);
+        /* 在块内查找空目录项 */
+        uint32_t dir_entry_idx = 0;
+        while (dir_entry_idx < dir_entrys_per_blk)
         {
             if ((dir_e + dir_entry_idx)->f_type == FT_UNKNOWN)
             {
                 // FT_UNKNOWN为0，初始化和删除文件都会把f_type设置为FT_UNKNOWN
                 memcpy(dir_e + dir_entry_idx, p_de, dir_entry_size);
-                ide_write(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
+                journal_write(cur_part->my_disk, all_blocks[block_idx], io_buf, block_sects);
                 
                 dir_inode->i_size += dir_entry_size;
                 return 1;
@@ -242,31 +226,74 @@ int sync_dir_entry(struct dir* parent_dir, struct dir_entry *p_de, void *io_buf)
     return 0;
 }
 
+/* 将目录项p_de写入到父目录parent_dir中，io_buf至少能容纳一个块 */
+int sync_dir_entry(struct dir* parent_dir, struct dir_entry *p_de, void *io_buf)
+{
+    struct inode *dir_inode = parent_dir->inode;
+    uint32_t dir_size = dir_inode->i_size;
+    uint32_t dir_entry_size = cur_part->sb->dir_entry_size;
+
+    /* dir_size应该是dir_entry_size的整数倍 */
+    ASSERT(dir_size % dir_entry_size == 0);
+
+    /* 内联目录中还有空位就直接放入，否则先把内联的目录项移到数据块中 */
+    if (dir_inode->i_flags & INODE_INLINE)
+    {
+        struct dir_entry *inline_e = (struct dir_entry *)dir_inode->i_sectors;
+        uint32_t inline_idx = 0;
+        while ((inline_idx + 1) * dir_entry_size <= INODE_INLINE_SIZE)
+        {
+            if (inline_e[inline_idx].f_type == FT_UNKNOWN)
+            {
+                memcpy(&inline_e[inline_idx], p_de, dir_entry_size);
+                dir_inode->i_size += dir_entry_size;
+                return 1;
+            }
+            inline_idx++;
+        }
+        if (inode_inline_to_block(cur_part, dir_inode) == -1) return 0;
+    }
+
+    /* 记录父目录的内容所在块，一级间接块表可能有上千项，不能放在栈上 */
+    uint32_t *all_blocks = (uint32_t *)sys_malloc(INODE_BLOCKS_MAX(cur_part->sb) * sizeof(uint32_t));
+    if (all_blocks == NULL)
+    {
+        printk("sync_dir_entry: sys_malloc for all_blocks failed\n");
+        return 0;
+    }
+    inode_collect_blocks(cur_part, dir_inode, all_blocks);
+
+    int ret = sync_dir_entry_blocks(dir_inode, p_de, io_buf, all_blocks);
+    sys_free(all_blocks);
+    return ret;
+}
+
 /* 把分区part的目录pdir中编号为inode_no的目录项删除 */
 int delete_dir_entry(struct partition *part, struct dir *pdir, uint32_t inode_no, void *io_buf)
 {
     struct inode *dir_inode = pdir->inode;
-    uint32_t block_idx = 0, all_blocks[140] = {0, };
-
-    /* 收集目录全部块地址 */
-    while (block_idx < 12)
+    uint32_t block_idx = 0, block_cnt = INODE_BLOCKS_MAX(part->sb);
+    uint32_t *all_blocks = (uint32_t *)sys_malloc(block_cnt * sizeof(uint32_t));
+    if (all_blocks == NULL)
     {
-        all_blocks[block_idx] = dir_inode->i_sectors[block_idx];
-        block_idx++;
+        printk("delete_dir_entry: sys_malloc for all_blocks failed\n");
+        return 0;
     }
-    if (dir_inode->i_sectors[12]) ide_read(part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
 
-    /* 目录项存储是保证不会跨多个扇区 */
+    /* 收集目录全部块地址 */
+    inode_collect_blocks(part, dir_inode, all_blocks);
+
+    /* 目录项存储是保证不会跨多个块 */
     uint32_t dir_entry_size = part->sb->dir_entry_size;
-    uint32_t dir_entrys_per_sec = (SECTOR_SIZE / dir_entry_size);
+    uint32_t dir_entrys_per_blk = (part->sb->block_size / dir_entry_size);
     struct dir_entry *dir_e = (struct dir_entry *)io_buf;
     struct dir_entry *dir_entry_found = NULL;
-    uint8_t dir_entry_idx, dir_entry_cnt;
+    uint32_t dir_entry_idx, dir_entry_cnt;
     int is_dir_first_block = 0;
 
     /* 遍历所有块找目录项 */
     block_idx = 0;
-    while (block_idx < 140)
+    while (block_idx < block_cnt)
     {
         is_dir_first_block = 0;
         if (all_blocks[block_idx] == 0)
@@ -275,12 +302,12 @@ int delete_dir_entry(struct partition *part, struct dir *pdir, uint32_t inode_no
             continue;
         }
         dir_entry_idx = dir_entry_cnt = 0;
-        memset(io_buf, 0, SECTOR_SIZE);
-        /* 读取目录项所在的扇区 */
-        ide_read(part->my_disk, all_blocks[block_idx], io_buf, 1);
+        memset(io_buf, 0, part->sb->block_size);
+        /* 读取目录项所在的块 */
+        inode_block_read(part, dir_inode, all_blocks[block_idx], io_buf);
         
-        /* 遍历该扇区所有目录项 */
-        while (dir_entry_idx < dir_entrys_per_sec)
+        /* 遍历该块所有目录项 */
+        while (dir_entry_idx < dir_entrys_per_blk)
         {
             if ((dir_e + dir_entry_idx)->f_type != FT_UNKNOWN)
             {
@@ -316,8 +343,8 @@ int delete_dir_entry(struct partition *part, struct dir *pdir, uint32_t inode_no
         if (dir_entry_cnt == 1 && !is_dir_first_block)
         {
             /* 在块位图中回收块 */
-            uint32_t block_bitmap_idx = all_blocks[block_idx] - part->sb->data_start_lba;
-            bitmap_set(&part->block_bitmap, block_bitmap_idx, 0);
+            uint32_t block_bitmap_idx = block_bitmap_idx_of(part, all_blocks[block_idx]);
+            part_bitmap_set(part, BLOCK_BITMAP, block_bitmap_idx, 0);
             bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
 
             /* 将块地址从数组的i_sectors中去除 */
@@ -331,12 +358,13 @@ int delete_dir_entry(struct partition *part, struct dir *pdir, uint32_t inode_no
                 uint32_t indirect_blocks = 0;
                 uint32_t indirect_block_idx = 12;
                 /* 判断一级间接表中块的数量，如果只有一个则连同一级间接表一起清空 */
-                while (indirect_block_idx < 140)
+                while (indirect_block_idx < block_cnt)
                 {
                     if (all_blocks[indirect_block_idx] != 0)
                     {
                         indirect_blocks++;
                     }
+                    indirect_block_idx++;
                 }
                 ASSERT(indirect_blocks >= 1);
 
@@ -344,13 +372,13 @@ int delete_dir_entry(struct partition *part, struct dir *pdir, uint32_t inode_no
                 {
                     /* 间接表中不知一个块 */
                     all_blocks[block_idx] = 0;
-                    ide_write(part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
+                    journal_write(part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, part->sb->block_sects);
                 }
                 else
                 {
                     /* 间接表中只有一个块 */
-                    block_bitmap_idx = dir_inode->i_sectors[12] - part->sb->data_start_lba;
-                    bitmap_set(&part->block_bitmap, block_bitmap_idx, 0);
+                    block_bitmap_idx = block_bitmap_idx_of(part, dir_inode->i_sectors[12]);
+                    part_bitmap_set(part, BLOCK_BITMAP, block_bitmap_idx, 0);
                     bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
                     
                     dir_inode->i_sectors[12] = 0;
@@ -361,19 +389,21 @@ int delete_dir_entry(struct partition *part, struct dir *pdir, uint32_t inode_no
         {
             /* 直接将目录项清空 */
             memset(dir_entry_found, 0, dir_entry_size);
-            ide_write(part->my_disk, all_blocks[block_idx], io_buf, 1);
+            inode_block_write(part, dir_inode, all_blocks[block_idx], io_buf);
         }
 
         /* 更改i节点信息同步硬盘 */
         ASSERT(dir_inode->i_size >= dir_entry_size);
         dir_inode->i_size -= dir_entry_size;
-        memset(io_buf, 0, SECTOR_SIZE * 2);
+        memset(io_buf, 0, part->sb->block_size);
         inode_sync(part, dir_inode, io_buf);
 
+        sys_free(all_blocks);
         return 1;
     }
     
     /* 没有找到目标目录项 */
+    sys_free(all_blocks);
     return 0;
 }
 
@@ -382,29 +412,22 @@ struct dir_entry *dir_read(struct dir *dir)
 {
     struct dir_entry *dir_e = (struct dir_entry *)dir->dir_buf;
     struct inode *dir_inode = dir->inode;
-    uint32_t all_blocks[140] = {0, }, block_cnt = 12;
+    uint32_t block_cnt = INODE_BLOCKS_MAX(cur_part->sb);
     uint32_t block_idx = 0, dir_entry_idx = 0;
+    struct dir_entry *found = NULL;
+    uint32_t *all_blocks = (uint32_t *)sys_malloc(block_cnt * sizeof(uint32_t));
+    if (all_blocks == NULL) return NULL;
     
     /* 读取目录项占用的所有LBA地址 */
-    while (block_idx < 12)
-    {
-        all_blocks[block_idx] = dir_inode->i_sectors[block_idx];
-        block_idx++;
-    }
-    if (dir_inode->i_sectors[12] != 0)
-    {
-        ide_read(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
-        block_cnt = 140;
-    }
-    block_idx = 0;
+    inode_collect_blocks(cur_part, dir_inode, all_blocks);
 
     uint32_t cur_dir_entry_pos = 0;     // 当前目录项偏移，用于判断是否之前返回的目录项
     uint32_t dir_entry_size = cur_part->sb->dir_entry_size;
-    uint32_t dir_entrys_per_sec = SECTOR_SIZE / dir_entry_size;
+    uint32_t dir_entrys_per_blk = cur_part->sb->block_size / dir_entry_size;
     /* 因为目录中可能删除了某些文件的目录项，导致目录项排列并不是连续的 */
-    while (block_idx < block_cnt)
+    while (block_idx < block_cnt && found == NULL)
     {
-        if (dir->dir_pos >= dir_inode->i_size) return NULL;
+        if (dir->dir_pos >= dir_inode->i_size) break;
 
         if (all_blocks[block_idx] == 0)
         {
@@ -412,12 +435,12 @@ struct dir_entry *dir_read(struct dir *dir)
             continue;
         }
         
-        memset(dir_e, 0, SECTOR_SIZE);
+        memset(dir_e, 0, cur_part->sb->block_size);
         /* 读取磁盘中的目录项到dir结构的缓冲中 */
-        ide_read(cur_part->my_disk, all_blocks[block_idx], dir_e, 1);
+        inode_block_read(cur_part, dir_inode, all_blocks[block_idx], dir_e);
         dir_entry_idx = 0;
-        /* 再遍历扇区内的所有目录项 */
-        while (dir_entry_idx < dir_entrys_per_sec)
+        /* 再遍历块内的所有目录项 */
+        while (dir_entry_idx < dir_entrys_per_blk)
         {
             if ((dir_e + dir_entry_idx)->f_type)
             {
@@ -433,7 +456,8 @@ struct dir_entry *dir_read(struct dir *dir)
 
                 ASSERT(cur_dir_entry_pos == dir->dir_pos);
                 dir->dir_pos += dir_entry_size;
-                return dir_e + dir_entry_idx;
+                found = dir_e + dir_entry_idx;
+                break;
             }           
             
             dir_entry_idx++;
@@ -442,7 +466,78 @@ struct dir_entry *dir_read(struct dir *dir)
         block_idx++;
     }
 
-    return NULL;
+    sys_free(all_blocks);
+    return found;
+}
+
+/* 从dir的游标处读出最多count个目录项到buf，每个目录块只读一次，下次调用从游标所在的块继续，
+   flags带GETDENTS_STAT时同时填写文件大小，返回读出的目录项数，读完返回0，失败返回-1 */
+int32_t dir_read_batch(struct dir *dir, struct dirent *buf, uint32_t count, uint32_t flags)
+{
+    struct dir_entry *dir_e = (struct dir_entry *)dir->dir_buf;
+    struct inode *dir_inode = dir->inode;
+    uint32_t block_cnt = INODE_BLOCKS_MAX(cur_part->sb);
+    uint32_t *all_blocks = (uint32_t *)sys_malloc(block_cnt * sizeof(uint32_t));
+    if (all_blocks == NULL) return -1;
+    inode_collect_blocks(cur_part, dir_inode, all_blocks);
+
+    uint32_t cur_dir_entry_pos = 0;     // 当前有效目录项的偏移，和dir_pos比较跳过已经返回的目录项
+    uint32_t dir_entry_size = cur_part->sb->dir_entry_size;
+    uint32_t dir_entrys_per_blk = cur_part->sb->block_size / dir_entry_size;
+    uint32_t block_idx = 0, dir_entry_idx = 0, filled = 0;
+    /* 游标有效时从游标处继续，否则（刚打开、rewinddir或用readdir读过）从头数过已经返回的目录项 */
+    if (dir->dir_cursor_pos == dir->dir_pos)
+    {
+        block_idx = dir->dir_blk_idx;
+        dir_entry_idx = dir->dir_blk_ent;
+        cur_dir_entry_pos = dir->dir_pos;
+    }
+    while (block_idx < block_cnt && filled < count && dir->dir_pos < dir_inode->i_size)
+    {
+        if (all_blocks[block_idx] == 0)
+        {
+            block_idx++;
+            dir_entry_idx = 0;
+            continue;
+        }
+
+        inode_block_read(cur_part, dir_inode, all_blocks[block_idx], dir_e);
+        while (dir_entry_idx < dir_entrys_per_blk && filled < count)
+        {
+            struct dir_entry *p_de = dir_e + dir_entry_idx++;
+            if (p_de->f_type == FT_UNKNOWN) continue;
+            if (cur_dir_entry_pos < dir->dir_pos)
+            {
+                cur_dir_entry_pos += dir_entry_size;
+                continue;
+            }
+
+            struct dirent *d = buf + filled++;
+            memcpy(d->d_name, p_de->filename, MAX_FILE_NAME_LEN);
+            d->d_ino = p_de->i_no;
+            d->d_type = p_de->f_type;
+            d->d_size = 0;
+            if (flags & GETDENTS_STAT)
+            {
+                struct inode *inode = inode_open(cur_part, p_de->i_no);
+                inode_flush_dalloc(inode);
+                d->d_size = inode->i_size;
+                inode_close(inode);
+            }
+            cur_dir_entry_pos += dir_entry_size;
+            dir->dir_pos += dir_entry_size;
+        }
+        /* buf已满，游标停在块内 */
+        if (dir_entry_idx < dir_entrys_per_blk) break;
+        block_idx++;
+        dir_entry_idx = 0;
+    }
+
+    dir->dir_blk_idx = block_idx;
+    dir->dir_blk_ent = dir_entry_idx;
+    dir->dir_cursor_pos = dir->dir_pos;
+    sys_free(all_blocks);
+    return filled;
 }
 
 /* 判断目录是否为空 */
@@ -457,15 +552,15 @@ int dir_is_empty(struct dir *dir)
 int32_t dir_remove(struct dir *parent_dir, struct dir *child_dir)
 {
     struct inode *child_dir_inode = child_dir->inode;
-    /* 空目录只在inode->i_sectors[0]中有扇区 */
+    /* 空目录只在inode->i_sectors[0]中有扇区，或者是内联的 */
     int32_t block_idx = 1;
-    while (block_idx < 13)
+    while (block_idx < 13 && !(child_dir_inode->i_flags & INODE_INLINE))
     {
         ASSERT(child_dir_inode->i_sectors[block_idx] == 0);
         block_idx++;
     }
 
-    void *io_buf = sys_malloc(SECTOR_SIZE * 2);
+    void *io_buf = sys_malloc(cur_part->sb->block_size);
     if (io_buf == NULL)
     {
         printk("dir_remove: malloc for io_buf failed\n");
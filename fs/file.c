@@ -9,12 +9,24 @@
 #include "interrupt.h"
 #include "string.h"
 #include "thread.h"
+#include "sync.h"
+#include "timer.h"
+#include "page_cache.h"
+#include "journal.h"
+#include "compress.h"
+#include "tmpfs.h"
+#include "mmap.h"
 
 #define DEFAULT_SECS    1
 
 /* 打开文件表 */
 struct file file_table[MAX_FILE_OPEN];
 
+/* 保护延迟分配缓冲区，写回线程和写文件的进程会同时访问 */
+static struct lock dalloc_lock;
+
+static void file_prealloc_window(struct file *file, uint32_t prev_lba, uint32_t cnt);
+
 /* 从文件表中获取一个空闲位置，成功返回下标，失败返回-1 */
 int32_t get_free_slot_in_global(void)
 {
@@ -58,53 +70,124 @@ int32_t pcb_fd_install(uint32_t globa_fd_idx)
 /* 分配一个i节点，成功返回i节点号，失败返回-1 */
 int32_t inode_bitmap_alloc(struct partition *part)
 {
-    int32_t bit_idx = bitmap_scan(&part->inode_bitmap, 1);
+    int32_t bit_idx = part_bitmap_scan(part, INODE_BITMAP);
     if (bit_idx == -1) return -1;
     
-    bitmap_set(&part->inode_bitmap, bit_idx, 1);
+    part_bitmap_set(part, INODE_BITMAP, bit_idx, 1);
     return bit_idx;
 }
 
-/* 分配1个扇区，返回其扇区lba地址，失败返回-1 */
+/* 块的起始扇区LBA地址转换为块位图中的位索引 */
+uint32_t block_bitmap_idx_of(struct partition *part, uint32_t block_lba)
+{
+    return (block_lba - part->sb->data_start_lba) / part->sb->block_sects;
+}
+
+/* 块位图中的位索引转换为块的起始扇区LBA地址 */
+uint32_t block_lba_of(struct partition *part, uint32_t bit_idx)
+{
+    return part->sb->data_start_lba + bit_idx * part->sb->block_sects;
+}
+
+/* 分配1个块，返回其起始扇区lba地址，失败返回-1 */
 int32_t block_bitmap_alloc(struct partition *part)
 {
-    int32_t bit_idx = bitmap_scan(&part->block_bitmap, 1);
+    int32_t bit_idx = part_bitmap_scan(part, BLOCK_BITMAP);
     if (bit_idx == -1) return -1;
     
-    bitmap_set(&part->block_bitmap, bit_idx, 1);
+    part_bitmap_set(part, BLOCK_BITMAP, bit_idx, 1);
     /* 次函数返回不是位图索引，而是具体可用的扇区LBA地址 */
-    return (part->sb->data_start_lba + bit_idx);
+    return block_lba_of(part, bit_idx);
 }
 
-/* 将内存中的bitmap第bit_idx位所在的512字节扇区同步到硬盘 */
-void bitmap_sync(struct partition *part, uint32_t bit_idx, uint8_t btmp_type)
+/* 计算inode_no的数据默认放置的块LBA地址，按inode编号把数据分散到数据区的不同位置，
+   同时写入的多个文件以及各个目录的数据块不会互相交错 */
+uint32_t block_goal_of_inode(struct partition *part, uint32_t inode_no)
 {
-    uint32_t off_sec = bit_idx / 4096;          // 本i节点索引相对与位图扇区的偏移扇区
-    uint32_t off_size = off_sec * BLOCK_SIZE;   // 本i节点索引相对于位图的字节偏移
-    uint32_t sec_lba;
-    uint8_t *bitmap_off;   
-
-    /* 需要被同步到硬盘的位图只有inode_bitmap和block_bitmap */
-    switch (btmp_type)
-    {
-        case INODE_BITMAP:
-            sec_lba = part->sb->inode_bitmap_lba + off_sec;
-            bitmap_off = part->inode_bitmap.bits + off_size;
-            break;   
-        
-        case BLOCK_BITMAP:
-            sec_lba = part->sb->block_bitmap_lba + off_sec;
-            bitmap_off = part->block_bitmap.bits + off_size;
-            break;
+    struct super_block *sb = part->sb;
+    uint32_t data_blocks = (sb->sec_cnt - (sb->data_start_lba - sb->part_lba_base)) / sb->block_sects;
+    return block_lba_of(part, (data_blocks / sb->inode_cnt) * inode_no);
+}
+
+/* 从goal_lba开始分配1个块，之后没有空闲块时从头分配，返回其起始扇区lba地址，失败返回-1 */
+int32_t block_bitmap_alloc_near(struct partition *part, uint32_t goal_lba)
+{
+    int32_t bit_idx = -1;
+    if (goal_lba >= part->sb->data_start_lba)
+        bit_idx = part_bitmap_find_next_zero(part, BLOCK_BITMAP, block_bitmap_idx_of(part, goal_lba));
+    if (bit_idx == -1) bit_idx = part_bitmap_scan(part, BLOCK_BITMAP);
+    if (bit_idx == -1) return -1;
+
+    part_bitmap_set(part, BLOCK_BITMAP, bit_idx, 1);
+    return block_lba_of(part, bit_idx);
+}
+
+/* 在prev_lba之后为文件file预留最多cnt个连续块作为分配窗口，prev_lba为0时从inode对应的位置开始，
+   预留的块在内存位图中已置位，调用前窗口必须为空 */
+static void file_prealloc_window(struct file *file, uint32_t prev_lba, uint32_t cnt)
+{
+    ASSERT(file->fd_prealloc_cnt == 0);
+    uint32_t goal_lba = prev_lba ? prev_lba + cur_part->sb->block_sects : block_goal_of_inode(cur_part, file->fd_inode->i_no);
+    uint32_t goal = block_bitmap_idx_of(cur_part, goal_lba);
+
+    /* 紧挨着上一块的位置空闲就从那里开始，否则找一段足够长的空闲块 */
+    int32_t start = part_bitmap_find_next_zero(cur_part, BLOCK_BITMAP, goal);
+    if (start != (int32_t)goal) start = part_bitmap_find_next_zero_run(cur_part, BLOCK_BITMAP, goal, cnt);
+    if (start == -1) return;
+
+    uint32_t bits_len = cur_part->block_bitmap.bits_len;
+    uint32_t reserved = 0;
+    while (reserved < cnt && start + reserved < bits_len && !part_bitmap_test(cur_part, BLOCK_BITMAP, start + reserved))
+    {
+        part_bitmap_set(cur_part, BLOCK_BITMAP, start + reserved, 1);
+        reserved++;
+    }
+    file->fd_prealloc_lba = block_lba_of(cur_part, start);
+    file->fd_prealloc_cnt = reserved;
+}
+
+/* 为文件file分配下一个数据块，prev_lba是文件当前最后一块的地址，没有时为0，
+   优先从文件的预留窗口中取，窗口用完时在prev_lba之后重新预留PREALLOC_BLOCKS个连续块，
+   file_close时归还没有用到的块。成功返回块的LBA地址，失败返回-1 */
+int32_t file_block_alloc(struct file *file, uint32_t prev_lba)
+{
+    if (file->fd_prealloc_cnt == 0) file_prealloc_window(file, prev_lba, PREALLOC_BLOCKS);
+    if (file->fd_prealloc_cnt == 0)
+    {
+        /* 没有连续的空闲块了，零散地分配 */
+        uint32_t goal_lba = prev_lba ? prev_lba + cur_part->sb->block_sects : block_goal_of_inode(cur_part, file->fd_inode->i_no);
+        return block_bitmap_alloc_near(cur_part, goal_lba);
+    }
+
+    uint32_t block_lba = file->fd_prealloc_lba;
+    file->fd_prealloc_lba += cur_part->sb->block_sects;
+    file->fd_prealloc_cnt--;
+    return block_lba;
+}
+
+/* 归还文件预留窗口中没有用到的块 */
+void file_prealloc_release(struct file *file)
+{
+    if (file->fd_prealloc_cnt == 0) return;
+
+    uint32_t first_bit = block_bitmap_idx_of(cur_part, file->fd_prealloc_lba);
+    uint32_t last_bit = first_bit + file->fd_prealloc_cnt - 1;
+    uint32_t bit_idx = first_bit;
+    while (bit_idx <= last_bit)
+    {
+        part_bitmap_set(cur_part, BLOCK_BITMAP, bit_idx, 0);
+        bit_idx++;
     }
-    ide_write(part->my_disk, sec_lba, bitmap_off, 1);
+    /* 预留的块可能已随同一扇区的其他位同步到硬盘 */
+    bitmap_sync_range(cur_part, first_bit, last_bit, BLOCK_BITMAP);
+    file->fd_prealloc_cnt = 0;
 }
 
 /* 创建文件，成功返回文件描述符，失败返回-1 */
 int32_t file_create(struct dir *parent_dir, char *filename, uint8_t flag)
 {
     /* 后续操作的公共缓冲区 */
-    void *io_buf = sys_malloc(1024);
+    void *io_buf = sys_malloc(cur_part->sb->block_size);
     if (io_buf == NULL) 
     {
         printk("in file_creat: sys_malloc for io_buf failed\n");
@@ -144,6 +227,7 @@ int32_t file_create(struct dir *parent_dir, char *filename, uint8_t flag)
         goto rollback;
     }
     inode_init(inode_no, new_file_inode);
+    if (flag & O_COMPRESS) new_file_inode->i_flags |= INODE_COMPRESSED;
 
     /* 返回file_table空闲的下标 */
     int fd_idx = get_free_slot_in_global();
@@ -157,6 +241,9 @@ int32_t file_create(struct dir *parent_dir, char *filename, uint8_t flag)
     file_table[fd_idx].fd_inode = new_file_inode;
     file_table[fd_idx].fd_pos = 0;
     file_table[fd_idx].fd_flag = flag;
+    file_table[fd_idx].fd_prealloc_cnt = 0;
+    file_table[fd_idx].fd_wbuf = NULL;
+    file_table[fd_idx].fd_wbuf_len = 0;
     file_table[fd_idx].fd_inode->write_deny = 0;
 
     struct dir_entry new_dir_entry;
@@ -174,11 +261,11 @@ int32_t file_create(struct dir *parent_dir, char *filename, uint8_t flag)
         goto rollback;
     }
     
-    memset(io_buf, 0, 1024);   
+    memset(io_buf, 0, cur_part->sb->block_size);   
     /* 将父目录i节点的内容同步到硬盘 */
     inode_sync(cur_part, parent_dir->inode, io_buf);
     
-    memset(io_buf, 0, 1024);
+    memset(io_buf, 0, cur_part->sb->block_size);
     /* 将新创建的文件的i节点同步到硬盘 */
     inode_sync(cur_part, new_file_inode, io_buf);
 
@@ -203,26 +290,30 @@ rollback:
             sys_free(new_file_inode);
         case 1:
             /* 如果新文件的i节点分配失败，则之前在位图中分配的inode_no也清空 */
-            bitmap_set(&cur_part->inode_bitmap, inode_no, 0);
+            part_bitmap_set(cur_part, INODE_BITMAP, inode_no, 0);
             break;
     }
     sys_free(io_buf);
     return -1;
 }
 
-/* 打开编号为inode_no的inode对应的文件，成功返回文件描述符，否则返回-1 */
-int32_t file_open(uint32_t inode_no, uint8_t flag)
+/* 为已打开的inode分配文件结构和文件描述符，失败时关闭inode，成功返回文件描述符，否则返回-1 */
+int32_t file_open_inode(struct inode *inode, uint8_t flag)
 {
     int fd_idx = get_free_slot_in_global();
     if (fd_idx == -1) 
     {
         printk("exceed max open files\n");
+        inode_close(inode);
         return -1;
     }
 
-    file_table[fd_idx].fd_inode = inode_open(cur_part, inode_no);
+    file_table[fd_idx].fd_inode = inode;
     file_table[fd_idx].fd_pos = 0;          // 默认文件指针指向文件头
     file_table[fd_idx].fd_flag = flag;
+    file_table[fd_idx].fd_prealloc_cnt = 0;
+    file_table[fd_idx].fd_wbuf = NULL;
+    file_table[fd_idx].fd_wbuf_len = 0;
     int *write_deny = &file_table[fd_idx].fd_inode->write_deny;
 
     if (flag & O_WRONLY || flag & O_RDWR)
@@ -242,6 +333,8 @@ int32_t file_open(uint32_t inode_no, uint8_t flag)
             /* 已被别的进程占用 */
             intr_set_status(old_status);
             printk("file can't be write now, try again later\n");
+            file_table[fd_idx].fd_inode = NULL;
+            inode_close(inode);
             return -1;
         }
     }
@@ -249,38 +342,77 @@ int32_t file_open(uint32_t inode_no, uint8_t flag)
     return pcb_fd_install(fd_idx);
 }
 
+/* 打开编号为inode_no的inode对应的文件，成功返回文件描述符，否则返回-1 */
+int32_t file_open(uint32_t inode_no, uint8_t flag)
+{
+    return file_open_inode(inode_open(cur_part, inode_no), flag);
+}
+
 /* 关闭文件 */
 int32_t file_close(struct file *file)
 {
     if (file == NULL) return -1;
     
+    /* 写回延迟分配的数据 */
+    file_flush(file);
+    if (file->fd_wbuf != NULL)
+    {
+        mfree_page(PF_KERNEL, file->fd_wbuf, 1);
+        file->fd_wbuf = NULL;
+    }
+    file_prealloc_release(file);
     file->fd_inode->write_deny = 0;
     inode_close(file->fd_inode);
     file->fd_inode = NULL;          // 使文件结构可用
     return 0;
 }
 
-/* 将buf中的count个字节写入到file，成功返回字节数，失败返回-1 */
-int32_t file_write(struct file *file, const void *buf, uint32_t count)
+/* 把buf中的count个字节追加到文件末尾，立即分配块并写入硬盘，成功返回字节数，失败返回-1 */
+static int32_t file_append_blocks(struct file *file, const void *buf, uint32_t count)
 {
-    if ((file->fd_inode->i_size + count) > (BLOCK_SIZE * 140))
+    struct inode *inode = file->fd_inode;
+    /* 整块的数据会从buf直接写入硬盘 */
+    if (mmap_prefault(buf, count, 0) == -1) return -1;
+
+    /* 追加的数据落在已缓存的页中时同步更新页，保证映射看到的内容和文件一致 */
+    page_cache_update(inode, inode->i_size, buf, count);
+
+    /* 压缩的文件重新压缩最后一块，之后的数据按块压缩后追加到数据流 */
+    if (inode->i_flags & INODE_COMPRESSED)
     {
-        printk("exceed max file_size 71680 bytes, write file failed\n");
-        return -1;
-    }   
+        int32_t ret = compress_write(inode, inode->i_size, buf, count);
+        file->fd_pos = inode->i_size - 1;
+        return ret;
+    }
 
-    uint8_t *io_buf = sys_malloc(BLOCK_SIZE);
+    /* 空文件或内联的文件写入后还放得下，就把数据直接存放在inode中 */
+    if ((inode->i_flags & INODE_INLINE || inode->i_sectors[0] == 0) && inode->i_size + count <= INODE_INLINE_SIZE)
+    {
+        memcpy((uint8_t *)inode->i_sectors + inode->i_size, buf, count);
+        inode->i_flags |= INODE_INLINE;
+        inode->i_size += count;
+        file->fd_pos = inode->i_size - 1;
+        inode_mark_dirty(cur_part, inode);
+        return count;
+    }
+    /* 放不下了，内联数据先移到数据块中，再按普通文件追加 */
+    if (inode->i_flags & INODE_INLINE && inode_inline_to_block(cur_part, inode) == -1) return -1;
+
+    uint32_t block_size = cur_part->sb->block_size;
+    uint32_t block_sects = cur_part->sb->block_sects;
+    uint8_t *io_buf = sys_malloc(block_size);
     if (io_buf == NULL)
     {
         printk("file_write: sys_malloc for io_buf failed\n");
         return -1;
     }
 
-    /* 用于记录文件的块所在的LBA地址 */
-    uint32_t *all_blocks = (uint32_t *)sys_malloc(BLOCK_SIZE + 48);
+    /* 用于记录文件的块所在的LBA地址，12个直接块加上一级间接块表 */
+    uint32_t *all_blocks = (uint32_t *)sys_malloc(block_size + 48);
     if (all_blocks == NULL)
     {
         printk("file_write: sys_malloc for all_blocks failed\n");
+        sys_free(io_buf);
         return -1;
     }
     
@@ -288,211 +420,424 @@ int32_t file_write(struct file *file, const void *buf, uint32_t count)
     uint32_t bytes_written = 0;         // 用来记录写入数据的大小
     uint32_t size_left = count;         // 用于记录还没写入数据的大小
     int32_t block_lba = -1;             // 块地址
-    uint32_t block_bitmap_idx = 0;      // 用于记录blocks对应block_bitmap中的索引
-    uint32_t sec_idx;                   // 用于索引扇区
-    uint32_t sec_lba;                   // 扇区地址
-    uint32_t sec_off_bytes;             // 扇区内字节偏移
-    uint32_t sec_left_bytes;            // 扇区内剩余字节数
+    uint32_t first_bit = 0xffffffff;    // 本次分配的块在块位图中的最小下标
+    uint32_t last_bit = 0;              // 本次分配的块在块位图中的最大下标
+    uint32_t blk_lba;                   // 块的起始扇区地址
+    uint32_t blk_off_bytes;             // 块内字节偏移
+    uint32_t blk_left_bytes;            // 块内剩余字节数
     uint32_t chunk_size;                // 每次写入硬盘的数据块大小
-    int32_t indirect_block_table;       // 用于获取一级间接表地址
     uint32_t block_idx;                 // 块索引
+    uint32_t bit_idx;                   // 块在块位图中的下标
 
     /* 判断文件是否是第一次写，如果是，先为其分配一个块 */
-    if (file->fd_inode->i_sectors[0] == 0)
+    if (inode->i_sectors[0] == 0)
     {
-        block_lba = block_bitmap_alloc(cur_part);
+        block_lba = file_block_alloc(file, 0);
         if (block_lba == -1)
         {
             printk("file_write: block_bitmap_alloc failed\n");
-            return -1;
+            goto fail;
         }
-        file->fd_inode->i_sectors[0] = block_lba;
-        
-        /* 同步块位图到硬盘 */
-        block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
-        ASSERT(block_bitmap_idx != 0);
-        bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
+        inode->i_sectors[0] = block_lba;
+        first_bit = last_bit = block_bitmap_idx_of(cur_part, block_lba);
+        ASSERT(first_bit != 0);
     }
 
-    /* 写入count个字节前，该文件已经占用的块数 */
-    uint32_t file_has_used_blocks = file->fd_inode->i_size / BLOCK_SIZE + 1;
-
-    /* 以下的计算不管数据是否刚好占用整数被的扇区（如：512，1024，2048）在计算
-       的时候都会多加一个扇区，比如文件的大小是1024则i_node记录使用了3个扇区，
-       这和下面的是否要添加扇区和写入扇区要一起看 */
+    /* 写入count个字节前后该文件占用的块数，不管数据是否刚好占用整数倍的块
+       都会多算一个块，这和下面写入块的计算要一起看 */
+    uint32_t file_has_used_blocks = inode->i_size / block_size + 1;
+    uint32_t file_will_use_blocks = (inode->i_size + count) / block_size + 1;
+    ASSERT(file_will_use_blocks <= INODE_BLOCKS_MAX(cur_part->sb));
 
-    /* 存储count字节后该文件占用的块数 */
-    uint32_t file_will_use_blocks = (file->fd_inode->i_size + count) / BLOCK_SIZE + 1;
-    ASSERT(file_will_use_blocks <= 140);
-
-    /* 通过此增量判断是否需要分配新扇区，如果为0表示不需要新增扇区 */   
-    uint32_t add_blocks = file_will_use_blocks - file_has_used_blocks;
-    
-    /* 将所有文件块地址收集到all_blocks，后面统一在all_blocks中获取写入扇区地址 */
-    if (add_blocks == 0)
+    /* 将已有的块地址收集到all_blocks，后面统一在all_blocks中获取写入扇区地址 */
+    block_idx = 0;
+    while (block_idx < file_has_used_blocks && block_idx < 12)
     {
-        /* 在同一个扇区写入数据，不涉及分配新扇区 */
-        if (file_has_used_blocks <= 12)
-        {
-            /* 文件在前12个直接块内 */
-            block_idx = file_has_used_blocks - 1;
-            all_blocks[block_idx] = file->fd_inode->i_sectors[block_idx];
-        }
-        else
-        {
-            /* 已经占用了一级间接块，需要将间接块地址读进来 */
-            ASSERT(file->fd_inode->i_sectors[12] != 0);
-            indirect_block_table = file->fd_inode->i_sectors[12];
-            ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
-        }
+        all_blocks[block_idx] = inode->i_sectors[block_idx];
+        block_idx++;
     }
-    else
+    if (file_has_used_blocks > 12)
     {
-        /* 需要新增扇区，涉及分配直接块，一级间接块 */
-        if (file_will_use_blocks <= 12)
-        {
-            /* 情况1：12个直接块够用 */
-            block_idx = file_has_used_blocks - 1;
-            ASSERT(file->fd_inode->i_sectors[block_idx] != 0);
-            all_blocks[block_idx] = file->fd_inode->i_sectors[block_idx];
+        /* 已经占用了一级间接块，需要将间接块地址读进来 */
+        ASSERT(inode->i_sectors[12] != 0);
+        journal_read(cur_part->my_disk, inode->i_sectors[12], all_blocks + 12, block_sects);
+    }
 
-            /* 将未来使用到的扇区分配好写入到all_blocks */
-            block_idx = file_has_used_blocks;
-            while (block_idx < file_will_use_blocks)
-            {
-                block_lba = block_bitmap_alloc(cur_part);
-                if (block_lba == -1)
-                {
-                    printk("file_write: block_bitmap_alloc for situation 1 failed\n");
-                    return -1;
-                }
+    if (file_will_use_blocks > file_has_used_blocks)
+    {
+        int new_indirect = file_has_used_blocks <= 12 && file_will_use_blocks > 12;
+        uint32_t need_blocks = file_will_use_blocks - file_has_used_blocks + (new_indirect ? 1 : 0);
+        uint32_t prev_lba = all_blocks[file_has_used_blocks - 1];
 
-                /* 写文件时，不应该存在块未使用但已经分配扇区的情况 */
-                ASSERT(file->fd_inode->i_sectors[block_idx] == 0);
-                file->fd_inode->i_sectors[block_idx] = all_blocks[block_idx] = block_lba;
-                
-                /* 同步块位图 */
-                block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
-                bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
-                
-                block_idx++;
-            }
-        } 
-        else if (file_has_used_blocks <= 12 && file_will_use_blocks > 12)
+        /* 一次预留本次需要的全部块，使追加的数据在硬盘上连续 */
+        if (file->fd_prealloc_cnt < need_blocks)
         {
-            /* 情况2：旧数据在12个扇区之内，新数据需要创建一级间接块 */
-            block_idx = file_has_used_blocks - 1;
-            all_blocks[block_idx] = file->fd_inode->i_sectors[block_idx];
-            
-            /* 创建一级间接表 */
-            block_lba = block_bitmap_alloc(cur_part);
+            file_prealloc_release(file);
+            file_prealloc_window(file, prev_lba, need_blocks);
+        }
+
+        /* 需要新建一级间接表，放在原有数据之后 */
+        if (new_indirect)
+        {
+            ASSERT(inode->i_sectors[12] == 0);
+            block_lba = file_block_alloc(file, prev_lba);
             if (block_lba == -1)
             {
-                printk("file_write: block_bitmap_alloc for situation 2 failed\n");
-                return -1;
+                printk("file_write: block_bitmap_alloc for indirect block failed\n");
+                goto fail;
             }
-            
-            /* 分配一级间接表地址 */
-            ASSERT(file->fd_inode->i_sectors[12] == 0);
-            indirect_block_table = file->fd_inode->i_sectors[12] = block_lba;
-            
-            block_idx = file_has_used_blocks;
-            while (block_idx < file_will_use_blocks)
-            {
-                block_lba = block_bitmap_alloc(cur_part);
-                if (block_lba == -1)
-                {
-                    printk("file_write: block_bitmap_alloc for situation 2 failed\n");
-                    return -1;
-                }
-                
-                if (block_idx < 12)
-                {
-                    ASSERT(file->fd_inode->i_sectors[block_idx] == 0);
-                    file->fd_inode->i_sectors[block_idx] = all_blocks[block_idx] = block_lba;
-                }
-                else
-                {
-                    all_blocks[block_idx] = block_lba;
-                }
-
-                /* 同步块位图到磁盘 */
-                block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
-                bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
-                
-                block_idx++;
-            }
-            /* 把一级间接表内容写入磁盘 */
-            ide_write(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
+            inode->i_sectors[12] = prev_lba = block_lba;
+            bit_idx = block_bitmap_idx_of(cur_part, block_lba);
+            if (bit_idx < first_bit) first_bit = bit_idx;
+            if (bit_idx > last_bit) last_bit = bit_idx;
         }
-        else if (file_has_used_blocks > 12)
+
+        block_idx = file_has_used_blocks;
+        while (block_idx < file_will_use_blocks)
         {
-            /* 情况3：旧数据已经占用间接块了 */
-            ASSERT(file->fd_inode->i_sectors[12] != 0);
-            indirect_block_table = file->fd_inode->i_sectors[12];
-            /* 读取间接表 */
-            ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
-            
-            block_idx = file_has_used_blocks;
-            while (block_idx < file_will_use_blocks)
+            block_lba = file_block_alloc(file, prev_lba);
+            if (block_lba == -1)
             {
-                block_lba = block_bitmap_alloc(cur_part);
-                if (block_lba == -1)
-                {
-                    printk("file_write: block_bitmap_alloc for situation 3 failed\n");
-                    return -1;
-                }
+                printk("file_write: block_bitmap_alloc failed\n");
+                goto fail;
+            }
 
-                all_blocks[block_idx++] = block_lba;
-                
-                /* 同步block_bitmap */
-                block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
-                bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
+            if (block_idx < 12)
+            {
+                /* 写文件时，不应该存在块未使用但已经分配扇区的情况 */
+                ASSERT(inode->i_sectors[block_idx] == 0);
+                inode->i_sectors[block_idx] = block_lba;
             }
-            /* 回写一级间接表 */
-            ide_write(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
+            all_blocks[block_idx++] = prev_lba = block_lba;
+            bit_idx = block_bitmap_idx_of(cur_part, block_lba);
+            if (bit_idx < first_bit) first_bit = bit_idx;
+            if (bit_idx > last_bit) last_bit = bit_idx;
         }
+
+        /* 回写一级间接表 */
+        if (file_will_use_blocks > 12) journal_write(cur_part->my_disk, inode->i_sectors[12], all_blocks + 12, block_sects);
     }
 
-    int first_write_block = 1;
-    file->fd_pos = file->fd_inode->i_size - 1;
+    /* 本次分配的块所在的位图扇区统一同步一次 */
+    if (first_bit <= last_bit) bitmap_sync_range(cur_part, first_bit, last_bit, BLOCK_BITMAP);
+
+    file->fd_pos = inode->i_size - 1;
     while (bytes_written < count)
     {
-        memset(io_buf, 0, BLOCK_SIZE);
-        sec_idx = file->fd_inode->i_size / BLOCK_SIZE;
-        sec_lba = all_blocks[sec_idx];
-        sec_off_bytes = file->fd_inode->i_size % BLOCK_SIZE;
-        sec_left_bytes = BLOCK_SIZE - sec_off_bytes;
+        block_idx = inode->i_size / block_size;
+        blk_lba = all_blocks[block_idx];
+        blk_off_bytes = inode->i_size % block_size;
+        blk_left_bytes = block_size - blk_off_bytes;
         
-        /* 判断此次写入硬盘的数据大小 */       
-        chunk_size = size_left < sec_left_bytes ? size_left : sec_left_bytes;
-        if (first_write_block)
+        if (blk_off_bytes == 0 && size_left >= block_size)
         {
-            ide_read(cur_part->my_disk, sec_lba, io_buf, 1);
-            first_write_block = 0;
+            /* 整块的数据直接从src写入，LBA连续的块合并为一次传输 */
+            uint32_t blk_cnt = 1;
+            while ((blk_cnt + 1) * block_size <= size_left && blk_cnt < 256 && \
+                   all_blocks[block_idx + blk_cnt] == blk_lba + blk_cnt * block_sects) blk_cnt++;
+            chunk_size = blk_cnt * block_size;
+            ide_write(cur_part->my_disk, blk_lba, (void *)src, blk_cnt * block_sects);
+        }
+        else
+        {
+            /* 判断此次写入硬盘的数据大小，只有文件原来的最后一个块需要先读出已有数据 */
+            chunk_size = size_left < blk_left_bytes ? size_left : blk_left_bytes;
+            memset(io_buf, 0, block_size);
+            if (blk_off_bytes) ide_read(cur_part->my_disk, blk_lba, io_buf, block_sects);
+            memcpy(io_buf + blk_off_bytes, src, chunk_size);
+            ide_write(cur_part->my_disk, blk_lba, io_buf, block_sects);
         }
-
-        memcpy(io_buf + sec_off_bytes, src, chunk_size);
-        ide_write(cur_part->my_disk, sec_lba, io_buf, 1);
-        printk("file write at lba 0x%x\n", sec_lba);
         
         src += chunk_size;
-        file->fd_inode->i_size += chunk_size;
+        inode->i_size += chunk_size;
         file->fd_pos += chunk_size;
         bytes_written += chunk_size;
         size_left -= chunk_size;
     }
 
-    inode_sync(cur_part, file->fd_inode, io_buf);
+    inode_mark_dirty(cur_part, inode);
     sys_free(all_blocks);
     sys_free(io_buf);
     return bytes_written;
+
+fail:
+    if (first_bit <= last_bit) bitmap_sync_range(cur_part, first_bit, last_bit, BLOCK_BITMAP);
+    sys_free(all_blocks);
+    sys_free(io_buf);
+    return -1;
 }
 
-/* 从文件file中读取count个字节写入buf，成功返回字节数，失败返回-1 */
-int32_t file_read(struct file *file, void *buf, uint32_t count)
+/* 追加数据，分配块和更新inode作为一个操作进入元数据日志 */
+static int32_t file_write_blocks(struct file *file, const void *buf, uint32_t count)
+{
+    journal_begin();
+    int32_t ret = file_append_blocks(file, buf, count);
+    journal_end();
+    return ret;
+}
+
+/* 把file的延迟分配缓冲区中的数据写入硬盘，这时才为数据分配块，成功返回0，失败返回-1 */
+int32_t file_flush(struct file *file)
+{
+    int32_t ret = 0;
+    lock_acquire(&dalloc_lock);
+    if (file->fd_wbuf_len > 0)
+    {
+        uint32_t len = file->fd_wbuf_len;
+        file->fd_wbuf_len = 0;
+        if (file_write_blocks(file, file->fd_wbuf, len) == -1) ret = -1;
+    }
+    lock_release(&dalloc_lock);
+    return ret;
+}
+
+/* 把打开inode的所有文件中延迟写入的数据写入硬盘，读取文件或获取文件大小前调用 */
+void inode_flush_dalloc(struct inode *inode)
+{
+    uint32_t fd_idx = 3;
+    while (fd_idx < MAX_FILE_OPEN)
+    {
+        if (file_table[fd_idx].fd_inode == inode && file_table[fd_idx].fd_wbuf_len > 0)
+            file_flush(&file_table[fd_idx]);
+        fd_idx++;
+    }
+}
+
+/* 写回所有文件中延迟写入的数据，only_expired为1时只写回停留超过DALLOC_EXPIRE_TICKS的 */
+void file_flush_all(int only_expired)
 {
-    uint8_t *buf_dst = (uint8_t *)buf;
+    uint32_t fd_idx = 3;
+    while (fd_idx < MAX_FILE_OPEN)
+    {
+        struct file *file = &file_table[fd_idx];
+        if (file->fd_wbuf_len > 0 && (!only_expired || ticks - file->fd_wbuf_ticks >= DALLOC_EXPIRE_TICKS))
+            file_flush(file);
+        fd_idx++;
+    }
+}
+
+/* 定期写回停留时间过长的脏数据，先写延迟分配的数据，再写页缓存和inode表，最后提交元数据日志 */
+static void dirty_flusher(void *arg UNUSED)
+{
+    while (1)
+    {
+        mtime_sleep(1000);
+        file_flush_all(1);
+        page_cache_flush_all(1);
+        inode_table_flush(1);
+        journal_flush(1);
+    }
+}
+
+/* 初始化延迟分配，启动写回线程 */
+void file_dalloc_init(void)
+{
+    lock_init(&dalloc_lock);
+    thread_start("flusher", 10, dirty_flusher, NULL);
+}
+
+/* 将buf中的count个字节追加到file，成功返回字节数，失败返回-1，
+   小的写入先缓冲在内存中，等缓冲区满、关闭文件或超时后再一次分配连续的块写入硬盘，
+   以O_DIRECT打开的文件不缓冲，整块的数据直接从buf写入硬盘 */
+int32_t file_write(struct file *file, const void *buf, uint32_t count)
+{
+    /* tmpfs的文件直接写入内存中的页，不需要缓冲 */
+    if (file->fd_inode->i_flags & INODE_TMPFS)
+    {
+        int32_t ret = tmpfs_write(file->fd_inode, file->fd_inode->i_size, buf, count);
+        file->fd_pos = file->fd_inode->i_size - 1;
+        return ret;
+    }
+
+    uint32_t max_file_size = cur_part->sb->block_size * INODE_BLOCKS_MAX(cur_part->sb);
+    if (file->fd_inode->i_flags & INODE_COMPRESSED) max_file_size = COMPRESS_CHUNK_SIZE * COMPRESS_CHUNKS_MAX(cur_part->sb);
+    if ((file->fd_inode->i_size + file->fd_wbuf_len + count) > max_file_size)
+    {
+        printk("exceed max file_size %d bytes, write file failed\n", max_file_size);
+        return -1;
+    }   
+
+    int32_t ret = count;
+    lock_acquire(&dalloc_lock);
+    if (file->fd_flag & O_DIRECT)
+    {
+        /* 同一文件在别处缓冲的数据先写入，保证追加的顺序 */
+        inode_flush_dalloc(file->fd_inode);
+        ret = file_write_blocks(file, buf, count);
+        lock_release(&dalloc_lock);
+        return ret;
+    }
+
+    if (file->fd_wbuf == NULL && count < DALLOC_BUF_SIZE)
+    {
+        file->fd_wbuf = get_kernel_pages(1);
+        if (file->fd_wbuf == NULL)
+        {
+            /* 内存不足，把所有缓冲的数据写回，这次直接写入 */
+            file_flush_all(0);
+        }
+    }
+
+    if (file->fd_wbuf == NULL || count >= DALLOC_BUF_SIZE)
+    {
+        /* 大块写入本身就能一次分配连续的块，不需要缓冲 */
+        if (file_flush(file) == -1) ret = -1;
+        else ret = file_write_blocks(file, buf, count);
+    }
+    else
+    {
+        if (file->fd_wbuf_len + count > DALLOC_BUF_SIZE && file_flush(file) == -1) ret = -1;
+        else
+        {
+            if (file->fd_wbuf_len == 0) file->fd_wbuf_ticks = ticks;
+            memcpy(file->fd_wbuf + file->fd_wbuf_len, buf, count);
+            file->fd_wbuf_len += count;
+            file->fd_pos = file->fd_inode->i_size + file->fd_wbuf_len - 1;
+        }
+    }
+    lock_release(&dalloc_lock);
+    return ret;
+}
+
+/* 依次把iov中iovcnt个缓冲区的数据追加到file，作为一次请求处理，中间不会插入其它写入，
+   小的缓冲区在延迟分配缓冲区中合并后一起分配连续的块，成功返回字节数，失败返回-1 */
+int32_t file_writev(struct file *file, const struct iovec *iov, uint32_t iovcnt)
+{
+    int32_t ret = 0;
+    uint32_t iov_idx = 0;
+    lock_acquire(&dalloc_lock);
+    while (iov_idx < iovcnt)
+    {
+        if (iov[iov_idx].iov_len > 0 && file_write(file, iov[iov_idx].iov_base, iov[iov_idx].iov_len) == -1)
+        {
+            ret = -1;
+            break;
+        }
+        ret += iov[iov_idx].iov_len;
+        iov_idx++;
+    }
+    lock_release(&dalloc_lock);
+    return ret;
+}
+
+/* 用buf中的count个字节覆盖inode从pos开始的已有数据，[pos, pos + count)不能超出文件末尾，
+   整块覆盖时LBA连续的块直接从buf一次写入，成功返回0，失败返回-1 */
+static int32_t file_overwrite(struct inode *inode, uint32_t pos, const void *buf, uint32_t count)
+{
+    ASSERT(pos + count <= inode->i_size);
+    if (mmap_prefault(buf, count, 0) == -1) return -1;
+    page_cache_update(inode, pos, buf, count);
+
+    if (inode->i_flags & INODE_COMPRESSED) return compress_write(inode, pos, buf, count) == -1 ? -1 : 0;
+
+    if (inode->i_flags & INODE_INLINE)
+    {
+        memcpy((uint8_t *)inode->i_sectors + pos, buf, count);
+        inode_mark_dirty(cur_part, inode);
+        return 0;
+    }
+
+    uint32_t block_size = cur_part->sb->block_size;
+    uint32_t block_sects = cur_part->sb->block_sects;
+    uint8_t *io_buf = sys_malloc(block_size);
+    uint32_t *all_blocks = (uint32_t *)sys_malloc(INODE_BLOCKS_MAX(cur_part->sb) * sizeof(uint32_t));
+    if (io_buf == NULL || all_blocks == NULL)
+    {
+        printk("file_overwrite: sys_malloc failed\n");
+        if (io_buf != NULL) sys_free(io_buf);
+        if (all_blocks != NULL) sys_free(all_blocks);
+        return -1;
+    }
+    inode_collect_blocks(cur_part, inode, all_blocks);
+
+    const uint8_t *src = buf;
+    while (count > 0)
+    {
+        uint32_t blk_idx = pos / block_size;
+        uint32_t blk_lba = all_blocks[blk_idx];
+        uint32_t blk_off_bytes = pos % block_size;
+        uint32_t chunk_size = block_size - blk_off_bytes < count ? block_size - blk_off_bytes : count;
+
+        if (blk_off_bytes == 0 && count >= block_size)
+        {
+            uint32_t blk_cnt = 1;
+            while ((blk_cnt + 1) * block_size <= count && blk_cnt < 256 && \
+                   all_blocks[blk_idx + blk_cnt] == blk_lba + blk_cnt * block_sects) blk_cnt++;
+            chunk_size = blk_cnt * block_size;
+            ide_write(cur_part->my_disk, blk_lba, (void *)src, blk_cnt * block_sects);
+        }
+        else
+        {
+            /* 不完整的块先读出再修改 */
+            ide_read(cur_part->my_disk, blk_lba, io_buf, block_sects);
+            memcpy(io_buf + blk_off_bytes, src, chunk_size);
+            ide_write(cur_part->my_disk, blk_lba, io_buf, block_sects);
+        }
+        src += chunk_size;
+        pos += chunk_size;
+        count -= chunk_size;
+    }
+
+    sys_free(all_blocks);
+    sys_free(io_buf);
+    return 0;
+}
+
+/* 从文件位置pos开始写入buf中的count个字节，覆盖已有的数据，超出文件末尾的部分追加，
+   pos不能超过文件大小，不改变fd_pos，成功返回字节数，失败返回-1 */
+int32_t file_pwrite(struct file *file, uint32_t pos, const void *buf, uint32_t count)
+{
+    struct inode *inode = file->fd_inode;
+    int32_t ret = count;
+    lock_acquire(&dalloc_lock);
+    inode_flush_dalloc(inode);
+    if (pos > inode->i_size)
+    {
+        printk("file_pwrite: pos %d is beyond the end of file\n", pos);
+        lock_release(&dalloc_lock);
+        return -1;
+    }
+
+    if (inode->i_flags & INODE_TMPFS)
+    {
+        ret = tmpfs_write(inode, pos, buf, count);
+        lock_release(&dalloc_lock);
+        return ret;
+    }
+
+    uint32_t over_size = inode->i_size - pos < count ? inode->i_size - pos : count;
+    journal_begin();
+    if (over_size > 0 && file_overwrite(inode, pos, buf, over_size) == -1) ret = -1;
+    else if (count > over_size)
+    {
+        uint32_t fd_pos_bak = file->fd_pos;
+        if (file_write(file, (const uint8_t *)buf + over_size, count - over_size) == -1) ret = -1;
+        file->fd_pos = fd_pos_bak;
+    }
+    journal_end();
+    lock_release(&dalloc_lock);
+    return ret;
+}
+
+/* 从文件file中读取数据依次填满iov中的iovcnt个缓冲区，作为一次请求处理，
+   相邻缓冲区落在同一块中时只读一次硬盘，成功返回字节数，失败返回-1 */
+int32_t file_readv(struct file *file, const struct iovec *iov, uint32_t iovcnt)
+{
+    /* 还在延迟分配缓冲区中的数据先写入硬盘 */
+    inode_flush_dalloc(file->fd_inode);
+    /* 直接I/O绕过页缓存，先把映射中修改过的页写回 */
+    if (file->fd_flag & O_DIRECT) page_cache_writeback(file->fd_inode, 0);
+
+    uint32_t count = 0, iov_idx = 0, iov_off = 0;
+    while (iov_idx < iovcnt)
+    {
+        /* 直接I/O会把数据从硬盘直接读入缓冲区 */
+        if (mmap_prefault(iov[iov_idx].iov_base, iov[iov_idx].iov_len, 1) == -1) return -1;
+        count += iov[iov_idx++].iov_len;
+    }
+    iov_idx = 0;
+
+    uint8_t *buf_dst;
     uint32_t size = count, size_left = size;
 
     /* 如果要读取的字节数超过文件的剩余量，就用剩余量作为读取的字节 */
@@ -503,23 +848,96 @@ int32_t file_read(struct file *file, void *buf, uint32_t count)
         if (size == 0) return -1;           // 文件到达结尾
     }
 
-    uint8_t *io_buf = sys_malloc(BLOCK_SIZE);
+    /* tmpfs的文件数据全部在页缓存中 */
+    if (file->fd_inode->i_flags & INODE_TMPFS)
+    {
+        while (size_left > 0)
+        {
+            uint32_t chunk_size = iov[iov_idx].iov_len < size_left ? iov[iov_idx].iov_len : size_left;
+            tmpfs_read(file->fd_inode, file->fd_pos, iov[iov_idx++].iov_base, chunk_size);
+            file->fd_pos += chunk_size;
+            size_left -= chunk_size;
+        }
+        return size;
+    }
+
+    /* 内联的文件不用读硬盘，被映射时最新的数据在页缓存中 */
+    if (file->fd_inode->i_flags & INODE_INLINE)
+    {
+        while (size_left > 0)
+        {
+            uint32_t chunk_size = iov[iov_idx].iov_len < size_left ? iov[iov_idx].iov_len : size_left;
+            buf_dst = iov[iov_idx++].iov_base;
+            if (page_cache_read(file->fd_inode, file->fd_pos, buf_dst, chunk_size) == -1)
+                memcpy(buf_dst, (uint8_t *)file->fd_inode->i_sectors + file->fd_pos, chunk_size);
+            file->fd_pos += chunk_size;
+            size_left -= chunk_size;
+        }
+        return size;
+    }
+
+    /* 压缩的文件一次解压一块，块在页缓存中时直接复制，一块被分到相邻的缓冲区时只解压一次 */
+    if (file->fd_inode->i_flags & INODE_COMPRESSED)
+    {
+        uint8_t *chunk_buf = get_kernel_pages(1);
+        if (chunk_buf == NULL)
+        {
+            printk("file_read: get_kernel_pages for chunk_buf failed\n");
+            return -1;
+        }
+        uint32_t chunk_idx = 0xffffffff;        // chunk_buf中现有数据是第几块
+        while (size_left > 0)
+        {
+            while (iov[iov_idx].iov_len == iov_off)
+            {
+                iov_idx++;
+                iov_off = 0;
+            }
+            buf_dst = (uint8_t *)iov[iov_idx].iov_base + iov_off;
+            uint32_t chunk_off = file->fd_pos % COMPRESS_CHUNK_SIZE;
+            uint32_t chunk_size = COMPRESS_CHUNK_SIZE - chunk_off < size_left ? COMPRESS_CHUNK_SIZE - chunk_off : size_left;
+            if (chunk_size > iov[iov_idx].iov_len - iov_off) chunk_size = iov[iov_idx].iov_len - iov_off;
+
+            if (page_cache_read(file->fd_inode, file->fd_pos, buf_dst, chunk_size) == -1)
+            {
+                if (chunk_idx != file->fd_pos / COMPRESS_CHUNK_SIZE)
+                {
+                    chunk_idx = file->fd_pos / COMPRESS_CHUNK_SIZE;
+                    if (compress_read_chunk(file->fd_inode, chunk_idx, chunk_buf) == -1)
+                    {
+                        mfree_page(PF_KERNEL, chunk_buf, 1);
+                        return -1;
+                    }
+                }
+                memcpy(buf_dst, chunk_buf + chunk_off, chunk_size);
+            }
+            iov_off += chunk_size;
+            file->fd_pos += chunk_size;
+            size_left -= chunk_size;
+        }
+        mfree_page(PF_KERNEL, chunk_buf, 1);
+        return size;
+    }
+
+    uint32_t block_size = cur_part->sb->block_size;
+    uint32_t block_sects = cur_part->sb->block_sects;
+    uint8_t *io_buf = sys_malloc(block_size);
     if (io_buf == NULL)
     {
         printk("file_read: sys_malloc for io_buf failed\n");
         return -1;
     }
-    uint32_t *all_blocks = (uint32_t *)sys_malloc(BLOCK_SIZE + 48);
+    uint32_t *all_blocks = (uint32_t *)sys_malloc(block_size + 48);
     if (all_blocks == NULL)
     {
         printk("file_read: sys_malloc for all_blocks failed\n");
         return -1;
     }
 
-    uint32_t block_read_start_idx = file->fd_pos / BLOCK_SIZE;          // 要读取的数据所在块的起始扇区
-    uint32_t block_read_end_idx = (file->fd_pos + size) / BLOCK_SIZE;   // 要读取数据的结束扇区
+    uint32_t block_read_start_idx = file->fd_pos / block_size;          // 要读取的数据所在的起始块
+    uint32_t block_read_end_idx = (file->fd_pos + size) / block_size;   // 要读取数据的结束块
     uint32_t read_blocks = block_read_end_idx - block_read_start_idx;
-    ASSERT(block_read_start_idx < 139 && block_read_end_idx < 139);
+    ASSERT(block_read_start_idx < INODE_BLOCKS_MAX(cur_part->sb) - 1 && block_read_end_idx < INODE_BLOCKS_MAX(cur_part->sb) - 1);
     
     int32_t indirect_block_table;       // 用于获取一级间接表的地址
     uint32_t block_idx;                 // 获取待读取的地址
@@ -527,7 +945,7 @@ int32_t file_read(struct file *file, void *buf, uint32_t count)
     /* 构建all_blocks，只读区要用到的地址 */
     if (read_blocks == 0)
     {
-        /* 读取的数据在同一个扇区 */   
+        /* 读取的数据在同一个块 */   
         ASSERT(block_read_end_idx == block_read_start_idx);
         if (block_read_end_idx < 12)
         {
@@ -539,12 +957,12 @@ int32_t file_read(struct file *file, void *buf, uint32_t count)
         {
             /* 读取的数据在一级间接表内 */
             indirect_block_table = file->fd_inode->i_sectors[12];
-            ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);   
+            journal_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, block_sects);   
         }
     }
     else
     {
-        /* 读取的数据跨越多个扇区 */
+        /* 读取的数据跨越多个块 */
 
         if (block_read_end_idx < 12)
         {
@@ -570,32 +988,59 @@ int32_t file_read(struct file *file, void *buf, uint32_t count)
             
             /* 从磁盘中读取一级间接表 */
             indirect_block_table = file->fd_inode->i_sectors[12];
-            ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
+            journal_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, block_sects);
         }
         else
         {
             /* 情况3：起始块和结束块都在一级间接块中 */
             ASSERT(file->fd_inode->i_sectors[12] != 0);
             indirect_block_table = file->fd_inode->i_sectors[12];
-            ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
+            journal_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, block_sects);
         }
     }
 
-    uint32_t sec_idx, sec_lba, sec_off_bytes, sec_left_bytes, chunk_size;
+    uint32_t blk_idx, blk_lba, blk_off_bytes, blk_left_bytes, chunk_size, iov_left;
     uint32_t bytes_read = 0;
+    uint32_t io_buf_lba = 0;            // io_buf中现有数据所在块的LBA，0表示无效
     while (bytes_read < size)
     {
-        sec_idx = file->fd_pos / BLOCK_SIZE;
-        sec_lba = all_blocks[sec_idx];
-        sec_off_bytes = file->fd_pos % BLOCK_SIZE;
-        sec_left_bytes = BLOCK_SIZE - sec_off_bytes;
-        chunk_size = size_left < sec_left_bytes ? size_left : sec_left_bytes;
+        /* 跳过长度为0的缓冲区 */
+        while (iov[iov_idx].iov_len == iov_off)
+        {
+            iov_idx++;
+            iov_off = 0;
+        }
+        buf_dst = (uint8_t *)iov[iov_idx].iov_base + iov_off;
+        iov_left = iov[iov_idx].iov_len - iov_off;
 
-        memset(io_buf, 0, BLOCK_SIZE);
-        ide_read(cur_part->my_disk, sec_lba, io_buf, 1);
-        memcpy(buf_dst, io_buf + sec_off_bytes, chunk_size);
+        blk_idx = file->fd_pos / block_size;
+        blk_lba = all_blocks[blk_idx];
+        blk_off_bytes = file->fd_pos % block_size;
+        blk_left_bytes = block_size - blk_off_bytes;
+        chunk_size = size_left < blk_left_bytes ? size_left : blk_left_bytes;
+        if (chunk_size > iov_left) chunk_size = iov_left;
+
+        if (file->fd_flag & O_DIRECT && blk_off_bytes == 0 && size_left >= block_size && iov_left >= block_size)
+        {
+            /* 直接I/O：整块的数据从硬盘直接读入buf，LBA连续的块合并为一次传输 */
+            uint32_t blk_cnt = 1;
+            while ((blk_cnt + 1) * block_size <= size_left && (blk_cnt + 1) * block_size <= iov_left && \
+                   blk_cnt < 256 && all_blocks[blk_idx + blk_cnt] == blk_lba + blk_cnt * block_sects) blk_cnt++;
+            chunk_size = blk_cnt * block_size;
+            ide_read(cur_part->my_disk, blk_lba, buf_dst, blk_cnt * block_sects);
+        }
+        else if (page_cache_read(file->fd_inode, file->fd_pos, buf_dst, chunk_size) == -1)
+        {
+            /* 块不在页缓存中，经过io_buf中转，一块被分到相邻的缓冲区时只读一次 */
+            if (io_buf_lba != blk_lba)
+            {
+                ide_read(cur_part->my_disk, blk_lba, io_buf, block_sects);
+                io_buf_lba = blk_lba;
+            }
+            memcpy(buf_dst, io_buf + blk_off_bytes, chunk_size);
+        }
         
-        buf_dst += chunk_size;
+        iov_off += chunk_size;
         file->fd_pos += chunk_size;
         bytes_read += chunk_size;
         size_left -= chunk_size;
@@ -606,3 +1051,12 @@ int32_t file_read(struct file *file, void *buf, uint32_t count)
     return bytes_read;
 }
 
+/* 从文件file中读取count个字节写入buf，成功返回字节数，失败返回-1 */
+int32_t file_read(struct file *file, void *buf, uint32_t count)
+{
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = count;
+    return file_readv(file, &iov, 1);
+}
+
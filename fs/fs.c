@@ -16,6 +16,11 @@
 #include "keyboard.h"
 #include "ioqueue.h"
 #include "pipe.h"
+#include "page_cache.h"
+#include "journal.h"
+#include "compress.h"
+#include "tmpfs.h"
+#include "mount.h"
 
 struct partition *cur_part;     // 默认情况下操作系统使用的分区
 
@@ -41,19 +46,28 @@ static int mount_partition(struct list_elem *pelem, int arg)
         ide_read(hd, cur_part->start_lba + 1, sb_buf, 1); 
         memcpy(cur_part->sb, sb_buf, sizeof(struct super_block));
 
-        /* 将硬盘上的块位图读入内存 */
-        cur_part->block_bitmap.bits = (uint8_t *)sys_malloc(sb_buf->block_bitmap_sects * SECTOR_SIZE);
-        if (cur_part->block_bitmap.bits == NULL) PANIC("alloc memory failed!");
-        cur_part->block_bitmap.btmp_bytes_len = sb_buf->block_bitmap_sects * SECTOR_SIZE;
-        ide_read(hd, sb_buf->block_bitmap_lba, cur_part->block_bitmap.bits, sb_buf->block_bitmap_sects);
-        
-        /* 将硬盘上的inode位图读入内存 */
-        cur_part->inode_bitmap.bits = (uint8_t *)sys_malloc(sb_buf->inode_bitmap_sects * SECTOR_SIZE);
-        if (cur_part->inode_bitmap.bits == NULL) PANIC("alloc memory failed!");
-        cur_part->inode_bitmap.btmp_bytes_len = sb_buf->inode_bitmap_sects * SECTOR_SIZE;
-        ide_read(hd, sb_buf->inode_bitmap_lba, cur_part->inode_bitmap.bits, sb_buf->inode_bitmap_sects);
+        /* 先重放日志，事务中可能有超级块，重放后重新读入 */
+        if (journal_replay(cur_part))
+        {
+            ide_read(hd, cur_part->start_lba + 1, sb_buf, 1);
+            memcpy(cur_part->sb, sb_buf, sizeof(struct super_block));
+        }
+
+        /* 没有记录块大小的分区是一块一个扇区 */
+        if (cur_part->sb->block_size == 0)
+        {
+            cur_part->sb->block_size = SECTOR_SIZE;
+            cur_part->sb->block_sects = 1;
+        }
+
+        /* 块位图和inode位图在用到时才按扇区读入 */
+        part_bitmap_mount(cur_part);
+        sys_free(sb_buf);
 
         list_init(&cur_part->open_inodes);
+
+        /* 之后的元数据修改都经过日志 */
+        journal_mount(cur_part);
         printk("mount %s done!\n", part->name);
         
         /* 已经挂在完毕后返回1让list_traversal停止遍历 */
@@ -64,27 +78,36 @@ static int mount_partition(struct list_elem *pelem, int arg)
     return 0;       
 }
 
+/* 将内存中part的超级块写回硬盘 */
+void super_block_sync(struct partition *part)
+{
+    journal_write(part->my_disk, part->start_lba + 1, part->sb, 1);
+}
+
 /* 格式化分区，即初始化分区的元信息，创建文件系统 */
-static void partition_format(struct partition *part)
+static void partition_format(struct partition *part, uint32_t block_size)
 {
-    /* 一个块一个扇区 */
+    /* 一个块由block_sects个扇区组成，块位图中的每一位对应一个块 */
+    ASSERT(block_size % SECTOR_SIZE == 0 && block_size <= BLOCK_SIZE_MAX);
+    uint32_t block_sects = block_size / SECTOR_SIZE;
     uint32_t boot_sector_sects = 1;
     uint32_t super_block_sects = 1;
     uint32_t inode_bitmap_sects = DIV_ROUND_UP(MAX_FILES_PER_PART, BITS_PER_SECTOR);
-    uint32_t inode_table_sects = DIV_ROUND_UP(((sizeof(struct inode) * MAX_FILES_PER_PART)), SECTOR_SIZE);
+    uint32_t inode_table_sects = DIV_ROUND_UP(((sizeof(struct d_inode) * MAX_FILES_PER_PART)), SECTOR_SIZE);
     uint32_t used_sects = boot_sector_sects + super_block_sects + inode_bitmap_sects + inode_table_sects;
     uint32_t free_sects = part->sec_cnt - used_sects;
 
     /* 简单处理块位图占用的扇区数 */
     uint32_t block_bitmap_sects;
-    block_bitmap_sects = DIV_ROUND_UP(free_sects, BITS_PER_SECTOR);
+    block_bitmap_sects = DIV_ROUND_UP(free_sects / block_sects, BITS_PER_SECTOR);
     /* 位图中位的长度，也是可用块的数量 */
-    uint32_t block_bitmap_bit_len = free_sects - block_bitmap_sects;
+    uint32_t block_bitmap_bit_len = (free_sects - block_bitmap_sects) / block_sects;
     block_bitmap_sects = DIV_ROUND_UP(block_bitmap_bit_len, BITS_PER_SECTOR);
 
     /* 超级块初始化 */   
     struct super_block sb;
-    sb.magic = 0x19590318;
+    memset(&sb, 0, sizeof(struct super_block));
+    sb.magic = SUPER_BLOCK_MAGIC;
     sb.sec_cnt = part->sec_cnt;
     sb.inode_cnt = MAX_FILES_PER_PART;
     sb.part_lba_base = part->start_lba;
@@ -102,9 +125,33 @@ static void partition_format(struct partition *part)
     sb.data_start_lba = sb.inode_table_lba + sb.inode_table_sects;
     sb.root_inode_no = 0;
     sb.dir_entry_size = sizeof(struct dir_entry);   
+    sb.inode_size = sizeof(struct d_inode);
+    sb.block_size = block_size;
+    sb.block_sects = block_sects;
+
+    /* 快速格式化：只有第0组inode表在格式化时清零，其余组标记为未初始化 */
+    sb.itable_group_sects = ITABLE_GROUP_SECTS;
+    uint32_t itable_group_cnt = DIV_ROUND_UP(sb.inode_table_sects, ITABLE_GROUP_SECTS);
+    ASSERT(itable_group_cnt <= 32);
+    sb.itable_uninit = (itable_group_cnt == 32 ? 0xffffffff : ((1 << itable_group_cnt) - 1)) & ~1;
+
+    /* 块位图分成不超过BLOCK_GROUPS_MAX个块组，记录每组的空闲块数 */
+    sb.block_group_sects = DIV_ROUND_UP(sb.block_bitmap_sects, BLOCK_GROUPS_MAX);
+    uint32_t group_bits = sb.block_group_sects * BITS_PER_SECTOR;
+    uint32_t group_idx = 0;
+    while (group_idx * group_bits < block_bitmap_bit_len)
+    {
+        uint32_t group_end = (group_idx + 1) * group_bits;
+        if (group_end > block_bitmap_bit_len) group_end = block_bitmap_bit_len;
+        sb.block_group_free[group_idx] = group_end - group_idx * group_bits;
+        group_idx++;
+    }
+    sb.block_group_free[0]--;       // 第0个块留作根目录
+    sb.free_blocks = block_bitmap_bit_len - 1;
+    sb.free_inodes = sb.inode_cnt - 1;      // 第0个inode分配给根目录
     
     printk("%s info:\n", part->name);
-    printk("    magic: 0x%x\n    part_lba_base: 0x%x\n    all_sectors: 0x%x\n    inode_cnt: 0x%x\n    block_bitmap_lba: 0x%x\n    block_bitmap_sectors: 0x%x\n    inode_bitmap_lba: 0x%x\n    inode_bitmap_sectors: 0x%x\n    inode_table_lba: 0x%x\n    inode_table_sectors: 0x%x\n    data_start_lba: 0x%x\n", sb.magic, sb.part_lba_base, sb.sec_cnt, sb.inode_cnt, sb.block_bitmap_lba, sb.block_bitmap_sects, sb.inode_bitmap_lba, sb.inode_bitmap_sects, sb.inode_table_lba, sb.inode_table_sects, sb.data_start_lba);
+    printk("    magic: 0x%x\n    part_lba_base: 0x%x\n    all_sectors: 0x%x\n    inode_cnt: 0x%x\n    block_bitmap_lba: 0x%x\n    block_bitmap_sectors: 0x%x\n    inode_bitmap_lba: 0x%x\n    inode_bitmap_sectors: 0x%x\n    inode_table_lba: 0x%x\n    inode_table_sectors: 0x%x\n    data_start_lba: 0x%x\n    block_size: %d\n", sb.magic, sb.part_lba_base, sb.sec_cnt, sb.inode_cnt, sb.block_bitmap_lba, sb.block_bitmap_sects, sb.inode_bitmap_lba, sb.inode_bitmap_sects, sb.inode_table_lba, sb.inode_table_sects, sb.data_start_lba, sb.block_size);
     
     struct disk *hd = part->my_disk;
 
@@ -112,9 +159,11 @@ static void partition_format(struct partition *part)
     ide_write(hd, part->start_lba + 1, &sb, 1);
     printk("    super_block_lba: 0x%x\n", part->start_lba + 1);
     
-    /* 找出块位图、inode节点位图、inode节点数组最大的做缓存 */
+    /* 找出块位图、inode节点位图、第0组inode表最大的做缓存 */
+    uint32_t itable_init_sects = (sb.inode_table_sects < ITABLE_GROUP_SECTS ? sb.inode_table_sects : ITABLE_GROUP_SECTS);
     uint32_t buf_size = (sb.block_bitmap_sects >= sb.inode_bitmap_sects ? sb.block_bitmap_sects : sb.inode_bitmap_sects);
-    buf_size = (buf_size >= sb.inode_table_sects ? buf_size : sb.inode_table_sects) * SECTOR_SIZE;
+    buf_size = (buf_size >= itable_init_sects ? buf_size : itable_init_sects) * SECTOR_SIZE;
+    if (buf_size < block_size) buf_size = block_size;
     uint8_t *buf = (uint8_t *)sys_malloc(buf_size);
 
     /* Step 2: 将块位图初始化并写入sb.block_bitmap_lba */   
@@ -129,7 +178,7 @@ static void partition_format(struct partition *part)
     
     /* 将上一步最后覆盖的最后一字节的有效位重置0 */
     uint8_t bit_idx = 0;
-    while (bit_idx <= block_bitmap_last_bit) buf[block_bitmap_last_byte] &= ~(1 << bit_idx++);
+    while (bit_idx < block_bitmap_last_bit) buf[block_bitmap_last_byte] &= ~(1 << bit_idx++);
     
     ide_write(hd, sb.block_bitmap_lba, buf, sb.block_bitmap_sects);
 
@@ -140,13 +189,12 @@ static void partition_format(struct partition *part)
        正好一个扇区，不存在没有使用的位 */
     ide_write(hd, sb.inode_bitmap_lba, buf, sb.inode_bitmap_sects);
 
-    /* Step 4: 将inode数组初始化并写入sb.inode_table_lba */
+    /* Step 4: 将第0组inode数组初始化并写入sb.inode_table_lba，其余组延迟清零 */
     memset(buf, 0, buf_size);
-    struct inode *i = (struct inode *)buf;
+    struct d_inode *i = (struct d_inode *)buf;     // 根目录占用数组中0
     i->i_size = sb.dir_entry_size * 2;      // .和..
-    i->i_no = 0;                            // 根目录占用数组中0
     i->i_sectors[0] = sb.data_start_lba; 
-    ide_write(hd, sb.inode_table_lba, buf, sb.inode_table_sects);
+    ide_write(hd, sb.inode_table_lba, buf, itable_init_sects);
 
     /* Step 5: 根目录初始化并写入sb.data_start_lba */
     memset(buf, 0, buf_size);
@@ -162,7 +210,7 @@ static void partition_format(struct partition *part)
     p_de->i_no = 0;             // 根目录的父目录还是自己
     p_de->f_type = FT_DIRECTORY;
 
-    ide_write(hd, sb.data_start_lba, buf, 1);
+    ide_write(hd, sb.data_start_lba, buf, block_sects);
     
     printk("    root_dir_lba: 0x%x\n", sb.data_start_lba);
     printk("%s format done\n", part->name);
@@ -205,9 +253,45 @@ int32_t path_depth_cnt(char *pathname)
     return depth;
 }
 
-/* 搜索文件pathname，找到返回inode号，否则返回-1 */
-static int search_file(const char *pathname, struct path_search_record *searched_record)
+/* 路径从挂载的文件系统中的目录base继续，rest为剩下的路径，可以为NULL。路径留在该文件系统中时，
+   关闭已打开的父目录，把base和rest记录在searched_record中并返回1。经过其根目录的..离开时返回0，
+   searched_record->parent_dir换成挂载点目录，name为这个..，*sub_path为之后的路径，
+   由调用者在挂载点目录中继续查找 */
+static int mount_cross(struct inode *base, char *rest, char **sub_path, char *name, struct path_search_record *searched_record)
 {
+    if (rest == NULL) rest = "";
+    const char *up;
+    struct inode *mnt_root = tmpfs_escape(base, rest, &up);
+    if (mnt_root == NULL)
+    {
+        dir_close(searched_record->parent_dir);
+        searched_record->parent_dir = &root_dir;
+        searched_record->mnt_dir = base;
+        searched_record->mnt_path = rest;
+        return 1;
+    }
+
+    /* 在挂载的文件系统中经过的各级也计入已查找的路径，调用者据此比较路径深度 */
+    uint32_t len = strlen(searched_record->searched_path);
+    if (rest[0] != '/') searched_record->searched_path[len++] = '/';
+    memcpy(searched_record->searched_path + len, rest, up - rest);
+    searched_record->searched_path[len + (up - rest)] = 0;
+
+    dir_close(searched_record->parent_dir);
+    searched_record->parent_dir = dir_open(cur_part, mount_point(mnt_root));
+    memset(name, 0, MAX_FILE_NAME_LEN);
+    *sub_path = path_parse((char *)up, name);
+    return 0;
+}
+
+/* 从目录start_dir开始搜索文件pathname，找到返回inode号，否则返回-1。
+   pathname以'/'开头时从根目录开始，start_dir为NULL时相对路径从当前工作目录开始，
+   start_dir本身不会被关闭。路径进入挂载的文件系统时返回-1，
+   searched_record->mnt_dir不为NULL，由调用者交给该文件系统处理 */
+static int search_file_at(struct dir *start_dir, const char *pathname, struct path_search_record *searched_record)
+{
+    searched_record->mnt_dir = NULL;
+
     /* 如果查找是如下几个目录直接返回 */
     if (!strcmp(pathname, "/") || !strcmp(pathname, "/.") || !strcmp(pathname, "/.."))
     {
@@ -218,18 +302,34 @@ static int search_file(const char *pathname, struct path_search_record *searched
     }
 
     uint32_t path_len = strlen(pathname);
-    ASSERT(pathname[0] == '/' && path_len > 1 && path_len < MAX_PATH_LEN);
+    ASSERT(path_len > 0 && path_len < MAX_PATH_LEN);
     char *sub_path = (char *)pathname;
     struct dir *parent_dir = &root_dir;
     struct dir_entry dir_e;
     /* 记录解析的名称 */
     char name[MAX_FILE_NAME_LEN] = {0, };
-    
     searched_record->parent_dir = parent_dir;
     searched_record->file_type = FT_UNKNOWN;
-    uint32_t parent_inode_no = 0;
 
-    sub_path = path_parse(sub_path, name);
+    if (pathname[0] != '/' && start_dir != NULL && start_dir->inode->i_flags & INODE_TMPFS)
+    {
+        /* 从挂载的文件系统中的目录出发，离开时从挂载点目录的..继续 */
+        if (mount_cross(start_dir->inode, sub_path, &sub_path, name, searched_record)) return -1;
+        parent_dir = searched_record->parent_dir;
+    }
+    else
+    {
+        if (pathname[0] != '/')
+        {
+            /* 相对路径另外打开起始目录，查找过程中关闭的是这份副本 */
+            uint32_t start_inode_no = start_dir != NULL ? start_dir->inode->i_no : running_thread()->cwd_inode_nr;
+            if (start_inode_no != root_dir.inode->i_no) parent_dir = dir_open(cur_part, start_inode_no);
+        }
+        searched_record->parent_dir = parent_dir;
+        sub_path = path_parse(sub_path, name);
+    }
+    uint32_t parent_inode_no = parent_dir->inode->i_no;
+
     while (name[0])
     {
         ASSERT(strlen(searched_record->searched_path) < 512);
@@ -245,6 +345,7 @@ static int search_file(const char *pathname, struct path_search_record *searched
             memset(name, 0, MAX_FILE_NAME_LEN);
             
             /* sub_path不为NULL说明还没找到底，继续寻找 */
+            char *rest_path = sub_path;
             if (sub_path) sub_path = path_parse(sub_path, name);
 
             if (FT_DIRECTORY == dir_e.f_type)
@@ -254,6 +355,14 @@ static int search_file(const char *pathname, struct path_search_record *searched
                 dir_close(parent_dir);   
                 parent_dir = dir_open(cur_part, dir_e.i_no);    // 更新父目录为本目录
                 searched_record->parent_dir = parent_dir;
+
+                /* 走进了挂载点，剩下的路径交给挂载的文件系统，从其根目录的..离开时回到这里 */
+                struct inode *mnt_root = mount_find(dir_e.i_no);
+                if (mnt_root != NULL)
+                {
+                    if (mount_cross(mnt_root, rest_path, &sub_path, name, searched_record)) return -1;
+                    parent_dir = searched_record->parent_dir;
+                }
                 continue;
             }
             else if (FT_REGULAR == dir_e.f_type)
@@ -278,15 +387,22 @@ static int search_file(const char *pathname, struct path_search_record *searched
     return dir_e.i_no;
 }
 
-/* 打开或创建文件，成功返回文件描述符，失败返回-1 */
-int32_t sys_open(const char *pathname, uint8_t flags)
+/* 从根目录或当前工作目录搜索文件pathname，找到返回inode号，否则返回-1 */
+static int search_file(const char *pathname, struct path_search_record *searched_record)
+{
+    return search_file_at(NULL, pathname, searched_record);
+}
+
+/* 在目录dir下打开或创建文件，pathname为相对路径时从dir开始查找，
+   dir为NULL时与sys_open相同，成功返回文件描述符，失败返回-1 */
+int32_t sys_openat(struct dir *dir, const char *pathname, uint8_t flags)
 {
     if (pathname[strlen(pathname) - 1] == '/')
     {
         printk("can't open a directory %s\n", pathname);
         return 0;
     }
-    ASSERT(flags <= 7);
+    ASSERT(flags <= (O_RDWR | O_CREAT | O_DIRECT | O_COMPRESS));
     int32_t fd = -1;
 
     struct path_search_record searched_record;
@@ -296,7 +412,9 @@ int32_t sys_open(const char *pathname, uint8_t flags)
     uint32_t pathname_depth = path_depth_cnt((char *)pathname);
     
     /* 先检查文件是否存在 */
-    int inode_no = search_file(pathname, &searched_record);
+    int inode_no = search_file_at(dir, pathname, &searched_record);
+    /* 经过挂载点的路径交给挂载的文件系统 */
+    if (searched_record.mnt_dir != NULL) return tmpfs_open(searched_record.mnt_dir, searched_record.mnt_path, flags);
     int found = inode_no != -1 ? 1 : 0;
     
     if (searched_record.file_type == FT_DIRECTORY)
@@ -338,7 +456,9 @@ int32_t sys_open(const char *pathname, uint8_t flags)
     {
         case O_CREAT:
             printk("creating file\n");
-            fd = file_create(searched_record.parent_dir, (strrchr(pathname, '/') + 1), flags);
+            journal_begin();
+            fd = file_create(searched_record.parent_dir, (strrchr(searched_record.searched_path, '/') + 1), flags);
+            journal_end();
             dir_close(searched_record.parent_dir);
             break;
         
@@ -351,6 +471,12 @@ int32_t sys_open(const char *pathname, uint8_t flags)
     return fd;
 }
 
+/* 打开或创建文件，成功返回文件描述符，失败返回-1 */
+int32_t sys_open(const char *pathname, uint8_t flags)
+{
+    return sys_openat(NULL, pathname, flags);
+}
+
 /* 将文件描述符转化为文件表下标 */
 uint32_t fd_local2global(uint32_t local_fd)
 {
@@ -402,9 +528,7 @@ int32_t sys_write(int32_t fd, const void *buf, uint32_t count)
         if (is_pipe(fd)) return pipe_write(fd, buf, count);
         else
         {
-            char tmp_buf[1024] = {0, };
-            memcpy(tmp_buf, buf, count);
-            console_put_str(tmp_buf);
+            console_write(buf, count);
             return count;
         }
     }
@@ -474,6 +598,199 @@ int32_t sys_read(int32_t fd, void *buf, uint32_t count)
     return ret;
 }
 
+/* 在内核中把最多count个字节从in_fd的当前位置传给out_fd，out_fd可以是控制台、管道或文件，
+   文件中已在页缓存的数据直接从缓存页写出，否则读入一页大小的内核缓冲区中转，
+   返回传输的字节数，一个字节都没传输就出错时返回-1 */
+static int32_t fd_transfer(int32_t out_fd, int32_t in_fd, uint32_t count)
+{
+    struct file *in_file = NULL;
+    if (in_fd > stderr_no && !is_pipe(in_fd)) in_file = &file_table[fd_local2global(in_fd)];
+
+    uint8_t *io_buf = get_kernel_pages(1);
+    if (io_buf == NULL)
+    {
+        printk("fd_transfer: get_kernel_pages for io_buf failed\n");
+        return -1;
+    }
+
+    int32_t transferred = 0;
+    while ((uint32_t)transferred < count)
+    {
+        uint32_t chunk = count - transferred < PG_SIZE ? count - transferred : PG_SIZE;
+        const void *src = io_buf;
+        int32_t bytes_in;
+        if (in_file != NULL)
+        {
+            struct inode *inode = in_file->fd_inode;
+            inode_flush_dalloc(inode);
+            if (in_file->fd_pos >= inode->i_size) break;
+
+            uint32_t pg_off = in_file->fd_pos % PG_SIZE;
+            struct cache_page *pg = page_cache_lookup(inode, in_file->fd_pos / PG_SIZE);
+            if (pg != NULL)
+            {
+                /* 数据已在页缓存中，不再复制到中转缓冲区 */
+                if (chunk > PG_SIZE - pg_off) chunk = PG_SIZE - pg_off;
+                if (chunk > inode->i_size - in_file->fd_pos) chunk = inode->i_size - in_file->fd_pos;
+                src = pg->kvaddr + pg_off;
+                in_file->fd_pos += chunk;
+                bytes_in = chunk;
+            }
+            else
+            {
+                bytes_in = file_read(in_file, io_buf, chunk);
+            }
+        }
+        else
+        {
+            bytes_in = sys_read(in_fd, io_buf, chunk);
+        }
+        if (bytes_in <= 0) break;
+
+        int32_t bytes_out = sys_write(out_fd, src, bytes_in);
+        if (bytes_out == -1)
+        {
+            if (in_file != NULL) in_file->fd_pos -= bytes_in;
+            if (transferred == 0) transferred = -1;
+            break;
+        }
+        transferred += bytes_out;
+        /* 管道满了，没写出的数据留在输入文件中 */
+        if (bytes_out < bytes_in)
+        {
+            if (in_file != NULL) in_file->fd_pos -= bytes_in - bytes_out;
+            break;
+        }
+    }
+
+    mfree_page(PF_KERNEL, io_buf, 1);
+    return transferred;
+}
+
+/* 把文件in_fd从当前位置开始的最多count个字节发送到out_fd，成功返回发送的字节数，失败返回-1 */
+int32_t sys_sendfile(int32_t out_fd, int32_t in_fd, uint32_t count)
+{
+    if (in_fd <= stderr_no || in_fd >= MAX_FILES_OPEN_PER_PROC || \
+        running_thread()->fd_table[in_fd] == (uint32_t)-1 || is_pipe(in_fd))
+    {
+        printk("sys_sendfile: in_fd must be an opened file\n");
+        return -1;
+    }
+    if (out_fd < 0 || out_fd >= MAX_FILES_OPEN_PER_PROC)
+    {
+        printk("sys_sendfile: out_fd error\n");
+        return -1;
+    }
+    return fd_transfer(out_fd, in_fd, count);
+}
+
+/* 在管道和其它文件描述符之间搬运最多count个字节，至少一端是管道，成功返回搬运的字节数，失败返回-1 */
+int32_t sys_splice(int32_t fd_in, int32_t fd_out, uint32_t count)
+{
+    if (fd_in < 0 || fd_in >= MAX_FILES_OPEN_PER_PROC || fd_out < 0 || fd_out >= MAX_FILES_OPEN_PER_PROC)
+    {
+        printk("sys_splice: fd error\n");
+        return -1;
+    }
+    if (!is_pipe(fd_in) && !is_pipe(fd_out))
+    {
+        printk("sys_splice: one of the fds must be a pipe\n");
+        return -1;
+    }
+    return fd_transfer(fd_out, fd_in, count);
+}
+
+/* fd是否是当前进程打开的普通文件，不是标准输入输出和管道 */
+static int fd_is_file(int32_t fd)
+{
+    return fd > stderr_no && fd < MAX_FILES_OPEN_PER_PROC && \
+           running_thread()->fd_table[fd] != (uint32_t)-1 && !is_pipe(fd);
+}
+
+/* 从fd读取数据依次填满iov中的iovcnt个缓冲区，成功返回读取的字节数，失败返回-1 */
+int32_t sys_readv(int32_t fd, const struct iovec *iov, uint32_t iovcnt)
+{
+    /* 普通文件的所有缓冲区作为一次请求交给文件系统 */
+    if (fd_is_file(fd)) return file_readv(&file_table[fd_local2global(fd)], iov, iovcnt);
+
+    int32_t ret = 0;
+    uint32_t iov_idx = 0;
+    while (iov_idx < iovcnt)
+    {
+        int32_t bytes_read = sys_read(fd, iov[iov_idx].iov_base, iov[iov_idx].iov_len);
+        if (bytes_read == -1) return ret == 0 ? -1 : ret;
+        ret += bytes_read;
+        if ((uint32_t)bytes_read < iov[iov_idx].iov_len) break;
+        iov_idx++;
+    }
+    return ret;
+}
+
+/* 把iov中iovcnt个缓冲区的数据依次写入fd，成功返回写入的字节数，失败返回-1 */
+int32_t sys_writev(int32_t fd, const struct iovec *iov, uint32_t iovcnt)
+{
+    if (fd_is_file(fd))
+    {
+        struct file *wr_file = &file_table[fd_local2global(fd)];
+        if (!(wr_file->fd_flag & O_WRONLY || wr_file->fd_flag & O_RDWR))
+        {
+            printk("sys_writev: not allowd to write file without flag O_RDWR or O_WRONLY\n");
+            return -1;
+        }
+        return file_writev(wr_file, iov, iovcnt);
+    }
+
+    int32_t ret = 0;
+    uint32_t iov_idx = 0;
+    while (iov_idx < iovcnt)
+    {
+        int32_t bytes_written = sys_write(fd, iov[iov_idx].iov_base, iov[iov_idx].iov_len);
+        if (bytes_written == -1) return ret == 0 ? -1 : ret;
+        ret += bytes_written;
+        if ((uint32_t)bytes_written < iov[iov_idx].iov_len) break;
+        iov_idx++;
+    }
+    return ret;
+}
+
+/* 从文件args->fd的args->offset处读取args->count个字节到args->buf，不改变文件的当前位置，
+   成功返回读取的字节数，失败或到达文件末尾返回-1 */
+int32_t sys_pread(const struct pio_args *args)
+{
+    if (!fd_is_file(args->fd))
+    {
+        printk("sys_pread: fd %d is not a file\n", args->fd);
+        return -1;
+    }
+    struct file *rd_file = &file_table[fd_local2global(args->fd)];
+    inode_flush_dalloc(rd_file->fd_inode);
+    if (args->offset >= rd_file->fd_inode->i_size) return -1;
+
+    uint32_t fd_pos_bak = rd_file->fd_pos;
+    rd_file->fd_pos = args->offset;
+    int32_t ret = file_read(rd_file, args->buf, args->count);
+    rd_file->fd_pos = fd_pos_bak;
+    return ret;
+}
+
+/* 把args->buf中的args->count个字节写到文件args->fd的args->offset处，覆盖已有数据，
+   offset不能超过文件大小，不改变文件的当前位置，成功返回写入的字节数，失败返回-1 */
+int32_t sys_pwrite(const struct pio_args *args)
+{
+    if (!fd_is_file(args->fd))
+    {
+        printk("sys_pwrite: fd %d is not a file\n", args->fd);
+        return -1;
+    }
+    struct file *wr_file = &file_table[fd_local2global(args->fd)];
+    if (!(wr_file->fd_flag & O_WRONLY || wr_file->fd_flag & O_RDWR))
+    {
+        printk("sys_pwrite: not allowd to write file without flag O_RDWR or O_WRONLY\n");
+        return -1;
+    }
+    return file_pwrite(wr_file, args->offset, args->buf, args->count);
+}
+
 /* 重置文件指针，成功返回新的对于文件头的偏移量，失败返回-1 */
 int32_t sys_lseek(int32_t fd, int32_t offset, uint8_t whence)
 {
@@ -486,6 +803,7 @@ int32_t sys_lseek(int32_t fd, int32_t offset, uint8_t whence)
     ASSERT(whence > 0 && whence < 4);
     uint32_t _fd = fd_local2global(fd);
     struct file *pf = &file_table[_fd];
+    inode_flush_dalloc(pf->fd_inode);
     int32_t new_pos = 0;            // 新的偏移必须位于文件大小之间
     int32_t file_size = (int32_t)pf->fd_inode->i_size;
     switch (whence)
@@ -508,14 +826,14 @@ int32_t sys_lseek(int32_t fd, int32_t offset, uint8_t whence)
     return pf->fd_pos;
 }
 
-/* 删除文件（FT_REGULAR），成功返回0，失败返回-1 */
-int32_t sys_unlink(const char *pathname)
+/* 删除目录dir下的文件（FT_REGULAR），dir为NULL时与sys_unlink相同，成功返回0，失败返回-1 */
+int32_t sys_unlinkat(struct dir *dir, const char *pathname)
 {
     ASSERT(strlen(pathname) < MAX_PATH_LEN);
-
     struct path_search_record searched_record;
     memset(&searched_record, 0, sizeof(struct path_search_record));
-    int inode_no = search_file(pathname, &searched_record);
+    int inode_no = search_file_at(dir, pathname, &searched_record);
+    if (searched_record.mnt_dir != NULL) return tmpfs_unlink(searched_record.mnt_dir, searched_record.mnt_path);
     ASSERT(inode_no != 0);
     if (inode_no == -1)
     {
@@ -538,7 +856,8 @@ int32_t sys_unlink(const char *pathname)
            (uint32_t)inode_no == file_table[file_idx].fd_inode->i_no) break;   
         file_idx++;
     }
-    if (file_idx < MAX_FILE_OPEN)
+    /* 文件关闭后可能还被映射着，inode仍然打开 */
+    if (file_idx < MAX_FILE_OPEN || inode_is_open(cur_part, inode_no))
     {
         dir_close(searched_record.parent_dir);
         printk("file %s is in use, not allow to delete!\n", pathname);
@@ -546,7 +865,7 @@ int32_t sys_unlink(const char *pathname)
     }
     ASSERT(file_idx == MAX_FILE_OPEN);
 
-    void *io_buf = sys_malloc(SECTOR_SIZE + SECTOR_SIZE);
+    void *io_buf = sys_malloc(cur_part->sb->block_size);
     if (io_buf == NULL)
     {
         dir_close(searched_record.parent_dir);
@@ -555,28 +874,43 @@ int32_t sys_unlink(const char *pathname)
     }
 
     struct dir *parent_dir = searched_record.parent_dir;
+    journal_begin();
     delete_dir_entry(cur_part, parent_dir, inode_no, io_buf);
     inode_release(cur_part, inode_no);
+    journal_end();
     sys_free(io_buf);
     dir_close(searched_record.parent_dir);
     return 0;
 }
 
-/* 创建目录pathname，成功返回0，失败返回1 */
-int32_t sys_mkdir(const char *pathname)
+/* 删除文件（FT_REGULAR），成功返回0，失败返回-1 */
+int32_t sys_unlink(const char *pathname)
+{
+    return sys_unlinkat(NULL, pathname);
+}
+
+/* 在目录dir下创建目录pathname，dir为NULL时与sys_mkdir相同，成功返回0，失败返回-1 */
+int32_t sys_mkdirat(struct dir *dir, const char *pathname)
 {
     uint8_t rollback_step = 0;      // 记录失败后的回滚状态
-    void *io_buf = sys_malloc(SECTOR_SIZE * 2);
+    void *io_buf = sys_malloc(cur_part->sb->block_size);
     if (io_buf == NULL)
     {
         printk("sys_mkdir: sys_malloc for io_buf failed\n");
         return -1;
     }
+    journal_begin();
 
     struct path_search_record searched_record;
     memset(&searched_record, 0, sizeof(struct path_search_record));
     int inode_no = -1;
-    inode_no = search_file(pathname, &searched_record);
+    inode_no = search_file_at(dir, pathname, &searched_record);
+    if (searched_record.mnt_dir != NULL)
+    {
+        journal_end();
+        sys_free(io_buf);
+        return tmpfs_mkdir(searched_record.mnt_dir, searched_record.mnt_path);
+    }
     if (inode_no != -1)
     {
         /* 如果存在同名的目录或文件 */
@@ -613,23 +947,9 @@ int32_t sys_mkdir(const char *pathname)
     struct inode new_dir_inode;
     inode_init(inode_no, &new_dir_inode);
 
-    uint32_t block_bitmap_idx = 0;
-    int32_t block_lba = -1;
-    block_lba = block_bitmap_alloc(cur_part);
-    if (block_lba == -1)
-    {
-        printk("sys_mkdir: block_bitmap_alloc for create directory failed\n");
-        rollback_step = 2;
-        goto rollback;
-    }
-    new_dir_inode.i_sectors[0] = block_lba;
-    block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
-    ASSERT(block_bitmap_idx != 0);
-    bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
-
-    /* 写入.和..到新的目录中 */
-    memset(io_buf, 0, SECTOR_SIZE * 2);
-    struct dir_entry *p_de = (struct dir_entry *)io_buf;
+    /* 新目录只有.和..，直接内联在inode中，不分配数据块 */
+    new_dir_inode.i_flags = INODE_INLINE;
+    struct dir_entry *p_de = (struct dir_entry *)new_dir_inode.i_sectors;
     
     memcpy(p_de->filename, ".", 1);
     p_de->i_no = inode_no;
@@ -640,7 +960,6 @@ int32_t sys_mkdir(const char *pathname)
     memcpy(p_de->filename, "..", 2);
     p_de->i_no = parent_dir->inode->i_no;
     p_de->f_type = FT_DIRECTORY;
-    ide_write(cur_part->my_disk, new_dir_inode.i_sectors[0], io_buf, 1);
 
     new_dir_inode.i_size = 2 * cur_part->sb->dir_entry_size;
 
@@ -648,7 +967,7 @@ int32_t sys_mkdir(const char *pathname)
     struct dir_entry new_dir_entry;
     memset(&new_dir_entry, 0, sizeof(struct dir_entry));
     create_dir_entry(dirname, inode_no, FT_DIRECTORY, &new_dir_entry);
-    memset(io_buf, 0, SECTOR_SIZE * 2);
+    memset(io_buf, 0, cur_part->sb->block_size);
     if (!sync_dir_entry(parent_dir, &new_dir_entry, io_buf))
     {
         printk("sync_mkdir: sync_dir_entry to disk failed!\n");
@@ -657,16 +976,17 @@ int32_t sys_mkdir(const char *pathname)
     }
 
     /* 父母路的inode同步到硬盘 */
-    memset(io_buf, 0, SECTOR_SIZE * 2);
+    memset(io_buf, 0, cur_part->sb->block_size);
     inode_sync(cur_part, parent_dir->inode, io_buf);
     
     /* 新建的目录inode同步到硬盘 */
-    memset(io_buf, 0, SECTOR_SIZE * 2);
+    memset(io_buf, 0, cur_part->sb->block_size);
     inode_sync(cur_part, &new_dir_inode, io_buf);
     
     /* 将inode位图同步到硬盘 */
     bitmap_sync(cur_part, inode_no, INODE_BITMAP);
     
+    journal_end();
     sys_free(io_buf);
 
     /* 关闭父目录 */
@@ -678,16 +998,23 @@ rollback:
     switch (rollback_step)
     {
         case 2:
-            bitmap_set(&cur_part->inode_bitmap, inode_no, 0);
+            part_bitmap_set(cur_part, INODE_BITMAP, inode_no, 0);
         case 1:
             dir_close(searched_record.parent_dir);
             break;
     }
 
+    journal_end();
     sys_free(io_buf);
     return -1;
 }
 
+/* 创建目录pathname，成功返回0，失败返回-1 */
+int32_t sys_mkdir(const char *pathname)
+{
+    return sys_mkdirat(NULL, pathname);
+}
+
 /* 打开目录，成功返回目录结构，失败返回NULL */
 struct dir *sys_opendir(const char *pathname)
 {
@@ -699,6 +1026,7 @@ struct dir *sys_opendir(const char *pathname)
     struct path_search_record searched_record;
     memset(&searched_record, 0, sizeof(struct path_search_record));
     int inode_no = search_file(pathname, &searched_record);
+    if (searched_record.mnt_dir != NULL) return tmpfs_opendir(searched_record.mnt_dir, searched_record.mnt_path);
     struct dir *ret = NULL;
     if (inode_no == -1)
     {
@@ -735,13 +1063,23 @@ int32_t sys_closedir(struct dir *dir)
 struct dir_entry *sys_readdir(struct dir *dir)
 {
     ASSERT(dir != NULL);
+    if (dir->inode->i_flags & INODE_TMPFS) return tmpfs_readdir(dir);
     return dir_read(dir);
 }
 
+/* 从目录args->dir的游标处一次读出最多args->count个目录项，返回读出的目录项数，读完返回0，失败返回-1 */
+int32_t sys_getdents(const struct getdents_args *args)
+{
+    ASSERT(args->dir != NULL);
+    if (args->dir->inode->i_flags & INODE_TMPFS) return tmpfs_read_batch(args->dir, args->buf, args->count, args->flags);
+    return dir_read_batch(args->dir, args->buf, args->count, args->flags);
+}
+
 /* 把dir目录的游标置0 */
 void sys_rewinddir(struct dir *dir)
 {
     dir->dir_pos = 0;
+    dir->dir_blk_idx = dir->dir_blk_ent = dir->dir_cursor_pos = 0;
 }
 
 /* 删除空目录，成功返回0，失败返回-1 */
@@ -750,6 +1088,7 @@ int32_t sys_rmdir(const char *pathname)
     struct path_search_record searched_record;
     memset(&searched_record, 0, sizeof(struct path_search_record));
     int inode_no = search_file(pathname, &searched_record);
+    if (searched_record.mnt_dir != NULL) return tmpfs_rmdir(searched_record.mnt_dir, searched_record.mnt_path);
     ASSERT(inode_no != 0);
     int retval = -1;
     if (inode_no == -1)
@@ -772,10 +1111,12 @@ int32_t sys_rmdir(const char *pathname)
             }
             else
             {
+                journal_begin();
                 if (!dir_remove(searched_record.parent_dir, dir))
                 {
                     retval = 0;
                 }
+                journal_end();
             }
             
             dir_close(dir);
@@ -790,11 +1131,11 @@ int32_t sys_rmdir(const char *pathname)
 static uint32_t get_parent_dir_inode_nr(uint32_t child_inode_nr, void *io_buf)
 {
     struct inode *child_dir_inode = inode_open(cur_part, child_inode_nr);
-    /* 目录中的..中包含父目录的inode编号，..位于目录块的第0块 */
-    uint32_t block_lba = child_dir_inode->i_sectors[0];
+    /* 目录中的..中包含父目录的inode编号，..位于目录块的第0块或内联数据中 */
+    uint32_t block_lba = (child_dir_inode->i_flags & INODE_INLINE) ? INODE_INLINE_LBA : child_dir_inode->i_sectors[0];
     ASSERT(block_lba >= cur_part->sb->data_start_lba);
+    inode_block_read(cur_part, child_dir_inode, block_lba, io_buf);
     inode_close(child_dir_inode);
-    ide_read(cur_part->my_disk, block_lba, io_buf, 1);
     struct dir_entry *dir_e = (struct dir_entry *)io_buf;
     /* 第0个目录项是. 。第一个是.. */
     ASSERT(dir_e[1].i_no < 4096 && dir_e[1].f_type == FT_DIRECTORY);
@@ -806,38 +1147,35 @@ static uint32_t get_parent_dir_inode_nr(uint32_t child_inode_nr, void *io_buf)
 static int get_child_dir_name(uint32_t p_inode_nr, uint32_t c_inode_nr, char *path, void *io_buf)
 {
     struct inode *parent_dir_inode = inode_open(cur_part, p_inode_nr);
-    uint8_t block_idx = 0;
-    uint32_t all_blocks[140] = {0, }, block_cnt = 12;
-    while (block_idx < 12)
+    uint32_t block_idx = 0, block_cnt = INODE_BLOCKS_MAX(cur_part->sb);
+    uint32_t *all_blocks = (uint32_t *)sys_malloc(block_cnt * sizeof(uint32_t));
+    if (all_blocks == NULL)
     {
-        all_blocks[block_idx] = parent_dir_inode->i_sectors[block_idx];
-        block_idx++;
-    }
-    if (parent_dir_inode->i_sectors[12])
-    {
-        ide_read(cur_part->my_disk, parent_dir_inode->i_sectors[12], all_blocks + 12, 1);
-        block_cnt = 140;
+        inode_close(parent_dir_inode);
+        return -1;
     }
-    inode_close(parent_dir_inode);
+    inode_collect_blocks(cur_part, parent_dir_inode, all_blocks);
 
     struct dir_entry *dir_e = (struct dir_entry *)io_buf;
     uint32_t dir_entry_size = cur_part->sb->dir_entry_size;
-    uint32_t dir_entrys_per_sec = (512 / dir_entry_size);
+    uint32_t dir_entrys_per_blk = (cur_part->sb->block_size / dir_entry_size);
+    int ret = -1;
     block_idx = 0;
-    while (block_idx < block_cnt)
+    while (block_idx < block_cnt && ret == -1)
     {
         if (all_blocks[block_idx])
         {
-            ide_read(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
-            uint8_t dir_e_idx = 0;
+            inode_block_read(cur_part, parent_dir_inode, all_blocks[block_idx], io_buf);
+            uint32_t dir_e_idx = 0;
             
-            while (dir_e_idx < dir_entrys_per_sec)
+            while (dir_e_idx < dir_entrys_per_blk)
             {
                 if ((dir_e + dir_e_idx)->i_no == c_inode_nr)
                 {
                     strcat(path, "/");
                     strcat(path, (dir_e + dir_e_idx)->filename);
-                    return 0;
+                    ret = 0;
+                    break;
                 }
                 
                 dir_e_idx++;
@@ -847,7 +1185,9 @@ static int get_child_dir_name(uint32_t p_inode_nr, uint32_t c_inode_nr, char *pa
         block_idx++;
     }
 
-    return -1;
+    sys_free(all_blocks);
+    inode_close(parent_dir_inode);
+    return ret;
 }
 
 /* 把当前工作目录的绝对路径写入buf，size是buf的大小
@@ -856,7 +1196,7 @@ static int get_child_dir_name(uint32_t p_inode_nr, uint32_t c_inode_nr, char *pa
 char *sys_getcwd(char *buf, uint32_t size)
 {
     ASSERT(buf != NULL);
-    void *io_buf = sys_malloc(SECTOR_SIZE);
+    void *io_buf = sys_malloc(cur_part->sb->block_size);
     if (io_buf == NULL) return NULL;
 
     struct task_struct *cur_thread = running_thread();
@@ -913,6 +1253,12 @@ int32_t sys_chdir(const char *path)
     struct path_search_record searched_record;
     memset(&searched_record, 0, sizeof(struct path_search_record));
     int inode_no = search_file(path, &searched_record);
+    /* 工作目录用硬盘分区上的inode号表示，不能进入挂载的文件系统 */
+    if (searched_record.mnt_dir != NULL)
+    {
+        printk("sys_chdir: can't change working directory into mounted %s\n", path);
+        return -1;
+    }
     if (inode_no != -1)
     {
         if (searched_record.file_type == FT_DIRECTORY)
@@ -930,8 +1276,8 @@ int32_t sys_chdir(const char *path)
     return ret;
 }
 
-/* 在buf中填充path文件的相关信息，成功返回0，失败返回-1k */
-int32_t sys_stat(const char *path, struct stat *buf)
+/* 在buf中填充目录dir下path文件的相关信息，dir为NULL时与sys_stat相同，成功返回0，失败返回-1 */
+int32_t sys_fstatat(struct dir *dir, const char *path, struct stat *buf)
 {
     /* 如果是查找根目录直接返回 */
     if (!strcmp(path, "/") || !strcmp(path, "/.") || !strcmp(path, "/.."))
@@ -941,14 +1287,15 @@ int32_t sys_stat(const char *path, struct stat *buf)
         buf->st_size = root_dir.inode->i_no;
         return 0;
     }
-
     int32_t ret = -1;
     struct path_search_record searched_record;
     memset(&searched_record, 0, sizeof(struct path_search_record));
-    int inode_no = search_file(path, &searched_record);
+    int inode_no = search_file_at(dir, path, &searched_record);
+    if (searched_record.mnt_dir != NULL) return tmpfs_stat(searched_record.mnt_dir, searched_record.mnt_path, buf);
     if (inode_no != -1)
     {
         struct inode *obj_inode = inode_open(cur_part, inode_no);   
+        inode_flush_dalloc(obj_inode);
         buf->st_size = obj_inode->i_size;
         inode_close(obj_inode);
         buf->st_filetype = searched_record.file_type;
@@ -957,13 +1304,101 @@ int32_t sys_stat(const char *path, struct stat *buf)
     }
     else
     {
-        printk("sys_stat: %s not found\n", path);
+        printk("sys_fstatat: %s not found\n", path);
     }
 
     dir_close(searched_record.parent_dir);
     return ret;
 }
 
+/* 在buf中填充path文件的相关信息，成功返回0，失败返回-1 */
+int32_t sys_stat(const char *path, struct stat *buf)
+{
+    return sys_fstatat(NULL, path, buf);
+}
+
+/* 在buf中填充已打开文件fd的相关信息，不再查找路径，成功返回0，失败返回-1 */
+int32_t sys_fstat(int32_t fd, struct stat *buf)
+{
+    if (!fd_is_file(fd))
+    {
+        printk("sys_fstat: fd %d is not a regular file\n", fd);
+        return -1;
+    }
+    struct inode *obj_inode = file_table[fd_local2global(fd)].fd_inode;
+    inode_flush_dalloc(obj_inode);
+    buf->st_size = obj_inode->i_size;
+    buf->st_filetype = FT_REGULAR;
+    buf->st_ino = obj_inode->i_no;
+    return 0;
+}
+
+/* 把文件fd的数据写入硬盘，metadata为1时无论inode是否修改过都写回inode，成功返回0，失败返回-1 */
+static int32_t fd_sync(int32_t fd, int metadata)
+{
+    if (!fd_is_file(fd))
+    {
+        printk("fd_sync: fd %d is not a regular file\n", fd);
+        return -1;
+    }
+    struct inode *inode = file_table[fd_local2global(fd)].fd_inode;
+    /* tmpfs的文件只在内存中，没有要写入硬盘的 */
+    if (inode->i_flags & INODE_TMPFS) return 0;
+    inode_flush_dalloc(inode);
+    page_cache_writeback(inode, 0);
+    if (metadata) inode_sync(cur_part, inode, NULL);
+    else inode_writeback(cur_part, inode);
+    /* 提交事务时会等硬盘写缓存落盘 */
+    journal_flush(0);
+    ide_flush(cur_part->my_disk);
+    return 0;
+}
+
+/* 把文件fd的数据和inode写入硬盘，返回后即使断电也不会丢失，成功返回0，失败返回-1 */
+int32_t sys_fsync(int32_t fd)
+{
+    return fd_sync(fd, 1);
+}
+
+/* 把文件fd的数据写入硬盘，inode只在文件大小或块地址变化时才写回，成功返回0，失败返回-1 */
+int32_t sys_fdatasync(int32_t fd)
+{
+    return fd_sync(fd, 0);
+}
+
+/* 把所有缓存中的修改写入硬盘 */
+void sys_sync(void)
+{
+    file_flush_all(0);
+    page_cache_flush_all(0);
+    inode_table_flush(0);
+    journal_flush(0);
+    ide_flush(cur_part->my_disk);
+}
+
+/* 获取path所在文件系统的容量和空闲块、空闲inode数，成功返回0，失败返回-1 */
+int32_t sys_statfs(const char *path, struct statfs *buf)
+{
+    struct stat path_stat;
+    if (sys_stat(path, &path_stat) == -1) return -1;
+
+    /* tmpfs的inode号在硬盘分区的inode号之后 */
+    if (path_stat.st_ino >= TMPFS_INO_BASE)
+    {
+        tmpfs_statfs(buf);
+        return 0;
+    }
+
+    /* 其余的路径都在挂载的分区上 */
+    struct super_block *sb = cur_part->sb;
+    buf->f_bsize = sb->block_size;
+    buf->f_blocks = (sb->sec_cnt - (sb->data_start_lba - sb->part_lba_base)) / sb->block_sects;
+    buf->f_bfree = sb->free_blocks;
+    buf->f_files = sb->inode_cnt;
+    buf->f_ffree = sb->free_inodes;
+    return 0;
+}
+
 /* 向屏幕输出一个字符 */
 void sys_putchar(char char_ascii)
 {
@@ -977,6 +1412,10 @@ void filesys_init()
 
     if (sb_buf == NULL) PANIC("alloc memory failed!");
 
+    inode_table_cache_init();
+    part_bitmap_cache_init();
+    page_cache_init();
+    compress_init();
     printk("searching filesystem......\n");
     
     while (channel_no < channel_cnt)
@@ -1006,14 +1445,20 @@ void filesys_init()
                     
                     ide_read(hd, part->start_lba + 1, sb_buf, 1);
                     
-                    if (sb_buf->magic == 0x19590318)
+                    if (sb_buf->magic == SUPER_BLOCK_MAGIC)
                     {
                         printk("%s has filesystem\n", part->name);
                     }
+                    else if (sb_buf->magic == SUPER_BLOCK_MAGIC_V1 || sb_buf->magic == SUPER_BLOCK_MAGIC_MIGRATING)
+                    {
+                        /* 旧格式的inode表，或者上次没有转换完，转换后继续使用 */
+                        printk("%s has old filesystem\n", part->name);
+                        if (inode_table_migrate(part, sb_buf) == -1) PANIC("migrate inode table failed!");
+                    }
                     else
                     {
                         printk("formatting %s`s partition %s......\n", hd->name, part->name);
-                        partition_format(part);
+                        partition_format(part, FS_BLOCK_SIZE);
                     }
                 }
                 
@@ -1040,4 +1485,26 @@ void filesys_init()
     /* 初始化文件表 */
     uint32_t fd_idx = 0;
     while (fd_idx < MAX_FILE_OPEN) file_table[fd_idx++].fd_inode = NULL;
+
+    /* 在硬盘上的/tmp目录挂载tmpfs，没有时先创建 */
+    struct path_search_record searched_record;
+    memset(&searched_record, 0, sizeof(struct path_search_record));
+    int tmp_ino = search_file("/tmp", &searched_record);
+    if (tmp_ino == -1)
+    {
+        dir_close(searched_record.parent_dir);
+        sys_mkdir("/tmp");
+        memset(&searched_record, 0, sizeof(struct path_search_record));
+        tmp_ino = search_file("/tmp", &searched_record);
+    }
+    struct inode *tmp_root = NULL;
+    if (tmp_ino != -1 && searched_record.file_type == FT_DIRECTORY) tmp_root = tmpfs_mount(searched_record.parent_dir->inode->i_no);
+    dir_close(searched_record.parent_dir);
+    if (tmp_root == NULL || mount_add(tmp_ino, tmp_root) == -1) printk("mount tmpfs on /tmp failed\n");
+
+    /* 启动延迟分配数据和其它脏数据的写回线程 */
+    file_dalloc_init();
+
+    /* 在后台清零快速格式化时跳过的inode表 */
+    inode_table_lazy_init(cur_part);
 }
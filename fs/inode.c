@@ -10,32 +10,161 @@
 #include "string.h"
 #include "super_block.h"
 #include "thread.h"
+#include "sync.h"
+#include "timer.h"
+#include "page_cache.h"
+#include "journal.h"
+#include "compress.h"
+
+#define ITABLE_CACHE_SECS   16          // 缓存的inode表扇区数
+#define ITABLE_ZERO_SECS    (PG_SIZE / SECTOR_SIZE)     // 清零时每次写入的扇区数
+#define ITABLE_ZERO_INTERVAL_MS 100     // 后台线程清零两组之间的间隔
 
 /* 用来存储inode位置 */
 struct inode_position
 {
-    int two_sec;            // inode是否跨扇区
     uint32_t sec_lba;       // inode所在的扇区号
     uint32_t off_size;      // inode在扇区内的字节偏移量
 };
 
-/* 获取inode所在的扇区和扇区内的偏移量 */
+/* inode表扇区缓存，更新单个inode时命中缓存就不用先读扇区。
+   inode_sync写直达；追加数据时的inode更新用inode_mark_dirty只改缓存，
+   由写回线程、fsync或sync写入硬盘，被替换出缓存时也会写回 */
+struct itable_sec
+{
+    struct disk *hd;        // 扇区所在的硬盘，NULL表示空闲
+    uint32_t lba;           // 扇区地址
+    int dirty;              // 缓存中有还没写入硬盘的修改
+    uint32_t dirty_ticks;   // 第一次被修改时的ticks
+    uint8_t data[512];
+};
+
+static struct itable_sec itable_cache[ITABLE_CACHE_SECS];
+static uint32_t itable_cache_next;      // 下一个被替换的缓存项
+static struct lock itable_lock;         // 保护缓存，读写扇区期间可能切换任务
+static uint8_t itable_zero_buf[PG_SIZE];    // 清零inode表用的全0缓冲区
+
+/* 获取inode所在的扇区和扇区内的偏移量，inode记录不会跨扇区 */
 static void inode_locate(struct partition *part, uint32_t inode_no, struct inode_position *inode_pos) 
 {
     ASSERT(inode_no < 4096);
-    uint32_t inode_table_lba = part->sb->inode_table_lba;
-    uint32_t inode_size = sizeof(struct inode);
-    uint32_t off_size = inode_no * inode_size;      // 第inode_no的i节点对于inode_table_lba的字节偏移量
-    uint32_t off_sec = off_size / 512;              // i节点对于inode_table_lba的扇区偏移量
-    uint32_t off_size_in_sec = off_size % 512;      // i节点在其扇区内的字节偏移量
-
-    /* 判断此i节点是否跨越两个扇区 */   
-    uint32_t left_in_sec = 512 - off_size_in_sec;
-    if (left_in_sec < inode_size) inode_pos->two_sec = 1;
-    else inode_pos->two_sec = 0;
+    inode_pos->sec_lba = part->sb->inode_table_lba + inode_no / INODES_PER_SECTOR;
+    inode_pos->off_size = (inode_no % INODES_PER_SECTOR) * DISK_INODE_SIZE;
+}
+
+/* 初始化inode表扇区缓存 */
+void inode_table_cache_init(void)
+{
+    memset(itable_cache, 0, sizeof(itable_cache));
+    itable_cache_next = 0;
+    lock_init(&itable_lock);
+}
+
+/* 把缓存的扇区写入硬盘并清除脏标记，调用者需持有itable_lock */
+static void itable_sec_write(struct itable_sec *sec)
+{
+    journal_write(sec->hd, sec->lba, sec->data, 1);
+    sec->dirty = 0;
+}
+
+/* 返回硬盘hd上lba扇区的缓存，不在缓存中时读入，调用者需持有itable_lock */
+static struct itable_sec *itable_sec_get(struct disk *hd, uint32_t lba)
+{
+    uint32_t idx = 0;
+    while (idx < ITABLE_CACHE_SECS)
+    {
+        if (itable_cache[idx].hd == hd && itable_cache[idx].lba == lba) return &itable_cache[idx];
+        idx++;
+    }
+
+    struct itable_sec *sec = &itable_cache[itable_cache_next];
+    itable_cache_next = (itable_cache_next + 1) % ITABLE_CACHE_SECS;
+    /* 被替换的扇区有修改时先写回 */
+    if (sec->hd != NULL && sec->dirty) itable_sec_write(sec);
+    /* 读盘时可能切换任务，先让此项失效 */
+    sec->hd = NULL;
+    journal_read(hd, lba, sec->data, 1);
+    sec->hd = hd;
+    sec->lba = lba;
+    sec->dirty = 0;
+    return sec;
+}
+
+/* 清零inode表的第group组并清除其未初始化标志，调用者需持有itable_lock */
+static void itable_group_zero(struct partition *part, uint32_t group)
+{
+    struct super_block *sb = part->sb;
+    uint32_t lba = sb->inode_table_lba + group * sb->itable_group_sects;
+    uint32_t sects_left = sb->itable_group_sects;
+    while (sects_left > 0)
+    {
+        uint32_t sects = sects_left < ITABLE_ZERO_SECS ? sects_left : ITABLE_ZERO_SECS;
+        ide_write(part->my_disk, lba, itable_zero_buf, sects);
+        lba += sects;
+        sects_left -= sects;
+    }
     
-    inode_pos->sec_lba = inode_table_lba + off_sec;
-    inode_pos->off_size = off_size_in_sec;
+    /* 组清零落盘后再清除标志 */
+    sb->itable_uninit &= ~(1 << group);
+    super_block_sync(part);
+}
+
+/* 确保inode_no所在的组已经清零，调用者需持有itable_lock */
+static void itable_group_prepare(struct partition *part, uint32_t inode_no)
+{
+    struct super_block *sb = part->sb;
+    if (sb->itable_uninit == 0) return;
+
+    uint32_t group = inode_no / INODES_PER_SECTOR / sb->itable_group_sects;
+    if (sb->itable_uninit & (1 << group)) itable_group_zero(part, group);
+}
+
+/* 后台线程，逐组清零part中剩余未初始化的inode表 */
+static void itable_lazy_zero(void *arg)
+{
+    struct partition *part = (struct partition *)arg;
+    struct super_block *sb = part->sb;
+    uint32_t group_cnt = DIV_ROUND_UP(sb->inode_table_sects, sb->itable_group_sects);
+    uint32_t group = 0;
+    while (group < group_cnt)
+    {
+        /* 每组之间让出硬盘，避免拖慢前台的读写 */
+        mtime_sleep(ITABLE_ZERO_INTERVAL_MS);
+        lock_acquire(&itable_lock);
+        if (sb->itable_uninit & (1 << group)) itable_group_zero(part, group);
+        lock_release(&itable_lock);
+        group++;
+    }
+    /* 工作完成后返回，线程由idle线程回收 */
+}
+
+/* part的inode表还有未清零的组时启动后台清零线程 */
+void inode_table_lazy_init(struct partition *part)
+{
+    if (part->sb->itable_uninit != 0)
+    {
+        thread_start("itable_zero", 10, itable_lazy_zero, part);
+    }
+}
+
+/* 把硬盘上的inode记录转换为内存中的inode */
+static void inode_from_disk(struct inode *inode, uint32_t inode_no, const struct d_inode *d_inode)
+{
+    inode->i_no = inode_no;
+    inode->i_size = d_inode->i_size;
+    inode->i_flags = d_inode->i_flags;
+    inode->i_ctable = d_inode->i_ctable;
+    memcpy(inode->i_sectors, d_inode->i_sectors, sizeof(inode->i_sectors));
+}
+
+/* 把内存中的inode转换为硬盘上的inode记录，只在内存中有用的字段不写入 */
+static void inode_to_disk(struct d_inode *d_inode, const struct inode *inode)
+{
+    memset(d_inode, 0, sizeof(struct d_inode));
+    d_inode->i_size = inode->i_size;
+    d_inode->i_flags = inode->i_flags;
+    d_inode->i_ctable = inode->i_ctable;
+    memcpy(d_inode->i_sectors, inode->i_sectors, sizeof(inode->i_sectors));
 }
 
 /* 根据i节点号返回相应的i节点 */
@@ -68,67 +197,128 @@ struct inode *inode_open(struct partition *part, uint32_t inode_no)
     /* 恢复pgdir */
     cur->pgdir = cur_pagedir_bak;
 
-    char *inode_buf;
-    if (inode_pos.two_sec) 
-    {
-        inode_buf = (char *)sys_malloc(1024);
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
-    }
-    else
-    {
-        inode_buf = (char *)sys_malloc(512);
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
-    }
-    memcpy(inode_found, inode_buf + inode_pos.off_size, sizeof(struct inode));
+    memset(inode_found, 0, sizeof(struct inode));
+    lock_acquire(&itable_lock);
+    itable_group_prepare(part, inode_no);
+    uint8_t *sec_buf = itable_sec_get(part->my_disk, inode_pos.sec_lba)->data;
+    inode_from_disk(inode_found, inode_no, (struct d_inode *)(sec_buf + inode_pos.off_size));
+    lock_release(&itable_lock);
+    list_init(&inode_found->i_pages);
     
     /* 执行该函数大概率之后会接着使用这个inode，所以插入队首 */
     list_push(&part->open_inodes, &inode_found->inode_tag);
     inode_found->i_open_cnts = 1;
     
-    sys_free(inode_buf);
     return inode_found;
 }
 
-/* 将inode写入到分区part */
-void inode_sync(struct partition *part, struct inode *inode, void *io_buf)
+/* 将inode写入到分区part，io_buf不再需要，保留参数与调用者兼容 */
+void inode_sync(struct partition *part, struct inode *inode, void *io_buf UNUSED)
 {
-    /* io_buf是在内存中的I/O缓冲区 */
-    uint8_t inode_no = inode->i_no;
     struct inode_position inode_pos;
     /* 获取inode信息到inode_pos */
-    inode_locate(part, inode_no, &inode_pos);
+    inode_locate(part, inode->i_no, &inode_pos);
     ASSERT(inode_pos.sec_lba <= (part->start_lba + part->sec_cnt));
     
-    /* inode中的inode_tag和i_open_cnts只在内存中有用，用于记录多进程共享文件 */
-    struct inode pure_inode;
-    memcpy(&pure_inode, inode, sizeof(struct inode));   
+    /* 在缓存的扇区中更新inode记录后整扇区写回 */
+    lock_acquire(&itable_lock);
+    itable_group_prepare(part, inode->i_no);
+    struct itable_sec *sec = itable_sec_get(part->my_disk, inode_pos.sec_lba);
+    inode_to_disk((struct d_inode *)(sec->data + inode_pos.off_size), inode);
+    itable_sec_write(sec);
+    lock_release(&itable_lock);
+}
 
-    pure_inode.i_open_cnts = 0;
-    pure_inode.write_deny = 0;          // 为0保证硬盘中读出时可写
-    pure_inode.inode_tag.prev = pure_inode.inode_tag.next = NULL;
+/* 只在缓存的扇区中更新inode记录并标记为脏，稍后再写入硬盘。
+   用于追加或覆盖数据后更新文件大小和块地址，新分配的块已经在位图中，
+   断电时最多丢失这些块和数据，不会出现inode指向未分配块的情况 */
+void inode_mark_dirty(struct partition *part, struct inode *inode)
+{
+    struct inode_position inode_pos;
+    inode_locate(part, inode->i_no, &inode_pos);
 
-    char *inode_buf = (char *)io_buf;
-    if (inode_pos.two_sec)
+    lock_acquire(&itable_lock);
+    itable_group_prepare(part, inode->i_no);
+    struct itable_sec *sec = itable_sec_get(part->my_disk, inode_pos.sec_lba);
+    inode_to_disk((struct d_inode *)(sec->data + inode_pos.off_size), inode);
+    if (!sec->dirty)
     {
-        /* 如果inode跨越两个扇区 */
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
-        /* 写入inode到缓冲区对应偏移 */
-        memcpy((inode_buf + inode_pos.off_size), &pure_inode, sizeof(struct inode));
-        /* 把I/O缓冲区的记录写回到硬盘 */
-        ide_write(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
+        sec->dirty = 1;
+        sec->dirty_ticks = ticks;
     }
-    else
+    lock_release(&itable_lock);
+}
+
+/* inode所在的扇区在缓存中有未写回的修改时写入硬盘 */
+void inode_writeback(struct partition *part, struct inode *inode)
+{
+    struct inode_position inode_pos;
+    inode_locate(part, inode->i_no, &inode_pos);
+
+    lock_acquire(&itable_lock);
+    uint32_t idx = 0;
+    while (idx < ITABLE_CACHE_SECS)
+    {
+        struct itable_sec *sec = &itable_cache[idx];
+        if (sec->hd == part->my_disk && sec->lba == inode_pos.sec_lba && sec->dirty) itable_sec_write(sec);
+        idx++;
+    }
+    lock_release(&itable_lock);
+}
+
+/* 按LBA从小到大写回inode表缓存中的脏扇区，only_expired为1时只写回修改后停留超过DIRTY_EXPIRE_TICKS的 */
+void inode_table_flush(int only_expired)
+{
+    lock_acquire(&itable_lock);
+    while (1)
+    {
+        struct itable_sec *first = NULL;
+        uint32_t idx = 0;
+        while (idx < ITABLE_CACHE_SECS)
+        {
+            struct itable_sec *sec = &itable_cache[idx];
+            if (sec->hd != NULL && sec->dirty && (!only_expired || ticks - sec->dirty_ticks >= DIRTY_EXPIRE_TICKS) && \
+                (first == NULL || sec->lba < first->lba)) first = sec;
+            idx++;
+        }
+        if (first == NULL) break;
+        itable_sec_write(first);
+    }
+    lock_release(&itable_lock);
+}
+
+/* inode是否已被打开，例如还有进程映射着此文件 */
+int inode_is_open(struct partition *part, uint32_t inode_no)
+{
+    struct list_elem *elem = part->open_inodes.head.next;
+    while (elem != &part->open_inodes.tail)
     {
-        /* inode全部在一个扇区 */
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
-        memcpy((inode_buf + inode_pos.off_size), &pure_inode, sizeof(struct inode));
-        ide_write(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+        struct inode *inode = elem2entry(struct inode, inode_tag, elem);
+        if (inode->i_no == inode_no) return 1;
+        elem = elem->next;
     }
+    return 0;
 }
 
 /* 关闭inode或减少inode打开次数 */
 void inode_close(struct inode *inode)
 {
+    /* tmpfs的inode和数据一直留在内存中，直到文件被删除 */
+    if (inode->i_flags & INODE_TMPFS)
+    {
+        enum intr_status old_status = intr_disable();
+        inode->i_open_cnts--;
+        intr_set_status(old_status);
+        return;
+    }
+
+    /* 最后一次关闭时写回并释放页缓存，写硬盘时会睡眠，不能在关中断后进行 */
+    if (inode->i_open_cnts == 1)
+    {
+        page_cache_release(inode);
+        compress_release(inode);
+    }
+
     enum intr_status old_status = intr_disable();
     if (--(inode->i_open_cnts) == 0)
     {
@@ -154,35 +344,206 @@ void inode_init(uint32_t inode_no, struct inode *new_inode)
     new_inode->i_size = 0;
     new_inode->i_open_cnts = 0;
     new_inode->write_deny = 0;
+    new_inode->i_flags = 0;
+    new_inode->i_ctable = 0;
+    new_inode->i_chunks = NULL;
+    list_init(&new_inode->i_pages);
     
     /* 初始化块索引数组 */
     uint8_t sec_idx = 0;
     while (sec_idx < 13) new_inode->i_sectors[sec_idx++] = 0;
 }
 
-/* 将分区part的inode清空 */
-void inode_delete(struct partition *part, uint32_t inode_no, void *io_buf)
+/* 将分区part的inode清空，io_buf不再需要，保留参数与调用者兼容 */
+void inode_delete(struct partition *part, uint32_t inode_no, void *io_buf UNUSED)
 {
     ASSERT(inode_no < 4096);
     struct inode_position inode_pos;
     inode_locate(part, inode_no, &inode_pos);
     ASSERT(inode_pos.sec_lba <= (part->start_lba + part->sec_cnt));
     
-    char *inode_buf = (char *)io_buf;
-    if (inode_pos.two_sec)
+    lock_acquire(&itable_lock);
+    itable_group_prepare(part, inode_no);
+    struct itable_sec *sec = itable_sec_get(part->my_disk, inode_pos.sec_lba);
+    memset(sec->data + inode_pos.off_size, 0, DISK_INODE_SIZE);
+    itable_sec_write(sec);
+    lock_release(&itable_lock);
+}
+
+/* 在旧格式分区的数据区中找连续sects个空闲扇区，用来暂存新的inode表，找不到返回0 */
+static uint32_t migrate_staging_find(struct partition *part, struct super_block *sb, uint32_t sects)
+{
+    uint32_t btmp_pages = DIV_ROUND_UP(sb->block_bitmap_sects * SECTOR_SIZE, PG_SIZE);
+    uint8_t *bits = get_kernel_pages(btmp_pages);
+    if (bits == NULL) return 0;
+    ide_read(part->my_disk, sb->block_bitmap_lba, bits, sb->block_bitmap_sects);
+
+    /* 格式化时块位图最后一个扇区中多余的位都置了1，找到的扇区一定在分区内 */
+    struct bitmap btmp;
+    btmp.btmp_bytes_len = sb->block_bitmap_sects * SECTOR_SIZE;
+    btmp.bits = bits;
+    btmp.hint = 0;
+    int bit_idx = bitmap_scan(&btmp, sects);
+    mfree_page(PF_KERNEL, bits, btmp_pages);
+    if (bit_idx == -1) return 0;
+    ASSERT(sb->data_start_lba + bit_idx + sects <= part->start_lba + part->sec_cnt);
+    return sb->data_start_lba + bit_idx;
+}
+
+/* 把旧格式分区的inode表转换为紧凑格式，sb是分区的超级块，会被更新并写回，
+   转换后inode表仍从原来的扇区开始，数据区不变。
+   新表先写到数据区的空闲扇区，超级块改为MIGRATING并记下暂存位置后才覆盖旧表，
+   在这之前断电分区仍是完整的旧格式，之后断电则下次挂载时从暂存处重新拷贝。
+   sb的magic为MIGRATING时只做后一半。成功返回0，失败返回-1 */
+int32_t inode_table_migrate(struct partition *part, struct super_block *sb)
+{
+    ASSERT(sb->magic == SUPER_BLOCK_MAGIC_V1 || sb->magic == SUPER_BLOCK_MAGIC_MIGRATING);
+    uint32_t old_bytes = sb->inode_table_sects * SECTOR_SIZE;
+    uint32_t new_sects = DIV_ROUND_UP(sb->inode_cnt * DISK_INODE_SIZE, SECTOR_SIZE);
+    ASSERT(new_sects <= sb->inode_table_sects);
+
+    uint8_t *old_table = get_kernel_pages(DIV_ROUND_UP(old_bytes, PG_SIZE));
+    uint8_t *new_table = get_kernel_pages(DIV_ROUND_UP(new_sects * SECTOR_SIZE, PG_SIZE));
+    if (old_table == NULL || new_table == NULL)
     {
-        /* inode跨越两个扇区 */
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
-        memset((inode_buf + inode_pos.off_size), 0, sizeof(struct inode));
-        ide_write(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
+        printk("inode_table_migrate: get_kernel_pages failed\n");
+        if (old_table) mfree_page(PF_KERNEL, old_table, DIV_ROUND_UP(old_bytes, PG_SIZE));
+        if (new_table) mfree_page(PF_KERNEL, new_table, DIV_ROUND_UP(new_sects * SECTOR_SIZE, PG_SIZE));
+        return -1;
+    }
+
+    if (sb->magic == SUPER_BLOCK_MAGIC_MIGRATING)
+    {
+        /* 上次转换在覆盖旧表时中断，暂存的新表是完整的 */
+        printk("resuming inode table migration of %s......\n", part->name);
+        ide_read(part->my_disk, sb->migrate_lba, new_table, new_sects);
     }
     else
     {
-        /* inode在同一个扇区 */
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
-        memset((inode_buf + inode_pos.off_size), 0, sizeof(struct inode));
-        ide_write(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+        printk("migrating inode table of %s......\n", part->name);
+        ide_read(part->my_disk, sb->inode_table_lba, old_table, sb->inode_table_sects);
+
+        /* 旧记录的前4个字段依次是i_no，i_size，i_open_cnts，write_deny，之后是i_sectors */
+        uint32_t inode_no = 0;
+        while (inode_no < sb->inode_cnt)
+        {
+            uint32_t *old_inode = (uint32_t *)(old_table + inode_no * OLD_DISK_INODE_SIZE);
+            struct d_inode *d_inode = (struct d_inode *)(new_table + inode_no * DISK_INODE_SIZE);
+            d_inode->i_size = old_inode[1];
+            memcpy(d_inode->i_sectors, old_inode + 4, sizeof(d_inode->i_sectors));
+            inode_no++;
+        }
+
+        /* 暂存的扇区在位图中仍是空闲的，转换完成前分区不会被挂载，没有别人会写它们 */
+        uint32_t staging_lba = migrate_staging_find(part, sb, new_sects);
+        if (staging_lba == 0)
+        {
+            printk("inode_table_migrate: no %d free sectors for staging\n", new_sects);
+            mfree_page(PF_KERNEL, old_table, DIV_ROUND_UP(old_bytes, PG_SIZE));
+            mfree_page(PF_KERNEL, new_table, DIV_ROUND_UP(new_sects * SECTOR_SIZE, PG_SIZE));
+            return -1;
+        }
+        ide_write(part->my_disk, staging_lba, new_table, new_sects);
+        ide_flush(part->my_disk);
+
+        sb->magic = SUPER_BLOCK_MAGIC_MIGRATING;
+        sb->migrate_lba = staging_lba;
+        ide_write(part->my_disk, part->start_lba + 1, sb, 1);
+        ide_flush(part->my_disk);
     }
+
+    ide_write(part->my_disk, sb->inode_table_lba, new_table, new_sects);
+    ide_flush(part->my_disk);
+
+    /* 新表已经落盘，最后把超级块改为新格式 */
+    sb->magic = SUPER_BLOCK_MAGIC;
+    sb->inode_size = DISK_INODE_SIZE;
+    sb->itable_group_sects = ITABLE_GROUP_SECTS;
+    sb->itable_uninit = 0;
+    sb->block_group_sects = 0;          // 挂载时重新统计块组空闲数
+    sb->block_size = SECTOR_SIZE;       // 旧分区一块就是一个扇区
+    sb->block_sects = 1;
+    sb->migrate_lba = 0;
+    memset(sb->pad, 0, sizeof(sb->pad));
+    ide_write(part->my_disk, part->start_lba + 1, sb, 1);
+    ide_flush(part->my_disk);
+
+    mfree_page(PF_KERNEL, old_table, DIV_ROUND_UP(old_bytes, PG_SIZE));
+    mfree_page(PF_KERNEL, new_table, DIV_ROUND_UP(new_sects * SECTOR_SIZE, PG_SIZE));
+    printk("%s migrate done\n", part->name);
+    return 0;
+}
+
+/* 把inode的全部块地址收集到all_blocks（INODE_BLOCKS_MAX项），没有的块为0，
+   内联的inode只有第0项，其值为INODE_INLINE_LBA */
+void inode_collect_blocks(struct partition *part, struct inode *inode, uint32_t *all_blocks)
+{
+    memset(all_blocks, 0, INODE_BLOCKS_MAX(part->sb) * sizeof(uint32_t));
+    if (inode->i_flags & INODE_INLINE)
+    {
+        all_blocks[0] = INODE_INLINE_LBA;
+        return;
+    }
+
+    memcpy(all_blocks, inode->i_sectors, 12 * sizeof(uint32_t));
+    if (inode->i_sectors[12] != 0) journal_read(part->my_disk, inode->i_sectors[12], all_blocks + 12, part->sb->block_sects);
+}
+
+/* 读取inode中地址为lba的块到buf，内联数据之后的部分填0 */
+void inode_block_read(struct partition *part, struct inode *inode, uint32_t lba, void *buf)
+{
+    if (lba == INODE_INLINE_LBA)
+    {
+        ASSERT(inode->i_flags & INODE_INLINE);
+        memset(buf, 0, part->sb->block_size);
+        memcpy(buf, inode->i_sectors, INODE_INLINE_SIZE);
+        return;
+    }
+    journal_read(part->my_disk, lba, buf, part->sb->block_sects);
+}
+
+/* 把buf写入inode中地址为lba的块，内联时只保存前INODE_INLINE_SIZE字节，由调用者同步inode */
+void inode_block_write(struct partition *part, struct inode *inode, uint32_t lba, void *buf)
+{
+    if (lba == INODE_INLINE_LBA)
+    {
+        ASSERT(inode->i_flags & INODE_INLINE);
+        memcpy(inode->i_sectors, buf, INODE_INLINE_SIZE);
+        return;
+    }
+    journal_write(part->my_disk, lba, buf, part->sb->block_sects);
+}
+
+/* 内联数据放不下时，为inode分配第一个数据块并把内联数据移过去，由调用者同步inode，
+   成功返回0，失败返回-1 */
+int32_t inode_inline_to_block(struct partition *part, struct inode *inode)
+{
+    ASSERT(inode->i_flags & INODE_INLINE);
+    int32_t block_lba = block_bitmap_alloc_near(part, block_goal_of_inode(part, inode->i_no));
+    if (block_lba == -1)
+    {
+        printk("inode_inline_to_block: block_bitmap_alloc failed\n");
+        return -1;
+    }
+    uint32_t bit_idx = block_bitmap_idx_of(part, block_lba);
+    bitmap_sync(part, bit_idx, BLOCK_BITMAP);
+
+    uint8_t *io_buf = sys_malloc(part->sb->block_size);
+    if (io_buf == NULL)
+    {
+        printk("inode_inline_to_block: sys_malloc for io_buf failed\n");
+        part_bitmap_set(part, BLOCK_BITMAP, bit_idx, 0);
+        bitmap_sync(part, bit_idx, BLOCK_BITMAP);
+        return -1;
+    }
+    inode_block_read(part, inode, INODE_INLINE_LBA, io_buf);
+    ide_write(part->my_disk, block_lba, io_buf, part->sb->block_sects);
+    sys_free(io_buf);
+
+    memset(inode->i_sectors, 0, sizeof(inode->i_sectors));
+    inode->i_sectors[0] = block_lba;
+    inode->i_flags &= ~INODE_INLINE;
+    return 0;
 }
 
 /* 回收inode的数据块和anode本身 */
@@ -191,28 +552,39 @@ void inode_release(struct partition *part, uint32_t inode_no)
     struct inode *inode_to_del = inode_open(part, inode_no);
     ASSERT(inode_to_del->i_no == inode_no);
 
-    /* 回收inode占用的所有块 */
-    uint8_t block_idx = 0, block_cnt = 12;
+    /* 回收inode占用的所有块，一级间接块表可能有上千项，不能放在栈上 */
+    uint32_t block_idx = 0, block_cnt = 12;
     uint32_t block_bitmap_idx;
-    uint32_t all_blocks[140] = {0, };
+    uint32_t *all_blocks = (uint32_t *)sys_malloc(INODE_BLOCKS_MAX(part->sb) * sizeof(uint32_t));
+    if (all_blocks == NULL) PANIC("inode_release: sys_malloc for all_blocks failed");
+    memset(all_blocks, 0, INODE_BLOCKS_MAX(part->sb) * sizeof(uint32_t));
 
-    /* 获取所有直接块LBA */
-    while (block_idx < 12)
+    /* 获取所有直接块LBA，内联的inode没有数据块 */
+    while (block_idx < 12 && !(inode_to_del->i_flags & INODE_INLINE))
     {
         all_blocks[block_idx] = inode_to_del->i_sectors[block_idx];
         block_idx++;
     }
 
-    /* 如果有一级间接块表则获取一级块表中所有项，并释放一级块表占用的扇区 */
-    if (inode_to_del->i_sectors[12] != 0)
+    /* 如果有一级间接块表则获取一级块表中所有项，并释放一级块表占用的块 */
+    if (inode_to_del->i_sectors[12] != 0 && !(inode_to_del->i_flags & INODE_INLINE))
     {
-        ide_read(part->my_disk, inode_to_del->i_sectors[12], all_blocks + 12, 1);
-        block_cnt = 140;
+        journal_read(part->my_disk, inode_to_del->i_sectors[12], all_blocks + 12, part->sb->block_sects);
+        block_cnt = INODE_BLOCKS_MAX(part->sb);
+
+        /* 回收一级块表占用的块 */
+        block_bitmap_idx = block_bitmap_idx_of(part, inode_to_del->i_sectors[12]);
+        ASSERT(block_bitmap_idx > 0);
+        part_bitmap_set(part, BLOCK_BITMAP, block_bitmap_idx, 0);
+        bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
+    }
 
-        /* 回收一级块表占用的扇区 */
-        block_bitmap_idx = inode_to_del->i_sectors[12] - part->sb->data_start_lba;
+    /* 回收压缩的文件的块表 */
+    if (inode_to_del->i_flags & INODE_COMPRESSED && inode_to_del->i_ctable != 0)
+    {
+        block_bitmap_idx = block_bitmap_idx_of(part, inode_to_del->i_ctable);
         ASSERT(block_bitmap_idx > 0);
-        bitmap_set(&part->block_bitmap, block_bitmap_idx, 0);
+        part_bitmap_set(part, BLOCK_BITMAP, block_bitmap_idx, 0);
         bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
     }
 
@@ -223,16 +595,17 @@ void inode_release(struct partition *part, uint32_t inode_no)
         if (all_blocks[block_idx] != 0)
         {
             block_bitmap_idx = 0;
-            block_bitmap_idx = all_blocks[block_idx] - part->sb->data_start_lba;
+            block_bitmap_idx = block_bitmap_idx_of(part, all_blocks[block_idx]);
             ASSERT(block_bitmap_idx > 0);
-            bitmap_set(&part->block_bitmap, block_bitmap_idx, 0);
+            part_bitmap_set(part, BLOCK_BITMAP, block_bitmap_idx, 0);
             bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
         }
         block_idx++;
     }
+    sys_free(all_blocks);
 
     /* 回收inode占用的inode项 */
-    bitmap_set(&part->inode_bitmap, inode_no, 0);
+    part_bitmap_set(part, INODE_BITMAP, inode_no, 0);
     bitmap_sync(cur_part, inode_no, INODE_BITMAP);
 
     void *io_buf = sys_malloc(1024);
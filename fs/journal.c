@@ -0,0 +1,425 @@
+#include "journal.h"
+#include "fs.h"
+#include "file.h"
+#include "super_block.h"
+#include "part_bitmap.h"
+#include "global.h"
+#include "debug.h"
+#include "memory.h"
+#include "string.h"
+#include "sync.h"
+#include "timer.h"
+#include "stdio_kern.h"
+#include "thread.h"
+#include "bitmap.h"
+
+/* 元数据（超级块、位图、inode表、目录块和间接块表）的写入先收集在内存中的事务里，
+   读取时用事务中的新内容覆盖硬盘上的旧内容。提交时把整个事务一次顺序写入日志区，
+   再按LBA顺序写回原位置，最后推进日志头中的序号。挂载时重放已提交但没有写回完的事务，
+   所以写回原位置的中途断电不会破坏文件系统，原位置也不必在每次修改时同步写入。
+   一个操作（journal_begin到journal_end之间）的修改总在同一个事务中，事务只在没有进行中的操作时提交。
+   文件数据不经过日志，总是在引用它的元数据提交之前写入硬盘 */
+
+#define JOURNAL_BUF_PAGES   DIV_ROUND_UP((JOURNAL_TXN_SECS + 2) * SECTOR_SIZE, PG_SIZE)
+
+static struct partition *journal_part;      // 启用日志的分区，NULL表示还没有启用
+static uint32_t journal_seq;                // 正在收集的事务的序号
+static uint8_t *txn_buf;                    // 描述扇区、元数据扇区、提交扇区在内存中的排列与日志区中相同
+static struct journal_desc *txn_desc;       // 即txn_buf的第0个扇区
+static uint32_t txn_cap;                    // 一个事务最多记录的元数据扇区数，由日志区的大小决定
+static uint32_t txn_ticks;                  // 事务中第一个扇区加入时的ticks
+static uint32_t txn_handles;                // 进行中的操作数，为0时才能提交
+static int txn_locked;                      // 事务等待提交，不再开始新的操作
+static uint32_t txn_waiters;                // 等待事务提交或操作结束的线程数
+static struct semaphore txn_wait;           // 事务提交或有操作结束时唤醒等待的线程
+static struct bitmap txn_freed;             // 当前事务中释放的块，事务提交之前不能重新分配
+static uint32_t txn_freed_cnt;              // txn_freed中置位的个数
+static struct lock journal_lock;            // 保护事务，提交期间读写硬盘会切换任务
+static struct journal_header journal_hdr;   // 日志头扇区的缓冲区
+
+/* 事务中第slot个元数据扇区在txn_buf中的地址 */
+static uint8_t *txn_sec(uint32_t slot)
+{
+    return txn_buf + (slot + 1) * SECTOR_SIZE;
+}
+
+/* 计算buf中sec_cnt个扇区的校验和 */
+static uint32_t journal_checksum(const void *buf, uint32_t sec_cnt)
+{
+    const uint32_t *word = buf;
+    uint32_t word_cnt = sec_cnt * SECTOR_SIZE / 4;
+    uint32_t sum = 0;
+    while (word_cnt-- > 0) sum = ((sum << 1) | (sum >> 31)) + *word++;
+    return sum;
+}
+
+/* 把日志头中的序号更新为seq */
+static void journal_header_write(struct partition *part, uint32_t seq)
+{
+    memset(&journal_hdr, 0, sizeof(journal_hdr));
+    journal_hdr.magic = JOURNAL_MAGIC;
+    journal_hdr.seq = seq;
+    ide_write(part->my_disk, part->sb->journal_lba, &journal_hdr, 1);
+}
+
+/* 按LBA从小到大把desc描述的sectors中的元数据扇区写回原位置 */
+static void journal_checkpoint(struct disk *hd, const struct journal_desc *desc, uint8_t *sectors)
+{
+    uint8_t done[JOURNAL_TXN_SECS];
+    memset(done, 0, sizeof(done));
+    uint32_t written = 0;
+    while (written < desc->count)
+    {
+        uint32_t first = 0xffffffff, slot = 0;
+        while (slot < desc->count)
+        {
+            if (!done[slot] && (first == 0xffffffff || desc->lbas[slot] < desc->lbas[first])) first = slot;
+            slot++;
+        }
+        ide_write(hd, desc->lbas[first], sectors + first * SECTOR_SIZE, 1);
+        done[first] = 1;
+        written++;
+    }
+}
+
+/* 把txn_buf中cnt个元数据扇区的事务写入日志区，再写回原位置，调用者需持有journal_lock */
+static void journal_commit_txn(uint32_t cnt)
+{
+    struct disk *hd = journal_part->my_disk;
+
+    txn_desc->magic = JOURNAL_DESC_MAGIC;
+    txn_desc->seq = journal_seq;
+    struct journal_commit *commit = (struct journal_commit *)txn_sec(cnt);
+    memset(commit, 0, SECTOR_SIZE);
+    commit->magic = JOURNAL_COMMIT_MAGIC;
+    commit->seq = journal_seq;
+    commit->count = cnt;
+    commit->checksum = journal_checksum(txn_buf, cnt + 1);
+
+    /* 描述扇区、元数据扇区和提交扇区一次顺序写入日志区，落盘后事务即已提交 */
+    ide_write(hd, journal_part->sb->journal_lba + 1, txn_buf, cnt + 2);
+    ide_flush(hd);
+
+    journal_checkpoint(hd, txn_desc, txn_sec(0));
+    ide_flush(hd);
+
+    /* 原位置都写好了，推进序号使日志区中的事务失效 */
+    journal_seq++;
+    journal_header_write(journal_part, journal_seq);
+    txn_desc->count = 0;
+}
+
+/* 唤醒所有等待事务提交或操作结束的线程，调用者需持有journal_lock */
+static void txn_wake_all(void)
+{
+    while (txn_waiters > 0)
+    {
+        txn_waiters--;
+        sema_up(&txn_wait);
+    }
+}
+
+/* 释放journal_lock，睡眠到事务提交或有操作结束后重新持有锁，调用者需持有journal_lock且不在操作中 */
+static void txn_wait_change(void)
+{
+    txn_waiters++;
+    lock_release(&journal_lock);
+    sema_down(&txn_wait);
+    lock_acquire(&journal_lock);
+}
+
+/* 当前事务能否再开始一个操作，每个进行中的操作和不在操作中的写回都要留有空间，调用者需持有journal_lock */
+static int txn_has_room(void)
+{
+    return txn_desc->count + (txn_handles + 1) * JOURNAL_HANDLE_SECS + JOURNAL_RESERVE_SECS <= txn_cap;
+}
+
+/* 提交当前事务，只能在没有进行中的操作时调用，调用者需持有journal_lock */
+static void journal_commit(void)
+{
+    ASSERT(txn_handles == 0);
+    uint32_t cnt = txn_desc->count;
+    if (cnt > 0) journal_commit_txn(cnt);
+
+    /* 释放块的位图已经落盘，这些块可以重新分配了 */
+    if (txn_freed_cnt > 0)
+    {
+        memset(txn_freed.bits, 0, txn_freed.btmp_bytes_len);
+        txn_freed_cnt = 0;
+    }
+    txn_locked = 0;
+    txn_wake_all();
+}
+
+/* 挂载分区时重放日志区中已提交但可能没有写回原位置的事务，在读取其它元数据之前调用，
+   重放了事务返回1，此时调用者需要重新读入超级块，否则返回0 */
+int journal_replay(struct partition *part)
+{
+    struct super_block *sb = part->sb;
+    if (sb->journal_sects == 0) return 0;
+
+    struct disk *hd = part->my_disk;
+    ide_read(hd, sb->journal_lba, &journal_hdr, 1);
+    if (journal_hdr.magic != JOURNAL_MAGIC) return 0;
+    uint32_t seq = journal_hdr.seq;
+
+    uint8_t *buf = get_kernel_pages(JOURNAL_BUF_PAGES);
+    if (buf == NULL) PANIC("journal_replay: get_kernel_pages failed");
+
+    int replayed = 0;
+    struct journal_desc *desc = (struct journal_desc *)buf;
+    ide_read(hd, sb->journal_lba + 1, desc, 1);
+    if (desc->magic == JOURNAL_DESC_MAGIC && desc->seq == seq && desc->count > 0 && \
+        desc->count <= JOURNAL_TXN_SECS && desc->count + 3 <= sb->journal_sects)
+    {
+        ide_read(hd, sb->journal_lba + 2, buf + SECTOR_SIZE, desc->count + 1);
+        struct journal_commit *commit = (struct journal_commit *)(buf + (desc->count + 1) * SECTOR_SIZE);
+
+        /* 提交扇区不完整的事务没有提交，原位置也还没有被它修改过，直接丢弃 */
+        if (commit->magic == JOURNAL_COMMIT_MAGIC && commit->seq == seq && commit->count == desc->count && \
+            commit->checksum == journal_checksum(buf, desc->count + 1))
+        {
+            journal_checkpoint(hd, desc, buf + SECTOR_SIZE);
+            ide_flush(hd);
+            journal_header_write(part, seq + 1);
+            printk("%s: replayed journal transaction %d, %d sectors\n", part->name, seq, desc->count);
+            replayed = 1;
+        }
+    }
+    mfree_page(PF_KERNEL, buf, JOURNAL_BUF_PAGES);
+    return replayed;
+}
+
+/* 为part启用日志，没有日志区的分区先从数据区分配一段连续的块作为日志区 */
+void journal_mount(struct partition *part)
+{
+    struct super_block *sb = part->sb;
+    if (sb->journal_sects == 0)
+    {
+        uint32_t blk_cnt = DIV_ROUND_UP(JOURNAL_SECTS, sb->block_sects);
+        int32_t bit_idx = part_bitmap_find_next_zero_run(part, BLOCK_BITMAP, 0, blk_cnt);
+        if (bit_idx == -1)
+        {
+            printk("journal_mount: no space for journal on %s, metadata is written in place\n", part->name);
+            return;
+        }
+        uint32_t blk_idx = 0;
+        while (blk_idx < blk_cnt) part_bitmap_set(part, BLOCK_BITMAP, bit_idx + blk_idx++, 1);
+        bitmap_sync_range(part, bit_idx, bit_idx + blk_cnt - 1, BLOCK_BITMAP);
+
+        sb->journal_lba = block_lba_of(part, bit_idx);
+        sb->journal_sects = blk_cnt * sb->block_sects;
+        journal_header_write(part, 1);
+        super_block_sync(part);
+        printk("%s: created journal at lba 0x%x\n", part->name, sb->journal_lba);
+    }
+
+    ide_read(part->my_disk, sb->journal_lba, &journal_hdr, 1);
+    ASSERT(journal_hdr.magic == JOURNAL_MAGIC);
+    journal_seq = journal_hdr.seq;
+
+    /* 较早创建的日志区可能比JOURNAL_SECTS小 */
+    txn_cap = sb->journal_sects - 3;
+    if (txn_cap > JOURNAL_TXN_SECS) txn_cap = JOURNAL_TXN_SECS;
+    ASSERT(txn_cap >= JOURNAL_HANDLE_SECS + JOURNAL_RESERVE_SECS);
+
+    txn_buf = get_kernel_pages(JOURNAL_BUF_PAGES);
+    txn_freed.btmp_bytes_len = part->block_bitmap.bits_len / 8;
+    txn_freed.bits = get_kernel_pages(DIV_ROUND_UP(txn_freed.btmp_bytes_len, PG_SIZE));
+    if (txn_buf == NULL || txn_freed.bits == NULL) PANIC("journal_mount: get_kernel_pages failed");
+    txn_desc = (struct journal_desc *)txn_buf;
+    txn_desc->count = 0;
+    txn_handles = 0;
+    txn_locked = 0;
+    txn_waiters = 0;
+    txn_freed_cnt = 0;
+    sema_init(&txn_wait, 0);
+    lock_init(&journal_lock);
+    journal_part = part;
+}
+
+/* 开始一个修改元数据的操作，在journal_end之前事务不会提交，可以嵌套。
+   事务等待提交或放不下这个操作时先睡眠，所以调用者不能持有进行中的操作可能需要的锁 */
+void journal_begin(void)
+{
+    if (journal_part == NULL) return;
+    /* 嵌套的操作算作最外层操作的一部分 */
+    struct task_struct *cur = running_thread();
+    if (cur->journal_depth++ > 0) return;
+
+    lock_acquire(&journal_lock);
+    while (txn_locked || !txn_has_room())
+    {
+        /* 没有进行中的操作，直接提交腾出空间 */
+        if (txn_handles == 0)
+        {
+            journal_commit();
+            continue;
+        }
+        /* 进行中的操作都结束后也放不下时，不再开始新的操作，由最后结束的操作提交 */
+        if (txn_desc->count + JOURNAL_HANDLE_SECS + JOURNAL_RESERVE_SECS > txn_cap) txn_locked = 1;
+        txn_wait_change();
+    }
+    txn_handles++;
+    lock_release(&journal_lock);
+}
+
+/* 结束一个操作，最后一个进行中的操作结束时，提交等待提交或已经较大的事务，多个操作的修改合并为一次提交 */
+void journal_end(void)
+{
+    if (journal_part == NULL) return;
+    struct task_struct *cur = running_thread();
+    ASSERT(cur->journal_depth > 0);
+    if (--cur->journal_depth > 0) return;
+
+    lock_acquire(&journal_lock);
+    ASSERT(txn_handles > 0);
+    txn_handles--;
+    if (txn_handles == 0 && (txn_locked || txn_desc->count >= txn_cap / 2)) journal_commit();
+    /* 操作预留的空间还给事务，等待开始操作的线程重新检查 */
+    else txn_wake_all();
+    lock_release(&journal_lock);
+}
+
+/* [lba, lba + sec_cnt)是否在启用日志的分区内 */
+static int journal_covers(struct disk *hd, uint32_t lba, uint32_t sec_cnt)
+{
+    return journal_part != NULL && hd == journal_part->my_disk && \
+           lba >= journal_part->start_lba && lba + sec_cnt <= journal_part->start_lba + journal_part->sec_cnt;
+}
+
+/* 查找事务中lba扇区的位置，没有返回-1，调用者需持有journal_lock */
+static int32_t txn_slot_of(uint32_t lba)
+{
+    uint32_t slot = 0;
+    while (slot < txn_desc->count)
+    {
+        if (txn_desc->lbas[slot] == lba) return slot;
+        slot++;
+    }
+    return -1;
+}
+
+/* 写入元数据，参数同ide_write。修改进入当前事务，由提交写入硬盘 */
+void journal_write(struct disk *hd, uint32_t lba, void *buf, uint32_t sec_cnt)
+{
+    if (!journal_covers(hd, lba, sec_cnt))
+    {
+        ide_write(hd, lba, buf, sec_cnt);
+        return;
+    }
+
+    lock_acquire(&journal_lock);
+    uint32_t sec_idx = 0;
+    while (sec_idx < sec_cnt)
+    {
+        int32_t slot = txn_slot_of(lba + sec_idx);
+        if (slot == -1)
+        {
+            if (txn_desc->count == txn_cap)
+            {
+                /* 每个操作都预留了空间，事务满了说明有操作修改的扇区超过了JOURNAL_HANDLE_SECS，
+                   此时提交会把操作拆到两个事务中 */
+                if (txn_handles > 0) PANIC("journal_write: transaction overflow");
+                journal_commit();
+            }
+            if (txn_desc->count == 0) txn_ticks = ticks;
+            slot = txn_desc->count++;
+            txn_desc->lbas[slot] = lba + sec_idx;
+        }
+        memcpy(txn_sec(slot), (uint8_t *)buf + sec_idx * SECTOR_SIZE, SECTOR_SIZE);
+        sec_idx++;
+    }
+    lock_release(&journal_lock);
+}
+
+/* 读取元数据，参数同ide_read。事务中有更新的扇区以事务中的内容为准 */
+void journal_read(struct disk *hd, uint32_t lba, void *buf, uint32_t sec_cnt)
+{
+    if (!journal_covers(hd, lba, sec_cnt))
+    {
+        ide_read(hd, lba, buf, sec_cnt);
+        return;
+    }
+
+    /* 读盘期间持有锁，防止事务在读完之前提交 */
+    lock_acquire(&journal_lock);
+    ide_read(hd, lba, buf, sec_cnt);
+    uint32_t slot = 0;
+    while (slot < txn_desc->count)
+    {
+        uint32_t slot_lba = txn_desc->lbas[slot];
+        if (slot_lba >= lba && slot_lba < lba + sec_cnt)
+            memcpy((uint8_t *)buf + (slot_lba - lba) * SECTOR_SIZE, txn_sec(slot), SECTOR_SIZE);
+        slot++;
+    }
+    lock_release(&journal_lock);
+}
+
+/* 块被释放时调用。块是元数据块时从事务中撤销它的扇区，否则提交时会用旧的元数据覆盖块的新内容。
+   块在事务提交前都不能重新分配，否则新内容直接写入硬盘后断电，旧的元数据仍然引用这个块 */
+void journal_forget(uint32_t lba, uint32_t sec_cnt)
+{
+    if (journal_part == NULL) return;
+    lock_acquire(&journal_lock);
+    uint32_t bit_idx = block_bitmap_idx_of(journal_part, lba);
+    if (!bitmap_scan_test(&txn_freed, bit_idx))
+    {
+        bitmap_set(&txn_freed, bit_idx, 1);
+        txn_freed_cnt++;
+    }
+
+    uint32_t slot = 0;
+    while (slot < txn_desc->count)
+    {
+        uint32_t slot_lba = txn_desc->lbas[slot];
+        if (slot_lba >= lba && slot_lba < lba + sec_cnt)
+        {
+            /* 用最后一个扇区填补空位 */
+            uint32_t last = --txn_desc->count;
+            txn_desc->lbas[slot] = txn_desc->lbas[last];
+            memcpy(txn_sec(slot), txn_sec(last), SECTOR_SIZE);
+            continue;
+        }
+        slot++;
+    }
+    lock_release(&journal_lock);
+}
+
+/* 块bit_idx是否在当前事务中被释放，这样的块在事务提交前不能分配 */
+int journal_block_freed(uint32_t bit_idx)
+{
+    return txn_freed_cnt > 0 && bitmap_scan_test(&txn_freed, bit_idx);
+}
+
+/* 正在收集的事务的序号，此时写入的元数据在这个事务中 */
+uint32_t journal_txn_seq(void)
+{
+    return journal_seq;
+}
+
+/* part上在序号为seq的事务中写入的元数据是否已经提交，没有启用日志的分区元数据直接写入硬盘 */
+int journal_committed(struct partition *part, uint32_t seq)
+{
+    return part != journal_part || seq != journal_seq;
+}
+
+/* 提交当前事务，only_expired为1时只在没有进行中的操作且事务停留超过DIRTY_EXPIRE_TICKS时提交，
+   为0时不再开始新的操作，等进行中的操作都结束后提交，返回时事务已经提交，调用者不能在操作中 */
+void journal_flush(int only_expired)
+{
+    if (journal_part == NULL) return;
+    lock_acquire(&journal_lock);
+    if (only_expired)
+    {
+        if (txn_handles == 0 && ticks - txn_ticks >= DIRTY_EXPIRE_TICKS) journal_commit();
+    }
+    else if (txn_handles == 0) journal_commit();
+    else
+    {
+        ASSERT(running_thread()->journal_depth == 0);
+        txn_locked = 1;
+        while (txn_locked) txn_wait_change();
+    }
+    lock_release(&journal_lock);
+}
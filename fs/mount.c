@@ -0,0 +1,48 @@
+#include "mount.h"
+#include "inode.h"
+#include "global.h"
+#include "debug.h"
+#include "stdio_kern.h"
+
+static struct mount mount_table[MAX_MOUNTS];
+
+/* 把根目录为root的文件系统挂载到硬盘分区上inode号为mnt_ino的目录，成功返回0，失败返回-1 */
+int32_t mount_add(uint32_t mnt_ino, struct inode *root)
+{
+    ASSERT(mount_find(mnt_ino) == NULL);
+    uint32_t idx = 0;
+    while (idx < MAX_MOUNTS && mount_table[idx].root != NULL) idx++;
+    if (idx == MAX_MOUNTS)
+    {
+        printk("mount_add: mount table is full\n");
+        return -1;
+    }
+    mount_table[idx].mnt_ino = mnt_ino;
+    mount_table[idx].root = root;
+    return 0;
+}
+
+/* 返回挂载在目录mnt_ino上的文件系统的根目录，不是挂载点时返回NULL */
+struct inode *mount_find(uint32_t mnt_ino)
+{
+    uint32_t idx = 0;
+    while (idx < MAX_MOUNTS)
+    {
+        if (mount_table[idx].root != NULL && mount_table[idx].mnt_ino == mnt_ino) return mount_table[idx].root;
+        idx++;
+    }
+    return NULL;
+}
+
+/* 返回根目录为root的文件系统的挂载点目录的inode号 */
+uint32_t mount_point(struct inode *root)
+{
+    uint32_t idx = 0;
+    while (idx < MAX_MOUNTS)
+    {
+        if (mount_table[idx].root == root) return mount_table[idx].mnt_ino;
+        idx++;
+    }
+    PANIC("mount_point: not a mounted root");
+    return 0;
+}
@@ -0,0 +1,274 @@
+#include "page_cache.h"
+#include "inode.h"
+#include "file.h"
+#include "fs.h"
+#include "super_block.h"
+#include "global.h"
+#include "debug.h"
+#include "memory.h"
+#include "string.h"
+#include "thread.h"
+#include "sync.h"
+#include "stdio_kern.h"
+#include "interrupt.h"
+#include "timer.h"
+#include "compress.h"
+
+/* 保护所有inode的页缓存链表和页的内容，读入页时会等待硬盘 */
+static struct lock page_cache_lock;
+
+/* 初始化页缓存 */
+void page_cache_init(void)
+{
+    lock_init(&page_cache_lock);
+}
+
+/* 在inode的页缓存中查找第pg_idx页，没有时返回NULL */
+struct cache_page *page_cache_lookup(struct inode *inode, uint32_t pg_idx)
+{
+    struct list_elem *elem = inode->i_pages.head.next;
+    while (elem != &inode->i_pages.tail)
+    {
+        struct cache_page *pg = elem2entry(struct cache_page, page_tag, elem);
+        if (pg->pg_idx == pg_idx) return pg;
+        elem = elem->next;
+    }
+    return NULL;
+}
+
+/* 对inode第pg_idx页中文件末尾之前的块，把LBA连续的块合并后调用io读写，
+   io为ide_read或ide_write，返回页中有效数据的字节数 */
+static uint32_t page_blocks_io(struct inode *inode, uint32_t pg_idx, uint8_t *kvaddr,
+                               void (*io)(struct disk *, uint32_t, void *, uint32_t))
+{
+    uint32_t pos = pg_idx * PG_SIZE;
+    if (pos >= inode->i_size) return 0;
+    uint32_t len = inode->i_size - pos < PG_SIZE ? inode->i_size - pos : PG_SIZE;
+
+    uint32_t block_size = cur_part->sb->block_size;
+    uint32_t block_sects = cur_part->sb->block_sects;
+    uint32_t *all_blocks = (uint32_t *)sys_malloc(INODE_BLOCKS_MAX(cur_part->sb) * sizeof(uint32_t));
+    if (all_blocks == NULL) PANIC("page_blocks_io: sys_malloc for all_blocks failed");
+    inode_collect_blocks(cur_part, inode, all_blocks);
+
+    /* 块的大小能整除页的大小，页中的块不会跨页 */
+    uint32_t blk_idx = pos / block_size;
+    uint32_t blk_end = blk_idx + DIV_ROUND_UP(len, block_size);
+    while (blk_idx < blk_end)
+    {
+        uint32_t blk_lba = all_blocks[blk_idx];
+        uint32_t blk_cnt = 1;
+        if (blk_lba != 0)
+        {
+            while (blk_idx + blk_cnt < blk_end && all_blocks[blk_idx + blk_cnt] == blk_lba + blk_cnt * block_sects) blk_cnt++;
+            io(cur_part->my_disk, blk_lba, kvaddr + (blk_idx * block_size - pos), blk_cnt * block_sects);
+        }
+        blk_idx += blk_cnt;
+    }
+    sys_free(all_blocks);
+    return len;
+}
+
+/* 读入inode第pg_idx页的数据到kvaddr，文件末尾之后填0 */
+static void page_fill(struct inode *inode, uint32_t pg_idx, uint8_t *kvaddr)
+{
+    memset(kvaddr, 0, PG_SIZE);
+    uint32_t len;
+    if (inode->i_flags & INODE_INLINE)
+    {
+        /* 内联的文件只有第0页 */
+        len = pg_idx == 0 ? inode->i_size : 0;
+        memcpy(kvaddr, inode->i_sectors, len);
+    }
+    else if (inode->i_flags & INODE_TMPFS)
+    {
+        /* tmpfs的页就是文件的数据，不在缓存中的页还没有写入过 */
+        len = 0;
+    }
+    else if (inode->i_flags & INODE_COMPRESSED)
+    {
+        /* 压缩的文件一页正好是一块，数据损坏时读出0 */
+        int32_t ret = compress_read_chunk(inode, pg_idx, kvaddr);
+        len = ret == -1 ? 0 : ret;
+    }
+    else
+    {
+        len = page_blocks_io(inode, pg_idx, kvaddr, ide_read);
+    }
+    /* 最后一块中文件末尾之后的内容无效 */
+    memset(kvaddr + len, 0, PG_SIZE - len);
+}
+
+/* 把页pg中文件末尾之前的数据写回硬盘，不会扩大文件 */
+static void page_flush(struct inode *inode, struct cache_page *pg)
+{
+    /* 压缩的文件不允许可写的映射，页不会被修改 */
+    ASSERT(!(inode->i_flags & INODE_COMPRESSED));
+    /* tmpfs的页没有对应的硬盘块 */
+    if (inode->i_flags & INODE_TMPFS) return;
+    if (inode->i_flags & INODE_INLINE)
+    {
+        if (pg->pg_idx != 0) return;
+        memcpy(inode->i_sectors, pg->kvaddr, inode->i_size);
+        inode_sync(cur_part, inode, NULL);
+        return;
+    }
+    page_blocks_io(inode, pg->pg_idx, pg->kvaddr, ide_write);
+}
+
+/* 获取inode第pg_idx页，不在缓存中时从硬盘读入，失败返回NULL */
+struct cache_page *page_cache_get(struct inode *inode, uint32_t pg_idx)
+{
+    /* 还在延迟分配缓冲区中的数据先写入硬盘，要在持有page_cache_lock之前，
+       否则和写文件时的加锁顺序相反 */
+    inode_flush_dalloc(inode);
+
+    lock_acquire(&page_cache_lock);
+    struct cache_page *pg = page_cache_lookup(inode, pg_idx);
+    if (pg != NULL)
+    {
+        lock_release(&page_cache_lock);
+        return pg;
+    }
+
+    /* 页缓存被所有进程共享，描述符和页都要在内核空间中分配 */
+    struct task_struct *cur = running_thread();
+    uint32_t *cur_pagedir_bak = cur->pgdir;
+    cur->pgdir = NULL;
+    pg = (struct cache_page *)sys_malloc(sizeof(struct cache_page));
+    cur->pgdir = cur_pagedir_bak;
+    if (pg == NULL)
+    {
+        lock_release(&page_cache_lock);
+        return NULL;
+    }
+    pg->kvaddr = get_kernel_pages(1);
+    if (pg->kvaddr == NULL)
+    {
+        cur->pgdir = NULL;
+        sys_free(pg);
+        cur->pgdir = cur_pagedir_bak;
+        lock_release(&page_cache_lock);
+        return NULL;
+    }
+
+    pg->pg_idx = pg_idx;
+    pg->map_cnt = 0;
+    pg->dirty = 0;
+    pg->dirty_ticks = 0;
+    page_fill(inode, pg_idx, pg->kvaddr);
+    list_append(&inode->i_pages, &pg->page_tag);
+    lock_release(&page_cache_lock);
+    return pg;
+}
+
+/* 文件位置pos所在的页在缓存中时，从页中复制count个字节到buf，成功返回0，
+   不在缓存中返回-1，由调用者读硬盘。[pos, pos + count)不能跨页 */
+int32_t page_cache_read(struct inode *inode, uint32_t pos, void *buf, uint32_t count)
+{
+    ASSERT(pos % PG_SIZE + count <= PG_SIZE);
+    int32_t ret = -1;
+    lock_acquire(&page_cache_lock);
+    struct cache_page *pg = page_cache_lookup(inode, pos / PG_SIZE);
+    if (pg != NULL)
+    {
+        memcpy(buf, pg->kvaddr + pos % PG_SIZE, count);
+        ret = 0;
+    }
+    lock_release(&page_cache_lock);
+    return ret;
+}
+
+/* 向文件写入数据时，把写入[pos, pos + count)的数据同步到已缓存的页中 */
+void page_cache_update(struct inode *inode, uint32_t pos, const void *buf, uint32_t count)
+{
+    if (list_empty(&inode->i_pages)) return;
+
+    lock_acquire(&page_cache_lock);
+    const uint8_t *src = buf;
+    while (count > 0)
+    {
+        uint32_t pg_off = pos % PG_SIZE;
+        uint32_t chunk = PG_SIZE - pg_off < count ? PG_SIZE - pg_off : count;
+        struct cache_page *pg = page_cache_lookup(inode, pos / PG_SIZE);
+        if (pg != NULL) memcpy(pg->kvaddr + pg_off, src, chunk);
+        src += chunk;
+        pos += chunk;
+        count -= chunk;
+    }
+    lock_release(&page_cache_lock);
+}
+
+/* 把inode所有可能被修改过的页按页号从小到大写回硬盘，文件的块大多连续分配，这也是LBA的顺序，
+   only_expired为1时只写回修改后停留超过DIRTY_EXPIRE_TICKS的页 */
+void page_cache_writeback(struct inode *inode, int only_expired)
+{
+    lock_acquire(&page_cache_lock);
+    uint32_t next_idx = 0;
+    while (1)
+    {
+        struct cache_page *first = NULL;
+        struct list_elem *elem = inode->i_pages.head.next;
+        while (elem != &inode->i_pages.tail)
+        {
+            struct cache_page *pg = elem2entry(struct cache_page, page_tag, elem);
+            if (pg->dirty && pg->pg_idx >= next_idx && (!only_expired || ticks - pg->dirty_ticks >= DIRTY_EXPIRE_TICKS) && \
+                (first == NULL || pg->pg_idx < first->pg_idx)) first = pg;
+            elem = elem->next;
+        }
+        if (first == NULL) break;
+
+        page_flush(inode, first);
+        /* 仍有映射的页之后还可能被修改，保留dirty标记并重新计时 */
+        if (first->map_cnt == 0) first->dirty = 0;
+        else first->dirty_ticks = ticks;
+        next_idx = first->pg_idx + 1;
+    }
+    lock_release(&page_cache_lock);
+}
+
+/* 按inode号从小到大写回当前分区所有打开的inode中修改过的页，only_expired的含义同page_cache_writeback */
+void page_cache_flush_all(int only_expired)
+{
+    uint32_t next_no = 0;
+    while (1)
+    {
+        /* 写回时会睡眠，挑出下一个inode后增加其打开次数，防止期间被关闭释放 */
+        struct inode *inode = NULL;
+        enum intr_status old_status = intr_disable();
+        struct list_elem *elem = cur_part->open_inodes.head.next;
+        while (elem != &cur_part->open_inodes.tail)
+        {
+            struct inode *open_inode = elem2entry(struct inode, inode_tag, elem);
+            if (open_inode->i_no >= next_no && !list_empty(&open_inode->i_pages) && \
+                (inode == NULL || open_inode->i_no < inode->i_no)) inode = open_inode;
+            elem = elem->next;
+        }
+        if (inode != NULL) inode->i_open_cnts++;
+        intr_set_status(old_status);
+        if (inode == NULL) break;
+
+        page_cache_writeback(inode, only_expired);
+        next_no = inode->i_no + 1;
+        inode_close(inode);
+    }
+}
+
+/* inode最后一次关闭时调用，写回修改过的页并释放inode的全部页缓存 */
+void page_cache_release(struct inode *inode)
+{
+    lock_acquire(&page_cache_lock);
+    struct task_struct *cur = running_thread();
+    uint32_t *cur_pagedir_bak = cur->pgdir;
+    while (!list_empty(&inode->i_pages))
+    {
+        struct cache_page *pg = elem2entry(struct cache_page, page_tag, list_pop(&inode->i_pages));
+        ASSERT(pg->map_cnt == 0);
+        if (pg->dirty) page_flush(inode, pg);
+        mfree_page(PF_KERNEL, pg->kvaddr, 1);
+        cur->pgdir = NULL;
+        sys_free(pg);
+        cur->pgdir = cur_pagedir_bak;
+    }
+    lock_release(&page_cache_lock);
+}
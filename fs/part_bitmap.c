@@ -0,0 +1,348 @@
+#include "part_bitmap.h"
+#include "fs.h"
+#include "file.h"
+#include "super_block.h"
+#include "ide.h"
+#include "bitmap.h"
+#include "global.h"
+#include "debug.h"
+#include "string.h"
+#include "sync.h"
+#include "journal.h"
+
+/* 块位图和inode位图不再整体读入内存，访问哪个扇区就把哪个扇区读进缓存，
+   块位图按块组在超级块中记录空闲块数，查找空闲块时直接跳过已满的块组，
+   超级块中还记录了空闲块和空闲inode的总数，分区满时分配直接失败 */
+
+#define BITMAP_CACHE_SECS   8           // 缓存的位图扇区数
+
+/* 位图扇区缓存，修改后先留在缓存中，bitmap_sync或被换出时写回 */
+struct bitmap_sec
+{
+    struct disk *hd;            // 扇区所在的硬盘，NULL表示空闲
+    uint32_t lba;               // 扇区地址
+    int dirty;                  // 有修改还未写回
+    uint32_t last_use;          // 最近一次访问的时间，用于换出最久没用的扇区
+    uint8_t data[SECTOR_SIZE];
+};
+
+static struct bitmap_sec bitmap_cache[BITMAP_CACHE_SECS];
+static uint32_t bitmap_cache_clock;         // 每访问一次缓存加1
+static struct lock bitmap_lock;             // 保护缓存和位图，读写扇区期间可能切换任务
+
+/* 初始化位图扇区缓存 */
+void part_bitmap_cache_init(void)
+{
+    memset(bitmap_cache, 0, sizeof(bitmap_cache));
+    bitmap_cache_clock = 0;
+    lock_init(&bitmap_lock);
+}
+
+static struct part_bitmap *part_bitmap_of(struct partition *part, uint8_t btmp_type)
+{
+    return btmp_type == INODE_BITMAP ? &part->inode_bitmap : &part->block_bitmap;
+}
+
+/* 返回超级块中位图对应的空闲总数 */
+static uint32_t part_bitmap_free_get(struct partition *part, uint8_t btmp_type)
+{
+    return btmp_type == INODE_BITMAP ? part->sb->free_inodes : part->sb->free_blocks;
+}
+
+/* 把超级块中位图对应的空闲总数加上delta */
+static void part_bitmap_free_add(struct partition *part, uint8_t btmp_type, int32_t delta)
+{
+    if (btmp_type == INODE_BITMAP) part->sb->free_inodes += delta;
+    else part->sb->free_blocks += delta;
+}
+
+/* 返回位图pbm第sec_idx个扇区的缓存，不在缓存中时换出最久没用的扇区后读入，调用者需持有bitmap_lock */
+static struct bitmap_sec *bitmap_sec_get(struct partition *part, struct part_bitmap *pbm, uint32_t sec_idx)
+{
+    ASSERT(sec_idx < pbm->sects);
+    uint32_t lba = pbm->lba + sec_idx;
+    struct bitmap_sec *victim = &bitmap_cache[0];
+    uint32_t idx = 0;
+    while (idx < BITMAP_CACHE_SECS)
+    {
+        struct bitmap_sec *sec = &bitmap_cache[idx];
+        if (sec->hd == part->my_disk && sec->lba == lba)
+        {
+            sec->last_use = ++bitmap_cache_clock;
+            return sec;
+        }
+        if (victim->hd != NULL && (sec->hd == NULL || sec->last_use < victim->last_use)) victim = sec;
+        idx++;
+    }
+
+    /* 被换出的扇区有修改时先写回 */
+    if (victim->hd != NULL && victim->dirty) journal_write(victim->hd, victim->lba, victim->data, 1);
+    victim->hd = NULL;
+    journal_read(part->my_disk, lba, victim->data, 1);
+    victim->hd = part->my_disk;
+    victim->lba = lba;
+    victim->dirty = 0;
+    victim->last_use = ++bitmap_cache_clock;
+    return victim;
+}
+
+/* 把缓存的扇区包装成只有一个扇区的struct bitmap，以便使用位图的查找函数 */
+static void bitmap_sec_view(struct bitmap_sec *sec, struct bitmap *btmp)
+{
+    btmp->btmp_bytes_len = SECTOR_SIZE;
+    btmp->bits = sec->data;
+    btmp->hint = 0;
+}
+
+/* 返回块位图第sec_idx个扇区所属块组的空闲块数 */
+static uint32_t block_group_free_get(struct partition *part, uint32_t sec_idx)
+{
+    return part->sb->block_group_free[sec_idx / part->sb->block_group_sects];
+}
+
+/* 把块位图第sec_idx个扇区所属块组的空闲块数加上delta，超级块是packed的，不能取成员的地址 */
+static void block_group_free_add(struct partition *part, uint32_t sec_idx, int32_t delta)
+{
+    part->sb->block_group_free[sec_idx / part->sb->block_group_sects] += delta;
+}
+
+/* 挂载分区时初始化分区的两个位图，只读超级块和一个扇区的inode位图，不读块位图。
+   旧分区的超级块中没有块组空闲数，此时逐扇区统计一次并写回超级块 */
+void part_bitmap_mount(struct partition *part)
+{
+    struct super_block *sb = part->sb;
+    part->block_bitmap.lba = sb->block_bitmap_lba;
+    part->block_bitmap.sects = sb->block_bitmap_sects;
+    part->block_bitmap.bits_len = sb->block_bitmap_sects * BITS_PER_SECTOR;
+    part->block_bitmap.hint = 0;
+    part->block_bitmap.summary_dirty = 0;
+
+    part->inode_bitmap.lba = sb->inode_bitmap_lba;
+    part->inode_bitmap.sects = sb->inode_bitmap_sects;
+    part->inode_bitmap.bits_len = sb->inode_cnt;
+    part->inode_bitmap.hint = 0;
+    part->inode_bitmap.summary_dirty = 0;
+
+    lock_acquire(&bitmap_lock);
+    uint32_t sec_idx = 0;
+    struct bitmap btmp;
+    int need_sync = 0;
+    if (sb->block_group_sects == 0)
+    {
+        sb->block_group_sects = DIV_ROUND_UP(sb->block_bitmap_sects, BLOCK_GROUPS_MAX);
+        memset(sb->block_group_free, 0, sizeof(sb->block_group_free));
+        while (sec_idx < sb->block_bitmap_sects)
+        {
+            bitmap_sec_view(bitmap_sec_get(part, &part->block_bitmap, sec_idx), &btmp);
+            block_group_free_add(part, sec_idx, bitmap_count_zero(&btmp));
+            sec_idx++;
+        }
+        need_sync = 1;
+    }
+
+    /* 空闲总数可以由块组空闲数和inode位图算出，挂载时校正一次，旧分区中没有这两项 */
+    uint32_t free_blocks = 0, group_idx = 0;
+    while (group_idx < BLOCK_GROUPS_MAX) free_blocks += sb->block_group_free[group_idx++];
+    uint32_t free_inodes = 0;
+    sec_idx = 0;
+    while (sec_idx < sb->inode_bitmap_sects)
+    {
+        bitmap_sec_view(bitmap_sec_get(part, &part->inode_bitmap, sec_idx), &btmp);
+        free_inodes += bitmap_count_zero(&btmp);
+        sec_idx++;
+    }
+    if (sb->free_blocks != free_blocks || sb->free_inodes != free_inodes)
+    {
+        sb->free_blocks = free_blocks;
+        sb->free_inodes = free_inodes;
+        need_sync = 1;
+    }
+    
+    if (need_sync) super_block_sync(part);
+    lock_release(&bitmap_lock);
+}
+
+/* 判断位图的bit_idx位是否为1 */
+int part_bitmap_test(struct partition *part, uint8_t btmp_type, uint32_t bit_idx)
+{
+    struct part_bitmap *pbm = part_bitmap_of(part, btmp_type);
+    ASSERT(bit_idx < pbm->bits_len);
+    struct bitmap btmp;
+    lock_acquire(&bitmap_lock);
+    bitmap_sec_view(bitmap_sec_get(part, pbm, bit_idx / BITS_PER_SECTOR), &btmp);
+    int ret = bitmap_scan_test(&btmp, bit_idx % BITS_PER_SECTOR) ? 1 : 0;
+    lock_release(&bitmap_lock);
+    return ret;
+}
+
+/* 将位图的bit_idx位置为value，修改只在缓存中，需要调用bitmap_sync写回 */
+void part_bitmap_set(struct partition *part, uint8_t btmp_type, uint32_t bit_idx, int8_t value)
+{
+    struct part_bitmap *pbm = part_bitmap_of(part, btmp_type);
+    ASSERT(bit_idx < pbm->bits_len);
+    uint32_t sec_idx = bit_idx / BITS_PER_SECTOR;
+    struct bitmap btmp;
+    lock_acquire(&bitmap_lock);
+    struct bitmap_sec *sec = bitmap_sec_get(part, pbm, sec_idx);
+    bitmap_sec_view(sec, &btmp);
+    int old_value = bitmap_scan_test(&btmp, bit_idx % BITS_PER_SECTOR) ? 1 : 0;
+    if (old_value != value)
+    {
+        bitmap_set(&btmp, bit_idx % BITS_PER_SECTOR, value);
+        sec->dirty = 1;
+        part_bitmap_free_add(part, btmp_type, value ? -1 : 1);
+        if (btmp_type == BLOCK_BITMAP)
+        {
+            block_group_free_add(part, sec_idx, value ? -1 : 1);
+            /* 释放的块可能是还在事务中的目录块或间接块表，在释放它的事务提交前也不能再分配出去，
+               要在释放bitmap_lock之前告诉日志 */
+            if (!value) journal_forget(block_lba_of(part, bit_idx), part->sb->block_sects);
+        }
+        pbm->summary_dirty = 1;
+    }
+    if (!value && bit_idx < pbm->hint) pbm->hint = bit_idx;
+    lock_release(&bitmap_lock);
+}
+
+/* 从start位开始查找第一个空闲位，跳过已满的块组，找不到返回-1 */
+int32_t part_bitmap_find_next_zero(struct partition *part, uint8_t btmp_type, uint32_t start)
+{
+    struct part_bitmap *pbm = part_bitmap_of(part, btmp_type);
+    uint32_t sec_idx = start / BITS_PER_SECTOR;
+    uint32_t bit_off = start % BITS_PER_SECTOR;
+    int32_t ret = -1;
+    struct bitmap btmp;
+    /* 没有空闲位时不用查找 */
+    if (part_bitmap_free_get(part, btmp_type) == 0) return -1;
+
+    lock_acquire(&bitmap_lock);
+    while (sec_idx < pbm->sects)
+    {
+        if (btmp_type == BLOCK_BITMAP && block_group_free_get(part, sec_idx) == 0)
+        {
+            /* 整个块组已满，不用读它的位图 */
+            uint32_t group_sects = part->sb->block_group_sects;
+            sec_idx = (sec_idx / group_sects + 1) * group_sects;
+            bit_off = 0;
+            continue;
+        }
+
+        bitmap_sec_view(bitmap_sec_get(part, pbm, sec_idx), &btmp);
+        int bit = bitmap_find_next_zero(&btmp, bit_off);
+        /* 当前事务中释放的块在提交前不能分配 */
+        while (bit != -1 && btmp_type == BLOCK_BITMAP && journal_block_freed(sec_idx * BITS_PER_SECTOR + bit))
+            bit = bitmap_find_next_zero(&btmp, bit + 1);
+        if (bit != -1)
+        {
+            ret = sec_idx * BITS_PER_SECTOR + bit;
+            break;
+        }
+        sec_idx++;
+        bit_off = 0;
+    }
+    lock_release(&bitmap_lock);
+    return (ret != -1 && (uint32_t)ret < pbm->bits_len) ? ret : -1;
+}
+
+/* 在[start, end)中查找第一个已占用的位，当前事务中释放的块也视为已占用，没有返回-1 */
+static int32_t part_bitmap_find_next_set(struct partition *part, struct part_bitmap *pbm, uint32_t start, uint32_t end)
+{
+    struct bitmap btmp;
+    int32_t ret = -1;
+    if (end > pbm->bits_len) end = pbm->bits_len;
+    uint32_t scan = start;
+    while (scan < end)
+    {
+        bitmap_sec_view(bitmap_sec_get(part, pbm, scan / BITS_PER_SECTOR), &btmp);
+        int bit = bitmap_find_next_set(&btmp, scan % BITS_PER_SECTOR);
+        if (bit != -1)
+        {
+            uint32_t bit_idx = scan - scan % BITS_PER_SECTOR + bit;
+            if (bit_idx < end) ret = bit_idx;
+            break;
+        }
+        scan = scan - scan % BITS_PER_SECTOR + BITS_PER_SECTOR;
+    }
+
+    if (pbm == &part->block_bitmap)
+    {
+        uint32_t limit = (ret == -1 ? end : (uint32_t)ret);
+        while (start < limit)
+        {
+            if (journal_block_freed(start)) return start;
+            start++;
+        }
+    }
+    return ret;
+}
+
+/* 从start位开始查找连续cnt个空闲位，可以跨扇区，返回其起始下标，找不到返回-1 */
+int32_t part_bitmap_find_next_zero_run(struct partition *part, uint8_t btmp_type, uint32_t start, uint32_t cnt)
+{
+    struct part_bitmap *pbm = part_bitmap_of(part, btmp_type);
+    lock_acquire(&bitmap_lock);
+    int32_t run_start = part_bitmap_find_next_zero(part, btmp_type, start);
+    while (run_start != -1)
+    {
+        if (run_start + cnt > pbm->bits_len)
+        {
+            run_start = -1;
+            break;
+        }
+        /* 只检查run_start之后的cnt位，不会把后面大片的空闲区都读一遍 */
+        int32_t run_end = part_bitmap_find_next_set(part, pbm, run_start, run_start + cnt);
+        if (run_end == -1) break;
+        run_start = part_bitmap_find_next_zero(part, btmp_type, run_end);
+    }
+    lock_release(&bitmap_lock);
+    return run_start;
+}
+
+/* 从头分配时使用，返回最小的空闲位，找不到返回-1 */
+int32_t part_bitmap_scan(struct partition *part, uint8_t btmp_type)
+{
+    struct part_bitmap *pbm = part_bitmap_of(part, btmp_type);
+    lock_acquire(&bitmap_lock);
+    int32_t bit_idx = part_bitmap_find_next_zero(part, btmp_type, pbm->hint);
+    pbm->hint = (bit_idx == -1 ? pbm->bits_len : (uint32_t)bit_idx);
+    lock_release(&bitmap_lock);
+    return bit_idx;
+}
+
+/* 将位图第bit_idx位所在的扇区同步到硬盘，空闲数有变化时一并写回超级块 */
+void bitmap_sync(struct partition *part, uint32_t bit_idx, uint8_t btmp_type)
+{
+    struct part_bitmap *pbm = part_bitmap_of(part, btmp_type);
+    uint32_t lba = pbm->lba + bit_idx / BITS_PER_SECTOR;
+    lock_acquire(&bitmap_lock);
+    uint32_t idx = 0;
+    while (idx < BITMAP_CACHE_SECS)
+    {
+        struct bitmap_sec *sec = &bitmap_cache[idx];
+        if (sec->hd == part->my_disk && sec->lba == lba)
+        {
+            /* 不在缓存中说明换出时已经写回 */
+            if (sec->dirty) journal_write(sec->hd, sec->lba, sec->data, 1);
+            sec->dirty = 0;
+            break;
+        }
+        idx++;
+    }
+    if (pbm->summary_dirty)
+    {
+        pbm->summary_dirty = 0;
+        super_block_sync(part);
+    }
+    lock_release(&bitmap_lock);
+}
+
+/* 将位图第first_bit位到第last_bit位所在的扇区同步到硬盘，每个扇区只写一次 */
+void bitmap_sync_range(struct partition *part, uint32_t first_bit, uint32_t last_bit, uint8_t btmp_type)
+{
+    uint32_t bit_idx = first_bit - first_bit % BITS_PER_SECTOR;
+    while (bit_idx <= last_bit)
+    {
+        bitmap_sync(part, bit_idx, btmp_type);
+        bit_idx += BITS_PER_SECTOR;
+    }
+}
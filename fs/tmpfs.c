@@ -0,0 +1,487 @@
+#include "tmpfs.h"
+#include "inode.h"
+#include "dir.h"
+#include "file.h"
+#include "fs.h"
+#include "page_cache.h"
+#include "global.h"
+#include "debug.h"
+#include "memory.h"
+#include "string.h"
+#include "thread.h"
+#include "sync.h"
+#include "stdio_kern.h"
+
+/* 保护所有tmpfs的目录树和文件数据 */
+static struct lock tmpfs_lock;
+static uint32_t tmpfs_next_ino = TMPFS_INO_BASE;
+static uint32_t tmpfs_nodes;            // 已创建的文件和目录数
+static uint32_t tmpfs_pages;            // 文件数据占用的页数
+
+/* inode所在的tmpfs节点 */
+static struct tmpfs_node *tmpfs_node_of(struct inode *inode)
+{
+    ASSERT(inode->i_flags & INODE_TMPFS);
+    return (struct tmpfs_node *)inode;
+}
+
+/* 在目录parent下新建名为name、类型为type的节点，parent为NULL时新建根目录，失败返回NULL */
+static struct tmpfs_node *tmpfs_node_new(struct tmpfs_node *parent, const char *name, enum file_types type)
+{
+    if (tmpfs_nodes >= TMPFS_NODES_MAX)
+    {
+        printk("tmpfs_node_new: too many files in tmpfs\n");
+        return NULL;
+    }
+
+    /* 节点被所有进程共享，要在内核空间中分配 */
+    struct task_struct *cur = running_thread();
+    uint32_t *cur_pagedir_bak = cur->pgdir;
+    cur->pgdir = NULL;
+    struct tmpfs_node *node = (struct tmpfs_node *)sys_malloc(sizeof(struct tmpfs_node));
+    cur->pgdir = cur_pagedir_bak;
+    if (node == NULL)
+    {
+        printk("tmpfs_node_new: sys_malloc for node failed\n");
+        return NULL;
+    }
+
+    memset(node, 0, sizeof(struct tmpfs_node));
+    inode_init(tmpfs_next_ino++, &node->inode);
+    node->inode.i_flags = INODE_TMPFS;
+    node->type = type;
+    strcpy(node->name, name);
+    node->parent = parent;
+    list_init(&node->children);
+    if (parent != NULL) list_append(&parent->children, &node->child_tag);
+    tmpfs_nodes++;
+    return node;
+}
+
+/* 从父目录中删除没有被打开的节点node，释放其数据页 */
+static void tmpfs_node_free(struct tmpfs_node *node)
+{
+    ASSERT(node->inode.i_open_cnts == 0 && list_empty(&node->children));
+    list_remove(&node->child_tag);
+    tmpfs_pages -= list_len(&node->inode.i_pages);
+    page_cache_release(&node->inode);
+    tmpfs_nodes--;
+
+    struct task_struct *cur = running_thread();
+    uint32_t *cur_pagedir_bak = cur->pgdir;
+    cur->pgdir = NULL;
+    sys_free(node);
+    cur->pgdir = cur_pagedir_bak;
+}
+
+/* 在目录dir中查找名为name的节点，没有时返回NULL。根目录的..在硬盘分区上，
+   由tmpfs_escape在查找路径时交回硬盘，这里同样返回NULL */
+static struct tmpfs_node *tmpfs_child(struct tmpfs_node *dir, const char *name)
+{
+    if (!strcmp(name, ".")) return dir;
+    if (!strcmp(name, "..")) return dir->parent;
+
+    struct list_elem *elem = dir->children.head.next;
+    while (elem != &dir->children.tail)
+    {
+        struct tmpfs_node *child = elem2entry(struct tmpfs_node, child_tag, elem);
+        if (!strcmp(child->name, name)) return child;
+        elem = elem->next;
+    }
+    return NULL;
+}
+
+/* 从节点base开始查找pathname，pathname中开头的'/'同样相对于base，找到返回节点，否则返回NULL。
+   只有最后一级不存在时，*parent为最后一级所在的目录，name为最后一级的名字，否则*parent为NULL */
+static struct tmpfs_node *tmpfs_walk(struct tmpfs_node *base, const char *pathname, struct tmpfs_node **parent, char *name)
+{
+    struct tmpfs_node *node = base;
+    const char *p = pathname;
+    *parent = NULL;
+    while (1)
+    {
+        while (*p == '/') p++;
+        if (*p == 0) return node;
+
+        /* 取出下一级的名字 */
+        uint32_t len = 0;
+        while (p[len] != '/' && p[len] != 0) len++;
+        if (len >= MAX_FILE_NAME_LEN || node->type != FT_DIRECTORY) return NULL;
+        memset(name, 0, MAX_FILE_NAME_LEN);
+        memcpy(name, p, len);
+        p += len;
+
+        struct tmpfs_node *child = tmpfs_child(node, name);
+        if (child == NULL)
+        {
+            while (*p == '/') p++;
+            if (*p == 0) *parent = node;
+            return NULL;
+        }
+        node = child;
+    }
+}
+
+/* 新建一个tmpfs，up_ino是挂载点所在的硬盘目录，返回其根目录的inode，失败返回NULL */
+struct inode *tmpfs_mount(uint32_t up_ino)
+{
+    if (tmpfs_next_ino == TMPFS_INO_BASE) lock_init(&tmpfs_lock);
+    struct tmpfs_node *root = tmpfs_node_new(NULL, "/", FT_DIRECTORY);
+    if (root == NULL) return NULL;
+    root->up_ino = up_ino;
+    return &root->inode;
+}
+
+/* 从目录base出发沿pathname中的目录逐级检查路径是否经过根目录的..离开tmpfs，
+   遇到不存在的一级或文件就停止，由后续的操作报错。离开时返回离开的根目录，*up指向这个..，
+   否则返回NULL */
+struct inode *tmpfs_escape(struct inode *base, const char *pathname, const char **up)
+{
+    struct tmpfs_node *node = tmpfs_node_of(base);
+    struct inode *root = NULL;
+    const char *p = pathname;
+    char name[MAX_FILE_NAME_LEN];
+    lock_acquire(&tmpfs_lock);
+    while (1)
+    {
+        while (*p == '/') p++;
+        uint32_t len = 0;
+        while (p[len] != '/' && p[len] != 0) len++;
+        if (len == 0 || len >= MAX_FILE_NAME_LEN) break;
+        memset(name, 0, MAX_FILE_NAME_LEN);
+        memcpy(name, p, len);
+
+        if (node->parent == NULL && !strcmp(name, ".."))
+        {
+            root = &node->inode;
+            *up = p;
+            break;
+        }
+        struct tmpfs_node *child = tmpfs_child(node, name);
+        if (child == NULL || child->type != FT_DIRECTORY) break;
+        node = child;
+        p += len;
+    }
+    lock_release(&tmpfs_lock);
+    return root;
+}
+
+/* 从目录base打开或创建tmpfs中的文件pathname，成功返回文件描述符，失败返回-1 */
+int32_t tmpfs_open(struct inode *base, const char *pathname, uint8_t flags)
+{
+    char name[MAX_FILE_NAME_LEN];
+    struct tmpfs_node *parent;
+    lock_acquire(&tmpfs_lock);
+    struct tmpfs_node *node = tmpfs_walk(tmpfs_node_of(base), pathname, &parent, name);
+
+    if (node != NULL && node->type == FT_DIRECTORY)
+    {
+        printk("can't open a directory with open(), use opendir() to instead\n");
+        node = NULL;
+    }
+    else if (node != NULL && flags & O_CREAT)
+    {
+        printk("%s has already exist!\n", pathname);
+        node = NULL;
+    }
+    else if (node == NULL && !(flags & O_CREAT && parent != NULL))
+    {
+        printk("tmpfs_open: %s is't exist\n", pathname);
+    }
+    else if (node == NULL)
+    {
+        node = tmpfs_node_new(parent, name, FT_REGULAR);
+    }
+
+    if (node == NULL)
+    {
+        lock_release(&tmpfs_lock);
+        return -1;
+    }
+    node->inode.i_open_cnts++;
+    lock_release(&tmpfs_lock);
+    return file_open_inode(&node->inode, flags);
+}
+
+/* 删除tmpfs中的文件pathname，成功返回0，失败返回-1 */
+int32_t tmpfs_unlink(struct inode *base, const char *pathname)
+{
+    char name[MAX_FILE_NAME_LEN];
+    struct tmpfs_node *parent;
+    int32_t ret = -1;
+    lock_acquire(&tmpfs_lock);
+    struct tmpfs_node *node = tmpfs_walk(tmpfs_node_of(base), pathname, &parent, name);
+    if (node == NULL)
+    {
+        printk("file %s not found!\n", pathname);
+    }
+    else if (node->type == FT_DIRECTORY)
+    {
+        printk("can't delete a directory with unlink(), use rmdir() to instead\n");
+    }
+    else if (node->inode.i_open_cnts > 0)
+    {
+        /* 文件关闭后可能还被映射着 */
+        printk("file %s is in use, not allow to delete!\n", pathname);
+    }
+    else
+    {
+        tmpfs_node_free(node);
+        ret = 0;
+    }
+    lock_release(&tmpfs_lock);
+    return ret;
+}
+
+/* 在tmpfs中创建目录pathname，成功返回0，失败返回-1 */
+int32_t tmpfs_mkdir(struct inode *base, const char *pathname)
+{
+    char name[MAX_FILE_NAME_LEN];
+    struct tmpfs_node *parent;
+    int32_t ret = -1;
+    lock_acquire(&tmpfs_lock);
+    struct tmpfs_node *node = tmpfs_walk(tmpfs_node_of(base), pathname, &parent, name);
+    if (node != NULL)
+    {
+        printk("sys_mkdir: file or directory %s exists!\n", pathname);
+    }
+    else if (parent == NULL)
+    {
+        printk("sys_mkdir: can't access %s, subpath is't exist\n", pathname);
+    }
+    else if (tmpfs_node_new(parent, name, FT_DIRECTORY) != NULL)
+    {
+        ret = 0;
+    }
+    lock_release(&tmpfs_lock);
+    return ret;
+}
+
+/* 删除tmpfs中的空目录pathname，根目录不能删除，成功返回0，失败返回-1 */
+int32_t tmpfs_rmdir(struct inode *base, const char *pathname)
+{
+    char name[MAX_FILE_NAME_LEN];
+    struct tmpfs_node *parent;
+    int32_t ret = -1;
+    lock_acquire(&tmpfs_lock);
+    struct tmpfs_node *node = tmpfs_walk(tmpfs_node_of(base), pathname, &parent, name);
+    if (node == NULL)
+    {
+        printk("sub path %s not exist\n", pathname);
+    }
+    else if (node->type != FT_DIRECTORY)
+    {
+        printk("%s is regular file!\n", pathname);
+    }
+    else if (!list_empty(&node->children))
+    {
+        printk("dir %s is not empty, it is not allowed to delete a nonempty directory!\n", pathname);
+    }
+    else if (node->parent == NULL || node->inode.i_open_cnts > 0)
+    {
+        printk("dir %s is in use, not allow to delete!\n", pathname);
+    }
+    else
+    {
+        tmpfs_node_free(node);
+        ret = 0;
+    }
+    lock_release(&tmpfs_lock);
+    return ret;
+}
+
+/* 打开tmpfs中的目录pathname，成功返回目录结构，失败返回NULL */
+struct dir *tmpfs_opendir(struct inode *base, const char *pathname)
+{
+    char name[MAX_FILE_NAME_LEN];
+    struct tmpfs_node *parent;
+    struct dir *pdir = NULL;
+    lock_acquire(&tmpfs_lock);
+    struct tmpfs_node *node = tmpfs_walk(tmpfs_node_of(base), pathname, &parent, name);
+    if (node == NULL)
+    {
+        printk("sub path %s not exist\n", pathname);
+    }
+    else if (node->type != FT_DIRECTORY)
+    {
+        printk("%s is regular file!\n", pathname);
+    }
+    else
+    {
+        /* 和dir_open一样分配，由dir_close关闭 */
+        pdir = (struct dir *)sys_malloc(sizeof(struct dir));
+        if (pdir != NULL)
+        {
+            node->inode.i_open_cnts++;
+            pdir->inode = &node->inode;
+            pdir->dir_pos = 0;
+            pdir->dir_blk_idx = pdir->dir_blk_ent = pdir->dir_cursor_pos = 0;
+        }
+    }
+    lock_release(&tmpfs_lock);
+    return pdir;
+}
+
+/* 把tmpfs目录dir游标处的目录项填入d并移动游标，d_size总是填写，读完返回0，否则返回1。
+   dir_pos是目录项的序号，前两项是.和..，根目录的..是挂载点所在的硬盘目录 */
+static int tmpfs_dir_next(struct dir *dir, struct dirent *d)
+{
+    struct tmpfs_node *dir_node = tmpfs_node_of(dir->inode);
+    struct tmpfs_node *node = NULL;
+    memset(d->d_name, 0, MAX_FILE_NAME_LEN);
+    if (dir->dir_pos == 0)
+    {
+        node = dir_node;
+        strcpy(d->d_name, ".");
+    }
+    else if (dir->dir_pos == 1)
+    {
+        node = dir_node->parent;
+        strcpy(d->d_name, "..");
+        if (node == NULL)
+        {
+            d->d_ino = dir_node->up_ino;
+            d->d_type = FT_DIRECTORY;
+            struct inode *up = inode_open(cur_part, dir_node->up_ino);
+            d->d_size = up->i_size;
+            inode_close(up);
+            dir->dir_pos++;
+            return 1;
+        }
+    }
+    else
+    {
+        uint32_t idx = 2;
+        struct list_elem *elem = dir_node->children.head.next;
+        while (elem != &dir_node->children.tail && idx < dir->dir_pos)
+        {
+            elem = elem->next;
+            idx++;
+        }
+        if (elem == &dir_node->children.tail) return 0;
+        node = elem2entry(struct tmpfs_node, child_tag, elem);
+        strcpy(d->d_name, node->name);
+    }
+    d->d_ino = node->inode.i_no;
+    d->d_type = node->type;
+    d->d_size = node->inode.i_size;
+    dir->dir_pos++;
+    return 1;
+}
+
+/* 读取tmpfs目录dir的一个目录项，成功返回目录项地址，读完返回NULL */
+struct dir_entry *tmpfs_readdir(struct dir *dir)
+{
+    struct dirent d;
+    struct dir_entry *dir_e = NULL;
+    lock_acquire(&tmpfs_lock);
+    if (tmpfs_dir_next(dir, &d))
+    {
+        dir_e = (struct dir_entry *)dir->dir_buf;
+        memset(dir_e, 0, sizeof(struct dir_entry));
+        memcpy(dir_e->filename, d.d_name, MAX_FILE_NAME_LEN);
+        dir_e->i_no = d.d_ino;
+        dir_e->f_type = d.d_type;
+    }
+    lock_release(&tmpfs_lock);
+    return dir_e;
+}
+
+/* 从tmpfs目录dir的游标处读出最多count个目录项到buf，flags带GETDENTS_STAT时同时填写文件大小，
+   返回读出的目录项数，读完返回0 */
+int32_t tmpfs_read_batch(struct dir *dir, struct dirent *buf, uint32_t count, uint32_t flags)
+{
+    uint32_t filled = 0;
+    lock_acquire(&tmpfs_lock);
+    while (filled < count && tmpfs_dir_next(dir, buf + filled))
+    {
+        if (!(flags & GETDENTS_STAT)) buf[filled].d_size = 0;
+        filled++;
+    }
+    lock_release(&tmpfs_lock);
+    return filled;
+}
+
+/* 在buf中填充tmpfs中pathname的属性，成功返回0，失败返回-1 */
+int32_t tmpfs_stat(struct inode *base, const char *pathname, struct stat *buf)
+{
+    char name[MAX_FILE_NAME_LEN];
+    struct tmpfs_node *parent;
+    lock_acquire(&tmpfs_lock);
+    struct tmpfs_node *node = tmpfs_walk(tmpfs_node_of(base), pathname, &parent, name);
+    if (node != NULL)
+    {
+        buf->st_ino = node->inode.i_no;
+        buf->st_size = node->inode.i_size;
+        buf->st_filetype = node->type;
+    }
+    lock_release(&tmpfs_lock);
+    if (node == NULL)
+    {
+        printk("sys_fstatat: %s not found\n", pathname);
+        return -1;
+    }
+    return 0;
+}
+
+/* 获取tmpfs的容量，块就是页 */
+void tmpfs_statfs(struct statfs *buf)
+{
+    buf->f_bsize = PG_SIZE;
+    buf->f_blocks = TMPFS_PAGES_MAX;
+    buf->f_bfree = TMPFS_PAGES_MAX - tmpfs_pages;
+    buf->f_files = TMPFS_NODES_MAX;
+    buf->f_ffree = TMPFS_NODES_MAX - tmpfs_nodes;
+}
+
+/* 从tmpfs文件inode的pos处读取count个字节到buf，调用者保证不超出文件末尾 */
+void tmpfs_read(struct inode *inode, uint32_t pos, void *buf, uint32_t count)
+{
+    uint8_t *dst = buf;
+    while (count > 0)
+    {
+        uint32_t pg_off = pos % PG_SIZE;
+        uint32_t chunk = PG_SIZE - pg_off < count ? PG_SIZE - pg_off : count;
+        /* 没有写入过的页全是0 */
+        if (page_cache_read(inode, pos, dst, chunk) == -1) memset(dst, 0, chunk);
+        dst += chunk;
+        pos += chunk;
+        count -= chunk;
+    }
+}
+
+/* 把buf中的count个字节写入tmpfs文件inode的pos处，覆盖已有数据，超出文件末尾的部分追加，
+   pos不能超过文件大小，成功返回字节数，失败返回-1 */
+int32_t tmpfs_write(struct inode *inode, uint32_t pos, const void *buf, uint32_t count)
+{
+    ASSERT(pos <= inode->i_size);
+    int32_t ret = count;
+    const uint8_t *src = buf;
+    lock_acquire(&tmpfs_lock);
+    while (count > 0)
+    {
+        uint32_t pg_idx = pos / PG_SIZE;
+        uint32_t pg_off = pos % PG_SIZE;
+        uint32_t chunk = PG_SIZE - pg_off < count ? PG_SIZE - pg_off : count;
+
+        struct cache_page *pg = page_cache_lookup(inode, pg_idx);
+        if (pg == NULL)
+        {
+            if (tmpfs_pages >= TMPFS_PAGES_MAX || (pg = page_cache_get(inode, pg_idx)) == NULL)
+            {
+                printk("tmpfs_write: tmpfs is full\n");
+                ret = -1;
+                break;
+            }
+            tmpfs_pages++;
+        }
+        memcpy(pg->kvaddr + pg_off, src, chunk);
+
+        src += chunk;
+        pos += chunk;
+        count -= chunk;
+        if (pos > inode->i_size) inode->i_size = pos;
+    }
+    lock_release(&tmpfs_lock);
+    return ret;
+}
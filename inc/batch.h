@@ -0,0 +1,66 @@
+#ifndef __FS_BATCH_H
+#define __FS_BATCH_H
+
+#include "stdint.h"
+
+/* 批量系统调用：用户进程把多个文件操作排进提交队列，一次batch_enter陷入内核后
+   由调用者线程按顺序同步执行，每个操作的返回值写入完成队列。
+   它只省去了逐个陷入的开销，操作之间没有重叠，也不会异步完成：
+   batch_enter返回时，已提交的操作都已执行完，结果都在完成队列里 */
+
+#define BATCH_ENTRIES       16                  // 提交队列和完成队列的项数，必须是2的幂
+#define BATCH_MASK          (BATCH_ENTRIES - 1)
+
+/* 提交队列项支持的操作 */
+enum batch_op
+{
+    BATCH_OP_NOP,       // 空操作，直接完成
+    BATCH_OP_READ,      // read(fd, addr, len)
+    BATCH_OP_WRITE,     // write(fd, addr, len)
+    BATCH_OP_OPEN,      // open(addr, len)，len为打开标志
+    BATCH_OP_CLOSE,     // close(fd)
+    BATCH_OP_STAT,      // stat(addr, buf)
+    BATCH_OP_LSEEK      // lseek(fd, off, len)，len为whence
+};
+
+/* 提交队列项，由用户进程填写 */
+struct batch_sqe
+{
+    uint8_t opcode;             // enum batch_op
+    int32_t fd;                 // 文件描述符
+    void *addr;                 // 读写缓冲区或路径名
+    void *buf;                  // stat的结果缓冲区
+    uint32_t len;               // 读写长度或附加参数
+    int32_t off;                // lseek的偏移量
+    uint32_t user_data;         // 原样带回完成队列项，用于区分请求
+};
+
+/* 完成队列项，由内核填写 */
+struct batch_cqe
+{
+    uint32_t user_data;         // 对应提交队列项的user_data
+    int32_t res;                // 操作的返回值
+};
+
+/* 提交/完成环，放在用户进程自己的内存中，内核只在batch_enter中访问，
+   用户只推进sq_tail和cq_head，内核只推进sq_head和cq_tail，下标不回绕，取用时与BATCH_MASK */
+struct batch_ring
+{
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    struct batch_sqe sqes[BATCH_ENTRIES];
+    struct batch_cqe cqes[BATCH_ENTRIES];
+};
+
+int32_t sys_batch_enter(struct batch_ring *ring, uint32_t to_submit);
+
+void batch_init(struct batch_ring *ring);
+struct batch_sqe *batch_get_sqe(struct batch_ring *ring);
+void batch_prep_rw(struct batch_sqe *sqe, uint8_t opcode, int32_t fd, void *addr, uint32_t len, uint32_t user_data);
+int32_t batch_submit(struct batch_ring *ring);
+struct batch_cqe *batch_peek_cqe(struct batch_ring *ring);
+void batch_cqe_seen(struct batch_ring *ring);
+
+#endif
@@ -9,11 +9,16 @@ struct bitmap
 {
     uint32_t btmp_bytes_len;        /* bitmap size in byte */
     uint8_t *bits;                  /* bitmap start address */
+    uint32_t hint;                  /* all bits before hint are set, searching starts here */
 };
 
 void bitmap_init(struct bitmap *btmp);
 int bitmap_scan_test(struct bitmap *btmp, uint32_t bit_idx);
 int bitmap_scan(struct bitmap *btmp, uint32_t cnt);
 void bitmap_set(struct bitmap *btmp, uint32_t bit_idx, int8_t value);
+int bitmap_find_next_zero(struct bitmap *btmp, uint32_t start);
+int bitmap_find_next_zero_run(struct bitmap *btmp, uint32_t start, uint32_t cnt);
+int bitmap_find_next_set(struct bitmap *btmp, uint32_t start);
+uint32_t bitmap_count_zero(struct bitmap *btmp);
 
 #endif
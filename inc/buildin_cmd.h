@@ -14,6 +14,8 @@ void buildin_ps(uint32_t argc, char **argv);
 void buildin_clear(uint32_t argc, char **argv);
 void buildin_cat(uint32_t argc, char **argv);
 void buildin_echo(uint32_t argc, char **argv);
+void buildin_bench(uint32_t argc, char **argv);
+void buildin_df(uint32_t argc, char **argv);
 void make_clear_abs_path(char *path, char *wash_buf);
 
 #endif
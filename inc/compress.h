@@ -0,0 +1,46 @@
+#ifndef __FS_COMPRESS_H
+#define __FS_COMPRESS_H
+
+#include "stdint.h"
+#include "inode.h"
+
+/* 压缩的文件按COMPRESS_CHUNK_SIZE字节分块，每块单独用LZ4压缩，正好对应页缓存中的一页。
+   文件的块映射中存放的是一个按扇区编址的数据流，每块压缩后的数据从一个新的扇区开始，
+   块在流中的位置记录在i_ctable指向的块表中，读取任意位置只需要读出所在的一块 */
+#define COMPRESS_CHUNK_SIZE     PG_SIZE
+
+/* chunk_entry.flags中的标志 */
+#define CHUNK_LZ4               1       // 数据经过LZ4压缩，否则原样存放
+
+/* 块表中的一项 */
+struct chunk_entry
+{
+    uint32_t sect_off;                  // 块的数据在数据流中的起始扇区
+    uint16_t stored_len;                // 存放的字节数，0表示这一块还没有写入
+    uint16_t flags;
+}__attribute__((packed));
+
+/* 块表，占用一个数据块，作为元数据经过日志写入 */
+struct chunk_table
+{
+    uint32_t stream_sects;              // 数据流的扇区数
+    uint32_t reserved;
+    struct chunk_entry chunks[0];
+}__attribute__((packed));
+
+/* 一个块表能记录的块数 */
+#define COMPRESS_TABLE_CHUNKS(sb)   (((sb)->block_size - sizeof(struct chunk_table)) / sizeof(struct chunk_entry))
+
+/* 数据流最多能容纳的块数，按每块都无法压缩、原样存放计算 */
+#define COMPRESS_STREAM_CHUNKS(sb)  (INODE_BLOCKS_MAX(sb) * (sb)->block_size / COMPRESS_CHUNK_SIZE)
+
+/* 压缩的文件最多的块数，取两者中小的，512字节块的旧分区受数据流限制 */
+#define COMPRESS_CHUNKS_MAX(sb)     (COMPRESS_TABLE_CHUNKS(sb) < COMPRESS_STREAM_CHUNKS(sb) ? \
+                                     COMPRESS_TABLE_CHUNKS(sb) : COMPRESS_STREAM_CHUNKS(sb))
+
+void compress_init(void);
+int32_t compress_read_chunk(struct inode *inode, uint32_t chunk_idx, uint8_t *buf);
+int32_t compress_write(struct inode *inode, uint32_t pos, const void *buf, uint32_t count);
+void compress_release(struct inode *inode);
+
+#endif
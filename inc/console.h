@@ -9,5 +9,6 @@ void console_release(void);
 void console_put_str(char *str);
 void console_put_char(uint8_t char_ascii);
 void console_put_int(uint32_t num);
+void console_write(const char *buf, uint32_t count);
 
 #endif
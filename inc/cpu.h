@@ -0,0 +1,72 @@
+#ifndef __LIB_CPU_H
+#define __LIB_CPU_H
+
+#include "stdint.h"
+
+/* cpuid 1号功能edx中的特性位 */
+#define CPUID_FEAT_EDX_SEP      (1 << 11)       // 支持sysenter/sysexit
+#define CPUID_FEAT_EDX_FXSR     (1 << 24)       // 支持fxsave/fxrstor
+#define CPUID_FEAT_EDX_SSE      (1 << 25)       // 支持SSE
+#define CPUID_FEAT_EDX_SSE2     (1 << 26)       // 支持SSE2
+
+/* 控制寄存器中的标志位 */
+#define CR0_MP                  (1 << 1)        // 监控协处理器，配合TS使wait/fwait也触发#NM
+#define CR0_EM                  (1 << 2)        // 模拟协处理器，置位时浮点指令触发#NM
+#define CR0_TS                  (1 << 3)        // 任务已切换，置位时浮点/SSE指令触发#NM
+#define CR0_NE                  (1 << 5)        // 使用#MF报告浮点错误
+#define CR4_OSFXSR              (1 << 9)        // 操作系统支持fxsave/fxrstor，开启SSE
+#define CR4_OSXMMEXCPT          (1 << 10)       // 操作系统支持#XF异常
+
+/* 执行cpuid指令，查询leaf号功能 */
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+    asm volatile ("cpuid": "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx): "a"(leaf), "c"(0));
+}
+
+/* 读取模型特定寄存器msr */
+static inline uint64_t rdmsr(uint32_t msr)
+{
+    uint32_t low, high;
+    asm volatile ("rdmsr": "=a"(low), "=d"(high): "c"(msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+/* 写入模型特定寄存器msr */
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+    asm volatile ("wrmsr": :"c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline uint32_t read_cr0(void)
+{
+    uint32_t cr0;
+    asm volatile ("movl %%cr0, %0": "=r"(cr0));
+    return cr0;
+}
+
+static inline void write_cr0(uint32_t cr0)
+{
+    asm volatile ("movl %0, %%cr0": :"r"(cr0): "memory");
+}
+
+static inline uint32_t read_cr4(void)
+{
+    uint32_t cr4;
+    asm volatile ("movl %%cr4, %0": "=r"(cr4));
+    return cr4;
+}
+
+static inline void write_cr4(uint32_t cr4)
+{
+    asm volatile ("movl %0, %%cr4": :"r"(cr4): "memory");
+}
+
+/* 读取时间戳计数器，用户态也可以执行 */
+static inline uint64_t rdtsc(void)
+{
+    uint32_t low, high;
+    asm volatile ("rdtsc": "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+#endif
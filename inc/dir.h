@@ -14,7 +14,10 @@ struct dir
 {
     struct inode *inode;
     uint32_t dir_pos;           // 记录目录内偏移
-    uint8_t dir_buf[512];       // 目录数据缓冲区
+    uint32_t dir_blk_idx;       // dir_read_batch的游标，下一个目录项所在的块序号
+    uint32_t dir_blk_ent;       // 游标在块内的目录项序号
+    uint32_t dir_cursor_pos;    // 游标对应的dir_pos，和dir_pos不相等时游标无效
+    uint8_t dir_buf[BLOCK_SIZE_MAX];    // 目录数据缓冲区，能容纳一个块
 };
 
 /* 目录项结构 */
@@ -25,6 +28,26 @@ struct dir_entry
     enum file_types f_type;             // 文件类型
 };
 
+/* getdents返回的目录项 */
+struct dirent
+{
+    char d_name[MAX_FILE_NAME_LEN];     // 文件名称
+    uint32_t d_ino;                     // i节点
+    enum file_types d_type;             // 文件类型
+    uint32_t d_size;                    // 文件大小，只在带GETDENTS_STAT标志时填写
+};
+
+#define GETDENTS_STAT           1       // getdents同时填写每项的d_size，省去逐项stat
+
+/* getdents的参数，系统调用最多传3个参数，所以通过结构体传入 */
+struct getdents_args
+{
+    struct dir *dir;
+    struct dirent *buf;
+    uint32_t count;                     // buf能容纳的目录项数
+    uint32_t flags;
+};
+
 extern struct dir root_dir;         // 根目录
 
 void open_root_dir(struct partition *part);
@@ -35,6 +58,7 @@ void create_dir_entry(char *filename, uint32_t inode_no, uint8_t file_type, stru
 int sync_dir_entry(struct dir* parent_dir, struct dir_entry *p_de, void *io_buf);
 int delete_dir_entry(struct partition *part, struct dir *pdir, uint32_t inode_no, void *io_buf);
 struct dir_entry *dir_read(struct dir *dir);
+int32_t dir_read_batch(struct dir *dir, struct dirent *buf, uint32_t count, uint32_t flags);
 int dir_is_empty(struct dir *dir);
 int32_t dir_remove(struct dir *parent_dir, struct dir *child_dir);
 
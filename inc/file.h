@@ -6,12 +6,19 @@
 #include "dir.h"
 #include "global.h"
 
+struct iovec;
+
 /* 文件结构 */
 struct file 
 {
     uint32_t fd_pos;            // 记录文件操作的偏移量
     uint32_t fd_flag;
     struct inode *fd_inode;
+    uint32_t fd_prealloc_lba;   // 写文件时预留的连续块中下一个可用块的LBA地址
+    uint32_t fd_prealloc_cnt;   // 预留的连续块中剩余的块数
+    uint8_t *fd_wbuf;           // 延迟分配缓冲区，缓存追加到文件末尾还没有分配块的数据
+    uint32_t fd_wbuf_len;       // 缓冲区中数据的字节数
+    uint32_t fd_wbuf_ticks;     // 缓冲区中最早的数据写入时的ticks
 };
 
 /* 标准输入输出描述符 */
@@ -30,18 +37,35 @@ enum bitmap_type
 };
 
 #define MAX_FILE_OPEN   32          // 系统中打开最大文件数
+#define PREALLOC_BLOCKS 8           // 写文件时一次预留的连续块数
+#define DALLOC_BUF_SIZE PG_SIZE     // 延迟分配缓冲区大小
+#define DALLOC_EXPIRE_TICKS 500     // 数据在延迟分配缓冲区中最长停留的ticks，即5秒
+#define DIRTY_EXPIRE_TICKS  500     // 页缓存和inode表缓存中的修改最长停留的ticks
 
 extern struct file file_table[MAX_FILE_OPEN];
 
 int32_t inode_bitmap_alloc(struct partition *part);
+uint32_t block_bitmap_idx_of(struct partition *part, uint32_t block_lba);
+uint32_t block_lba_of(struct partition *part, uint32_t bit_idx);
 int32_t block_bitmap_alloc(struct partition *part);
+uint32_t block_goal_of_inode(struct partition *part, uint32_t inode_no);
+int32_t block_bitmap_alloc_near(struct partition *part, uint32_t goal_lba);
+int32_t file_block_alloc(struct file *file, uint32_t prev_lba);
+void file_prealloc_release(struct file *file);
+int32_t file_flush(struct file *file);
+void inode_flush_dalloc(struct inode *inode);
+void file_flush_all(int only_expired);
+void file_dalloc_init(void);
 int32_t file_create(struct dir *parent_dir, char *filename, uint8_t flag);
-void bitmap_sync(struct partition *part, uint32_t bit_idx, uint8_t btmp_type);
 int32_t get_free_slot_in_global(void);
 int32_t pcb_fd_install(uint32_t globa_fd_idx);
+int32_t file_open_inode(struct inode *inode, uint8_t flag);
 int32_t file_open(uint32_t inode_no, uint8_t flag);
 int32_t file_close(struct file *file);
 int32_t file_write(struct file *file, const void *buf, uint32_t count);
 int32_t file_read(struct file *file, void *buf, uint32_t count);
+int32_t file_writev(struct file *file, const struct iovec *iov, uint32_t iovcnt);
+int32_t file_pwrite(struct file *file, uint32_t pos, const void *buf, uint32_t count);
+int32_t file_readv(struct file *file, const struct iovec *iov, uint32_t iovcnt);
 
 #endif
@@ -0,0 +1,20 @@
+#ifndef __KERNEL_FPU_H
+#define __KERNEL_FPU_H
+
+#include "stdint.h"
+#include "thread.h"
+#include "interrupt.h"
+
+#define FPU_STATE_SIZE      512             // fxsave保存区的大小，fnsave只用到前108字节
+
+extern int fpu_has_sse;
+extern int fpu_has_sse2;
+
+void fpu_init(void);
+void fpu_switch(struct task_struct *next);
+int32_t fpu_fork(struct task_struct *child, struct task_struct *parent);
+void fpu_release(struct task_struct *pthread);
+enum intr_status kernel_fpu_begin(void);
+void kernel_fpu_end(enum intr_status old_status);
+
+#endif
@@ -7,7 +7,8 @@
 #define MAX_FILES_PER_PART      4096            // 每个分区支持的最大文件数
 #define BITS_PER_SECTOR         4096            // 每个扇区的位数
 #define SECTOR_SIZE             512             // 扇区字节大小 
-#define BLOCK_SIZE              SECTOR_SIZE     // 块字节大小
+#define BLOCK_SIZE_MAX          4096            // 块字节大小的上限
+#define FS_BLOCK_SIZE           4096            // 格式化时使用的块字节大小，可以是1024、2048或4096
 
 #define MAX_PATH_LEN            512             // 路径最大长度
 
@@ -25,7 +26,9 @@ enum oflags
     O_RDONLY,           // 只读
     O_WRONLY,           // 只写
     O_RDWR,             // 读写
-    O_CREAT = 4         // 创建
+    O_CREAT = 4,        // 创建
+    O_DIRECT = 8,       // 直接I/O，整块对齐的读写不经过中间缓冲区
+    O_COMPRESS = 16     // 和O_CREAT一起使用，新文件的数据按块LZ4压缩后存放
 };
 
 /* 文件读写位置偏移量 */
@@ -41,6 +44,8 @@ struct path_search_record
     char searched_path[MAX_PATH_LEN];       // 查找文件的路径
     struct dir *parent_dir;                 // 查找文件的直接父目录
     enum file_types file_type;              // 找到的文件类型
+    struct inode *mnt_dir;                  // 路径进入了挂载的文件系统时为在其中开始查找的目录，否则为NULL
+    const char *mnt_path;                   // 在mnt_dir中继续查找的路径
 };
 
 /* 文件属性结构 */
@@ -51,18 +56,50 @@ struct stat
     enum file_types st_filetype;             // 文件类型
 };
 
+/* 文件系统统计信息 */
+struct statfs
+{
+    uint32_t f_bsize;                       // 块大小
+    uint32_t f_blocks;                      // 数据块总数
+    uint32_t f_bfree;                       // 空闲块数
+    uint32_t f_files;                       // inode总数
+    uint32_t f_ffree;                       // 空闲inode数
+};
+
+/* readv/writev的一个缓冲区 */
+struct iovec
+{
+    void *iov_base;
+    uint32_t iov_len;
+};
+
+/* pread/pwrite的参数，系统调用最多传3个参数，所以通过结构体传入 */
+struct pio_args
+{
+    int32_t fd;
+    void *buf;
+    uint32_t count;
+    uint32_t offset;                        // 文件中的位置，不使用也不改变fd的当前位置
+};
+
+struct getdents_args;
+
 extern struct partition *cur_part;
 
 void filesys_init(void);
+void super_block_sync(struct partition *part);
 char *path_parse(char *pathname, char *name_store);
 int32_t path_depth_cnt(char *pathname);
 int32_t sys_open(const char *pathname, uint8_t flags);
+int32_t sys_openat(struct dir *dir, const char *pathname, uint8_t flags);
 int32_t sys_close(int32_t fd);
 int32_t sys_write(int32_t fd, const void *buf, uint32_t count);
 int32_t sys_read(int32_t fd, void *buf, uint32_t count);
 int32_t sys_lseek(int32_t fd, int32_t offset, uint8_t whence);
 int32_t sys_unlink(const char *pathname);
+int32_t sys_unlinkat(struct dir *dir, const char *pathname);
 int32_t sys_mkdir(const char *pathname);
+int32_t sys_mkdirat(struct dir *dir, const char *pathname);
 struct dir *sys_opendir(const char *pathname);
 int32_t sys_closedir(struct dir *dir);
 struct dir_entry *sys_readdir(struct dir *dir);
@@ -71,6 +108,19 @@ int32_t sys_rmdir(const char *pathname);
 char *sys_getcwd(char *buf, uint32_t size);
 int32_t sys_chdir(const char *path);
 int32_t sys_stat(const char *path, struct stat *buf);
+int32_t sys_fstatat(struct dir *dir, const char *path, struct stat *buf);
+int32_t sys_fstat(int32_t fd, struct stat *buf);
+int32_t sys_fsync(int32_t fd);
+int32_t sys_fdatasync(int32_t fd);
+void sys_sync(void);
+int32_t sys_statfs(const char *path, struct statfs *buf);
+int32_t sys_sendfile(int32_t out_fd, int32_t in_fd, uint32_t count);
+int32_t sys_splice(int32_t fd_in, int32_t fd_out, uint32_t count);
+int32_t sys_readv(int32_t fd, const struct iovec *iov, uint32_t iovcnt);
+int32_t sys_writev(int32_t fd, const struct iovec *iov, uint32_t iovcnt);
+int32_t sys_pread(const struct pio_args *args);
+int32_t sys_pwrite(const struct pio_args *args);
+int32_t sys_getdents(const struct getdents_args *args);
 void sys_putchar(char char_ascii);
 uint32_t fd_local2global(uint32_t local_fd);
 
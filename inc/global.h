@@ -36,7 +36,12 @@
 
 #define SELECTOR_U_CODE     ((5 << 3) + (TI_GDT << 2) + RPL3)
 #define SELECTOR_U_DATA     ((6 << 3) + (TI_GDT << 2) + RPL3)     
-#define SELECTOR_U_STACK    SELECTOR_U_DATA     
+#define SELECTOR_U_STACK    SELECTOR_U_DATA
+
+/* sysenter/sysexit要求内核代码段、内核数据段、用户代码段、用户数据段在GDT中依次相邻，
+   原有布局不满足，所以在GDT的第7～10项另外准备一组描述符 */
+#define SELECTOR_SYSENTER_CS    ((7 << 3) + (TI_GDT << 2) + RPL0)
+#define GDT_DESC_CNT            11
 
 #define GDT_ATTR_HIGH           ((DESC_G_4K << 7) + (DESC_D_32 << 6) + (DESC_L << 5) + (DESC_AVL << 4))
 #define GDT_CODE_ATTR_LOW_DPL3  ((DESC_P << 7) + (DESC_DPL_3 << 5) + (DESC_S_CODE << 4) + DESC_TYPE_CODE)
@@ -5,6 +5,7 @@
 #include "sync.h"
 #include "bitmap.h"
 #include "super_block.h"
+#include "part_bitmap.h"
 
 /* 分区结构 */
 struct partition 
@@ -15,8 +16,8 @@ struct partition
     struct list_elem part_tag;      // 用于队列中的标记
     char name[8];                   // 分区名称
     struct super_block *sb;         // 本分区的超级块
-    struct bitmap block_bitmap;     // 块位图
-    struct bitmap inode_bitmap;     // i节点位图
+    struct part_bitmap block_bitmap;    // 块位图
+    struct part_bitmap inode_bitmap;    // i节点位图
     struct list open_inodes;        // 本分区打开的i节点队列
 };
 
@@ -49,6 +50,7 @@ extern struct list partition_list;
 void ide_init(void);
 void ide_read(struct disk *hd, uint32_t lba, void *buf, uint32_t sec_cnt);
 void ide_write(struct disk *hd, uint32_t lba, void *buf, uint32_t sec_cnt);
+void ide_flush(struct disk *hd);
 void intr_hd_handler(uint8_t irq_no);
 
 #endif
@@ -4,6 +4,9 @@
 #include "stdint.h"
 #include "list.h"
 #include "ide.h"
+#include "super_block.h"
+
+struct chunk_table;
 
 /* inode结构 */
 struct inode 
@@ -16,16 +19,61 @@ struct inode
 
     uint32_t i_open_cnts;           // 此文件打开的次数
     int write_deny;                 // 写文件互斥
+    uint32_t i_flags;               // inode标志
     
-    uint32_t i_sectors[13];         // 0～11是直接块，12是一级间接块指针
+    /* 0～11是直接块，12是一级间接块指针，有INODE_INLINE标志时直接存放数据 */
+    uint32_t i_sectors[13];
+    uint32_t i_ctable;              // 有INODE_COMPRESSED标志时是块表所在块的LBA
     struct list_elem inode_tag;
+    struct list i_pages;            // 此文件在页缓存中的页，只在内存中
+    struct chunk_table *i_chunks;   // 缓存的块表，只在内存中
+    uint32_t i_ctable_seq;          // 最后一次写入块表的日志事务序号，只在内存中
 };
 
+/* i_flags中的标志 */
+#define INODE_INLINE            1                       // 数据内联在i_sectors中，不占用数据块
+#define INODE_COMPRESSED        2                       // 数据按块LZ4压缩后存放，见compress.h
+#define INODE_TMPFS             4                       // tmpfs中的inode，只在内存中，见tmpfs.h
+#define INODE_INLINE_SIZE       (13 * 4)                // 内联数据的最大字节数
+#define INODE_INLINE_LBA        0xffffffff              // 内联inode唯一的"块"的地址
+
+/* 一个inode最多的块数，12个直接块加上一级间接块表中能存放的块地址数 */
+#define INODE_BLOCKS_MAX(sb)    (12 + (sb)->block_size / 4)
+
+/* 硬盘上的inode记录，只保存需要持久化的字段，大小能整除扇区，不会跨扇区 */
+struct d_inode
+{
+    uint32_t i_size;                // 文件大小或目录项大小的总和
+    uint32_t i_sectors[13];         // 0～11是直接块，12是一级间接块指针
+    uint32_t i_flags;               // inode标志
+    uint32_t i_ctable;              // 压缩的文件的块表所在块的LBA
+}__attribute__((packed));
+
+#define DISK_INODE_SIZE         64                                  // sizeof(struct d_inode)
+#define INODES_PER_SECTOR       (512 / DISK_INODE_SIZE)
+
+/* inode表按组延迟清零，格式化时只写第0组，其余组在首次使用或由后台线程清零 */
+#define ITABLE_GROUP_SECTS      32
+
+/* 旧格式把整个struct inode写入硬盘，用于迁移旧分区 */
+#define OLD_DISK_INODE_SIZE     76
+
 struct inode *inode_open(struct partition *part, uint32_t inode_no);
 void inode_sync(struct partition *part, struct inode *inode, void *io_buf);
+void inode_mark_dirty(struct partition *part, struct inode *inode);
+void inode_writeback(struct partition *part, struct inode *inode);
+void inode_table_flush(int only_expired);
 void inode_init(uint32_t inode_no, struct inode *new_inode);
 void inode_close(struct inode *inode);
 void inode_release(struct partition *part, uint32_t inode_no);
 void inode_delete(struct partition *part, uint32_t inode_no, void *io_buf);
+void inode_table_cache_init(void);
+int32_t inode_table_migrate(struct partition *part, struct super_block *sb);
+void inode_table_lazy_init(struct partition *part);
+void inode_collect_blocks(struct partition *part, struct inode *inode, uint32_t *all_blocks);
+void inode_block_read(struct partition *part, struct inode *inode, uint32_t lba, void *buf);
+void inode_block_write(struct partition *part, struct inode *inode, uint32_t lba, void *buf);
+int32_t inode_inline_to_block(struct partition *part, struct inode *inode);
+int inode_is_open(struct partition *part, uint32_t inode_no);
 
 #endif
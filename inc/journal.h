@@ -0,0 +1,55 @@
+#ifndef __FS_JOURNAL_H
+#define __FS_JOURNAL_H
+
+#include "stdint.h"
+#include "ide.h"
+
+#define JOURNAL_MAGIC           0x4a524e4c                  // 日志头扇区的魔数
+#define JOURNAL_DESC_MAGIC      0x4a445343                  // 描述扇区的魔数
+#define JOURNAL_COMMIT_MAGIC    0x4a434d54                  // 提交扇区的魔数
+
+#define JOURNAL_SECTS           128                         // 新建日志区的扇区数
+#define JOURNAL_TXN_SECS        (JOURNAL_SECTS - 3)         // 一个事务最多记录的元数据扇区数，除去头、描述和提交扇区
+#define JOURNAL_HANDLE_SECS     24                          // 一个操作最多修改的元数据扇区数，开始操作时在事务中预留
+#define JOURNAL_RESERVE_SECS    25                          // 为不在操作中的写回预留的扇区数，即inode表缓存、位图缓存和超级块的扇区数
+
+/* 日志区第0个扇区，seq是下一个要提交的事务序号，日志区中序号与之相同的事务还没有写回原位置 */
+struct journal_header
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint8_t pad[504];
+}__attribute__((packed));
+
+/* 事务的描述扇区，紧接着是count个元数据扇区，最后是提交扇区，三部分一次顺序写入 */
+struct journal_desc
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t count;                                 // 事务中元数据扇区的个数
+    uint32_t lbas[(512 - 12) / 4];                  // 每个元数据扇区在分区中的原位置
+}__attribute__((packed));
+
+/* 事务的提交扇区，校验和覆盖描述扇区和全部元数据扇区，重放时校验失败说明提交没有完成 */
+struct journal_commit
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t count;
+    uint32_t checksum;
+    uint8_t pad[496];
+}__attribute__((packed));
+
+int journal_replay(struct partition *part);
+void journal_mount(struct partition *part);
+void journal_begin(void);
+void journal_end(void);
+void journal_write(struct disk *hd, uint32_t lba, void *buf, uint32_t sec_cnt);
+void journal_read(struct disk *hd, uint32_t lba, void *buf, uint32_t sec_cnt);
+void journal_forget(uint32_t lba, uint32_t sec_cnt);
+int journal_block_freed(uint32_t bit_idx);
+uint32_t journal_txn_seq(void);
+int journal_committed(struct partition *part, uint32_t seq);
+void journal_flush(int only_expired);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef __LIB_KERNEL_LZ4_H
+#define __LIB_KERNEL_LZ4_H
+
+#include "stdint.h"
+
+#define LZ4_HASH_LOG        11
+#define LZ4_HASH_SIZE       (1 << LZ4_HASH_LOG)     // 压缩时哈希表的项数，每项2字节，正好一页
+
+/* 最坏情况下（数据不可压缩）压缩结果的字节数 */
+#define LZ4_COMPRESS_BOUND(len)     ((len) + (len) / 255 + 16)
+
+int32_t lz4_compress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint16_t *hash_table);
+int32_t lz4_decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap);
+
+#endif
@@ -61,5 +61,11 @@ void pfree(uint32_t pg_phy_addr);
 void sys_free(void *ptr);
 void *get_a_page_without_opvaddrbitmap(enum pool_flags pf, uint32_t vaddr);
 void free_a_phy_page(uint32_t pg_phy_addr);
+void page_map_readonly(uint32_t vaddr, uint32_t pg_phy_addr);
+void page_map_user(uint32_t vaddr, uint32_t pg_phy_addr, int writable);
+void page_unmap(uint32_t vaddr);
+void *get_user_vaddr(uint32_t pg_cnt);
+void put_user_vaddr(void *vaddr, uint32_t pg_cnt);
+void user_vaddr_claim(uint32_t vaddr, uint32_t pg_cnt);
 
 #endif
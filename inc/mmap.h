@@ -0,0 +1,51 @@
+#ifndef __KERNEL_MMAP_H
+#define __KERNEL_MMAP_H
+
+#include "stdint.h"
+#include "global.h"
+#include "thread.h"
+#include "inode.h"
+
+/* 映射区的访问权限 */
+#define PROT_READ       1
+#define PROT_WRITE      2
+
+/* 映射的类型 */
+#define MAP_SHARED      1               // 修改写回文件，映射同一文件的进程互相可见
+#define MAP_PRIVATE     2               // 只读的私有映射，暂不支持写时复制
+
+/* mmap的参数，系统调用最多传3个参数，所以通过结构体传入 */
+struct mmap_args
+{
+    void *addr;                         // 建议的地址，目前忽略，由内核选择
+    uint32_t length;
+    uint32_t prot;
+    uint32_t flags;
+    int32_t fd;
+    uint32_t offset;                    // 必须按页对齐
+};
+
+/* 进程中的一个文件映射区，按页访问时通过缺页异常从页缓存中映射 */
+struct vm_area
+{
+    uint32_t start;                     // 起始虚拟地址
+    uint32_t pg_cnt;                    // 占用的虚拟页数
+    struct inode *inode;                // 映射的文件，NULL表示此项空闲
+    uint32_t pg_off;                    // 起始地址对应文件中的页号
+    uint32_t prot;
+};
+
+/* 每个进程的映射区表占一页 */
+#define VM_AREA_CNT     (PG_SIZE / sizeof(struct vm_area))
+
+void mmap_init(void);
+void *sys_mmap(const struct mmap_args *args);
+int32_t sys_munmap(void *addr, uint32_t length);
+int32_t mmap_text(struct inode *inode, uint32_t vaddr, uint32_t pg_cnt, uint32_t pg_off);
+int32_t mmap_fault(struct task_struct *cur, uint32_t vaddr);
+int32_t mmap_prefault(const void *buf, uint32_t len, int write);
+int mmap_contains(struct task_struct *pthread, uint32_t vaddr);
+int32_t mmap_fork(struct task_struct *child, struct task_struct *parent);
+void mmap_release(struct task_struct *pthread);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef __FS_MOUNT_H
+#define __FS_MOUNT_H
+
+#include "stdint.h"
+#include "inode.h"
+
+#define MAX_MOUNTS              4       // 除硬盘分区外最多的挂载数
+
+/* 挂载表的一项，挂载点是硬盘分区上的一个目录，
+   路径查找走进这个目录时转到挂载的文件系统的根目录继续查找 */
+struct mount
+{
+    uint32_t mnt_ino;                   // 挂载点目录的inode号
+    struct inode *root;                 // 挂载的文件系统的根目录，为NULL表示此项空闲
+};
+
+int32_t mount_add(uint32_t mnt_ino, struct inode *root);
+struct inode *mount_find(uint32_t mnt_ino);
+uint32_t mount_point(struct inode *root);
+
+#endif
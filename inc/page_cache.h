@@ -0,0 +1,28 @@
+#ifndef __FS_PAGE_CACHE_H
+#define __FS_PAGE_CACHE_H
+
+#include "stdint.h"
+#include "list.h"
+#include "inode.h"
+
+/* 文件页缓存中的一页，挂在所属inode的i_pages链表上，被映射同一文件的所有进程共享 */
+struct cache_page
+{
+    uint32_t pg_idx;                // 页在文件中的序号，对应文件偏移pg_idx * PG_SIZE
+    uint8_t *kvaddr;                // 页在内核空间中的虚拟地址
+    uint32_t map_cnt;               // 映射了此页的用户页表项数
+    int dirty;                      // 页中可能有还没写回硬盘的修改
+    uint32_t dirty_ticks;           // 开始被修改时的ticks，写回线程据此判断是否该写回
+    struct list_elem page_tag;      // 用于inode->i_pages
+};
+
+void page_cache_init(void);
+struct cache_page *page_cache_get(struct inode *inode, uint32_t pg_idx);
+struct cache_page *page_cache_lookup(struct inode *inode, uint32_t pg_idx);
+int32_t page_cache_read(struct inode *inode, uint32_t pos, void *buf, uint32_t count);
+void page_cache_update(struct inode *inode, uint32_t pos, const void *buf, uint32_t count);
+void page_cache_writeback(struct inode *inode, int only_expired);
+void page_cache_flush_all(int only_expired);
+void page_cache_release(struct inode *inode);
+
+#endif
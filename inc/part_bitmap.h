@@ -0,0 +1,28 @@
+#ifndef __FS_PART_BITMAP_H
+#define __FS_PART_BITMAP_H
+
+#include "stdint.h"
+
+struct partition;
+
+/* 分区中的位图，不整体读入内存，按扇区通过缓存访问 */
+struct part_bitmap
+{
+    uint32_t lba;                   // 位图起始扇区
+    uint32_t sects;                 // 位图占用的扇区数
+    uint32_t bits_len;              // 位图的位数
+    uint32_t hint;                  // hint之前的位都已被占用，从这里开始查找空闲位
+    int summary_dirty;              // 超级块中的空闲数有修改还未写回
+};
+
+void part_bitmap_cache_init(void);
+void part_bitmap_mount(struct partition *part);
+int part_bitmap_test(struct partition *part, uint8_t btmp_type, uint32_t bit_idx);
+void part_bitmap_set(struct partition *part, uint8_t btmp_type, uint32_t bit_idx, int8_t value);
+int32_t part_bitmap_scan(struct partition *part, uint8_t btmp_type);
+int32_t part_bitmap_find_next_zero(struct partition *part, uint8_t btmp_type, uint32_t start);
+int32_t part_bitmap_find_next_zero_run(struct partition *part, uint8_t btmp_type, uint32_t start, uint32_t cnt);
+void bitmap_sync(struct partition *part, uint32_t bit_idx, uint8_t btmp_type);
+void bitmap_sync_range(struct partition *part, uint32_t first_bit, uint32_t last_bit, uint8_t btmp_type);
+
+#endif
@@ -14,5 +14,6 @@ void process_activate(struct task_struct *p_thread);
 void page_dir_activate(struct task_struct *p_thread);
 uint32_t *create_page_dir(void);
 void create_user_vaddr_bitmap(struct task_struct *user_proc);
+int32_t vdso_install(struct task_struct *p_thread);
 
 #endif
@@ -13,5 +13,13 @@ char *strchr(const char *string, const uint8_t ch);
 char *strrchr(const char *string, const uint8_t ch);
 char *strcat(char *dst_, const char *src_);
 uint32_t strchrs(const char *string, uint8_t ch);
+void string_init(void);
+int string_sse2_enabled(void);
+
+/* 各个实现版本，供基准测试直接调用 */
+void memset_rep(void *dst_, uint8_t value, uint32_t size);
+void memcpy_rep(void *dst_, const void *src_, uint32_t size);
+void memset_sse2(void *dst_, uint8_t value, uint32_t size);
+void memcpy_sse2(void *dst_, const void *src_, uint32_t size);
 
 #endif
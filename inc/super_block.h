@@ -3,6 +3,12 @@
 
 #include "stdint.h"
 
+#define SUPER_BLOCK_MAGIC_V1    0x19590318      // 旧格式，inode表中存放整个struct inode
+#define SUPER_BLOCK_MAGIC       0x19590319      // inode表中存放紧凑的struct d_inode
+#define SUPER_BLOCK_MAGIC_MIGRATING 0x1959031a  // 新格式的inode表已暂存在migrate_lba，还没有拷贝到inode表
+
+#define BLOCK_GROUPS_MAX        64              // 块位图最多分成的块组数
+
 /* 超级块 */
 struct super_block 
 {
@@ -23,8 +29,20 @@ struct super_block
     uint32_t data_start_lba;            // 数据区起始的第一个扇区号
     uint32_t root_inode_no;             // 根目录所在的i节点号
     uint32_t dir_entry_size;            // 目录项大小
-
-    uint8_t pad[460];                   // 填充一个扇区的大小
+    uint32_t inode_size;                // 硬盘上inode记录的大小
+    uint32_t itable_group_sects;        // inode表每组的扇区数
+    uint32_t itable_uninit;             // 每位对应inode表的一组，置1表示该组还未清零
+    uint32_t block_group_sects;         // 每个块组对应的块位图扇区数，为0表示还没有统计块组空闲数
+    uint32_t block_group_free[BLOCK_GROUPS_MAX];    // 每个块组中的空闲块数
+    uint32_t free_blocks;               // 空闲块总数
+    uint32_t free_inodes;               // 空闲inode总数
+    uint32_t block_size;                // 块字节大小，为0表示旧分区，块大小等于扇区大小
+    uint32_t block_sects;               // 每块的扇区数
+    uint32_t journal_lba;               // 元数据日志区的起始lba地址
+    uint32_t journal_sects;             // 日志区的扇区数，为0表示还没有创建日志区
+    uint32_t migrate_lba;               // 转换旧格式inode表时新表暂存的起始lba地址
+
+    uint8_t pad[160];                   // 填充一个扇区的大小
 }__attribute__((packed));
 
 #endif
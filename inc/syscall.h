@@ -4,6 +4,9 @@
 #include "stdint.h"
 #include "fs.h"
 #include "thread.h"
+#include "batch.h"
+#include "mmap.h"
+#include "dir.h"
 
 enum SYSCALL_NR 
 {
@@ -33,9 +36,35 @@ enum SYSCALL_NR
     SYS_EXIT,
     SYS_WAIT,
     SYS_PIPE,
-    SYS_DUP2
+    SYS_DUP2,
+    SYS_BATCH_ENTER,
+    SYS_STATFS,
+    SYS_MMAP,
+    SYS_MUNMAP,
+    SYS_SENDFILE,
+    SYS_SPLICE,
+    SYS_READV,
+    SYS_WRITEV,
+    SYS_PREAD,
+    SYS_PWRITE,
+    SYS_GETDENTS,
+    SYS_FSTAT,
+    SYS_OPENAT,
+    SYS_FSTATAT,
+    SYS_UNLINKAT,
+    SYS_MKDIRAT,
+    SYS_FSYNC,
+    SYS_FDATASYNC,
+    SYS_SYNC
 };
 
+/* 系统调用入口桩 */
+typedef void syscall_stub(void);
+syscall_stub syscall_int80;
+syscall_stub syscall_sysenter;
+extern syscall_stub *syscall_entry;
+
+uint32_t syscall_roundtrip(syscall_stub *entry);
 uint32_t getpid(void);
 uint32_t write(int32_t fd, const void *buf, uint32_t count);
 void *malloc(uint32_t size);
@@ -63,5 +92,24 @@ void exit(int32_t status);
 pid_t wait(int32_t *status);
 int32_t pipe(int32_t pipefd[2]);
 void dup2(uint32_t fd1, uint32_t fd2);
+int32_t batch_enter(struct batch_ring *ring, uint32_t to_submit);
+int32_t statfs(const char *path, struct statfs *buf);
+void *mmap(void *addr, uint32_t length, uint32_t prot, uint32_t flags, int32_t fd, uint32_t offset);
+int32_t munmap(void *addr, uint32_t length);
+int32_t sendfile(int32_t out_fd, int32_t in_fd, uint32_t count);
+int32_t splice(int32_t fd_in, int32_t fd_out, uint32_t count);
+int32_t readv(int32_t fd, const struct iovec *iov, uint32_t iovcnt);
+int32_t writev(int32_t fd, const struct iovec *iov, uint32_t iovcnt);
+int32_t pread(int32_t fd, void *buf, uint32_t count, uint32_t offset);
+int32_t pwrite(int32_t fd, const void *buf, uint32_t count, uint32_t offset);
+int32_t getdents(struct dir *dir, struct dirent *buf, uint32_t count, uint32_t flags);
+int32_t fstat(int32_t fd, struct stat *buf);
+int32_t openat(struct dir *dir, const char *pathname, uint8_t flag);
+int32_t fstatat(struct dir *dir, const char *path, struct stat *buf);
+int32_t unlinkat(struct dir *dir, const char *pathname);
+int32_t mkdirat(struct dir *dir, const char *pathname);
+int32_t fsync(int32_t fd);
+int32_t fdatasync(int32_t fd);
+void sync(void);
 
 #endif
@@ -13,6 +13,9 @@
 typedef void thread_func(void *);
 typedef int16_t pid_t;
 
+struct vdso_data;
+struct vm_area;
+
 /* 进程或线程状态 */
 enum task_status 
 {
@@ -92,6 +95,10 @@ struct task_struct
     uint32_t cwd_inode_nr;                          // 进程所在工作目录的inode编号
     pid_t parent_pid;                               // 父进程PID
     int8_t exit_status;                             // 进程结束调用exit传入的参数
+    struct vdso_data *vdso;                         // 用户进程的vdso页在内核中的虚拟地址
+    uint8_t *fpu_state;                             // FPU/SSE状态保存区，第一次使用FPU时才分配
+    struct vm_area *vm_areas;                       // 文件映射区表，第一次mmap时才分配
+    uint32_t journal_depth;                         // 进行中的元数据日志操作的嵌套层数
     uint32_t stack_magic;                           // 用于做栈的边界标记，用于检查栈溢出
 };
 
@@ -3,6 +3,10 @@
 
 #include "stdint.h"
 
+#define IRQ0_FREQUENCY      100         // 每秒时钟中断次数
+
+extern uint32_t ticks;
+
 void timer_init(void);
 void mtime_sleep(uint32_t m_seconds);
 
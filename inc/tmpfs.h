@@ -0,0 +1,41 @@
+#ifndef __FS_TMPFS_H
+#define __FS_TMPFS_H
+
+#include "stdint.h"
+#include "list.h"
+#include "inode.h"
+#include "dir.h"
+#include "fs.h"
+
+#define TMPFS_INO_BASE      MAX_FILES_PER_PART      // tmpfs的inode编号从这里开始，不和硬盘分区的重复
+#define TMPFS_NODES_MAX     1024                    // tmpfs中最多的文件和目录数
+#define TMPFS_PAGES_MAX     1024                    // tmpfs中文件数据最多占用的页数
+
+/* tmpfs中的一个文件或目录，全部在内核内存中。文件的数据就是inode页缓存中的页，
+   读写、mmap和sendfile都直接使用这些页，不对应任何硬盘块 */
+struct tmpfs_node
+{
+    struct inode inode;                 // 必须是第一个成员，i_flags带INODE_TMPFS
+    enum file_types type;
+    char name[MAX_FILE_NAME_LEN];       // 以0结尾，所以名字比硬盘上的少一个字符
+    struct tmpfs_node *parent;          // 根目录的parent为NULL
+    uint32_t up_ino;                    // 只用于根目录，挂载点所在的硬盘目录的inode号，根目录的..指向它
+    struct list children;               // 目录下的文件和子目录
+    struct list_elem child_tag;         // 用于parent->children
+};
+
+struct inode *tmpfs_mount(uint32_t up_ino);
+struct inode *tmpfs_escape(struct inode *base, const char *pathname, const char **up);
+int32_t tmpfs_open(struct inode *base, const char *pathname, uint8_t flags);
+int32_t tmpfs_unlink(struct inode *base, const char *pathname);
+int32_t tmpfs_mkdir(struct inode *base, const char *pathname);
+int32_t tmpfs_rmdir(struct inode *base, const char *pathname);
+struct dir *tmpfs_opendir(struct inode *base, const char *pathname);
+struct dir_entry *tmpfs_readdir(struct dir *dir);
+int32_t tmpfs_read_batch(struct dir *dir, struct dirent *buf, uint32_t count, uint32_t flags);
+int32_t tmpfs_stat(struct inode *base, const char *pathname, struct stat *buf);
+void tmpfs_statfs(struct statfs *buf);
+void tmpfs_read(struct inode *inode, uint32_t pos, void *buf, uint32_t count);
+int32_t tmpfs_write(struct inode *inode, uint32_t pos, const void *buf, uint32_t count);
+
+#endif
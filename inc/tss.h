@@ -4,6 +4,7 @@
 #include "thread.h"
 
 void update_tss_esp(struct task_struct *pthread);
+uint32_t tss_esp0_addr(void);
 void tss_init(void);
 
 #endif
@@ -0,0 +1,24 @@
+#ifndef __LIB_USER_VDSO_H
+#define __LIB_USER_VDSO_H
+
+#include "stdint.h"
+
+/* vdso页映射在每个用户进程中的固定虚拟地址，紧挨在USER_VADDR_START之下 */
+#define USER_VDSO_VADDR     0x8047000
+
+/* 内核与用户进程共享的只读数据页，内核在时钟中断和任务调度时维护 */
+struct vdso_data
+{
+    volatile uint32_t ticks;        // 自中断开启以来的滴答数
+    uint32_t hz;                    // 每秒的滴答数
+    volatile int16_t pid;           // 进程PID
+    volatile int16_t parent_pid;    // 父进程PID
+};
+
+#define VDSO    ((const struct vdso_data *)USER_VDSO_VADDR)
+
+int16_t getppid(void);
+uint32_t get_ticks(void);
+uint32_t uptime_ms(void);
+
+#endif
@@ -0,0 +1,165 @@
+#include "fpu.h"
+#include "cpu.h"
+#include "global.h"
+#include "memory.h"
+#include "string.h"
+#include "interrupt.h"
+#include "print.h"
+#include "debug.h"
+
+/* 浮点/SSE上下文采用延迟切换：任务切换时只置位CR0.TS，
+   任务第一次执行浮点或SSE指令时触发#NM，再在处理程序中保存上一个使用者的状态并恢复自己的 */
+
+int fpu_has_sse = 0;                        // 是否已开启SSE
+int fpu_has_sse2 = 0;                       // 是否支持SSE2
+static int fpu_has_fxsr = 0;                // 是否支持fxsave/fxrstor
+static struct task_struct *fpu_owner;       // 当前FPU寄存器中状态所属的任务
+
+/* 把FPU寄存器的状态保存到area */
+static void fpu_save(uint8_t *area)
+{
+    if (fpu_has_fxsr) asm volatile ("fxsave %0": "=m"(*area));
+    else asm volatile ("fnsave %0; fwait": "=m"(*area));
+}
+
+/* 从area恢复FPU寄存器的状态 */
+static void fpu_restore(uint8_t *area)
+{
+    if (fpu_has_fxsr) asm volatile ("fxrstor %0": :"m"(*area));
+    else asm volatile ("frstor %0": :"m"(*area));
+}
+
+/* 把当前FPU寄存器中的状态保存给它的所属任务 */
+static void fpu_flush_owner(void)
+{
+    if (fpu_owner != NULL)
+    {
+        fpu_save(fpu_owner->fpu_state);
+        fpu_owner = NULL;
+    }
+}
+
+/* #NM异常处理程序，为当前任务装入其FPU状态 */
+static void intr_fpu_handler(uint8_t vec_nr UNUSED)
+{
+    struct task_struct *cur = running_thread();
+    uint8_t *new_state = NULL;
+
+    /* 分配内存时的memset可能借用FPU，所以要在装入状态之前分配 */
+    if (cur->fpu_state == NULL)
+    {
+        new_state = get_kernel_pages(1);
+        if (new_state == NULL) PANIC("intr_fpu_handler: get_kernel_pages failed\n");
+    }
+
+    asm volatile ("clts");
+    if (fpu_owner == cur) return;
+
+    fpu_flush_owner();
+    if (new_state != NULL)
+    {
+        /* 第一次使用FPU，从初始状态开始 */
+        cur->fpu_state = new_state;
+        asm volatile ("fninit");
+        if (fpu_has_sse)
+        {
+            uint32_t mxcsr = 0x1f80;            // 屏蔽所有SIMD浮点异常
+            asm volatile ("ldmxcsr %0": :"m"(mxcsr));
+        }
+    }
+    else
+    {
+        fpu_restore(cur->fpu_state);
+    }
+    fpu_owner = cur;
+}
+
+/* 任务切换时调用，只有下一个任务就是FPU状态的所属者时才允许直接使用FPU */
+void fpu_switch(struct task_struct *next)
+{
+    uint32_t cr0 = read_cr0();
+    if (next == fpu_owner) cr0 &= ~CR0_TS;
+    else cr0 |= CR0_TS;
+    write_cr0(cr0);
+}
+
+/* fork时为子进程复制父进程的FPU状态，成功返回0，失败返回-1 */
+int32_t fpu_fork(struct task_struct *child, struct task_struct *parent)
+{
+    child->fpu_state = NULL;
+    if (parent->fpu_state == NULL) return 0;
+
+    /* 父进程的最新状态可能还在FPU寄存器中 */
+    if (fpu_owner == parent)
+    {
+        asm volatile ("clts");
+        fpu_save(parent->fpu_state);
+    }
+
+    child->fpu_state = get_kernel_pages(1);
+    if (child->fpu_state == NULL) return -1;
+    memcpy(child->fpu_state, parent->fpu_state, FPU_STATE_SIZE);
+    return 0;
+}
+
+/* 丢弃pthread的FPU状态并回收保存区，用于任务退出和exec */
+void fpu_release(struct task_struct *pthread)
+{
+    if (fpu_owner == pthread)
+    {
+        fpu_owner = NULL;
+        write_cr0(read_cr0() | CR0_TS);
+    }
+    if (pthread->fpu_state != NULL)
+    {
+        mfree_page(PF_KERNEL, pthread->fpu_state, 1);
+        pthread->fpu_state = NULL;
+    }
+}
+
+/* 内核借用FPU前调用，先把寄存器中的状态还给所属任务，并关闭中断防止被切换，
+   返回之前的中断状态，交给kernel_fpu_end恢复 */
+enum intr_status kernel_fpu_begin(void)
+{
+    enum intr_status old_status = intr_disable();
+    asm volatile ("clts");
+    fpu_flush_owner();
+    return old_status;
+}
+
+/* 内核使用完FPU，之后任何任务使用FPU都会触发#NM重新装入自己的状态 */
+void kernel_fpu_end(enum intr_status old_status)
+{
+    write_cr0(read_cr0() | CR0_TS);
+    intr_set_status(old_status);
+}
+
+/* 初始化FPU，支持时开启SSE */
+void fpu_init(void)
+{
+    put_str("fpu_init start...\n");
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    fpu_has_fxsr = (edx & CPUID_FEAT_EDX_FXSR) != 0;
+
+    /* 使用原生FPU，浮点错误通过#MF报告 */
+    uint32_t cr0 = read_cr0();
+    cr0 &= ~CR0_EM;
+    cr0 |= CR0_MP | CR0_NE;
+    write_cr0(cr0);
+    asm volatile ("clts; fninit");
+
+    if (fpu_has_fxsr && (edx & CPUID_FEAT_EDX_SSE))
+    {
+        write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+        fpu_has_sse = 1;
+        fpu_has_sse2 = (edx & CPUID_FEAT_EDX_SSE2) != 0;
+        put_str("    sse enabled\n");
+    }
+
+    /* 没有任何任务拥有FPU，第一次使用时触发#NM */
+    fpu_owner = NULL;
+    write_cr0(read_cr0() | CR0_TS);
+    register_handler(0x07, intr_fpu_handler);
+    put_str("fpu_init done.\n");
+}
@@ -10,13 +10,19 @@
 #include "syscall_init.h"
 #include "ide.h"
 #include "fs.h"
+#include "fpu.h"
+#include "mmap.h"
+#include "string.h"
 
 /* 初始化所有模块 */
 void init_all() 
 {
     put_str("init_all\n");
     idt_init();
+    fpu_init();
+    string_init();
     mem_init();
+    mmap_init();
     thread_init();
     timer_init();
     console_init();
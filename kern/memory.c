@@ -240,6 +240,30 @@ void *get_a_page_without_opvaddrbitmap(enum pool_flags pf, uint32_t vaddr)
     lock_release(&mem_pool->lock);
     return (void *)vaddr;
 }
+
+/* 在当前页表中把物理页pg_phy_addr映射到用户虚拟地址vaddr，writable为0时用户态只读 */
+void page_map_user(uint32_t vaddr, uint32_t pg_phy_addr, int writable)
+{
+    /* 页表本身可能需要从内核内存池中分配 */
+    lock_acquire(&kernel_pool.lock);
+    page_table_add((void *)vaddr, (void *)pg_phy_addr);
+    lock_release(&kernel_pool.lock);
+    if (!writable) *pte_ptr(vaddr) &= ~PG_RW_W;
+    asm volatile ("invlpg %0": :"m"(*(char *)vaddr): "memory");
+}
+
+/* 在当前页表中把物理页pg_phy_addr映射到用户虚拟地址vaddr，用户态只读 */
+void page_map_readonly(uint32_t vaddr, uint32_t pg_phy_addr)
+{
+    page_map_user(vaddr, pg_phy_addr, 0);
+}
+
+/* 去掉vaddr的映射，不释放物理页，物理页由映射的提供者管理 */
+void page_unmap(uint32_t vaddr)
+{
+    *pte_ptr(vaddr) = 0;
+    asm volatile ("invlpg %0": :"m"(*(char *)vaddr): "memory");
+}
     
 static void mem_pool_init(uint32_t all_mem)
 {
@@ -495,6 +519,43 @@ static void vaddr_remove(enum pool_flags pf, void *_vaddr, uint32_t pg_cnt)
     }
 }
 
+/* 在当前进程的虚拟地址池中申请pg_cnt个连续的虚拟页，不分配物理页 */
+void *get_user_vaddr(uint32_t pg_cnt)
+{
+    lock_acquire(&user_pool.lock);
+    void *vaddr = vaddr_get(PF_USER, pg_cnt);
+    lock_release(&user_pool.lock);
+    return vaddr;
+}
+
+/* 在当前进程中占用从vaddr开始的pg_cnt个虚拟页，用于固定地址的映射，
+   这些地址上原有的私有页，例如exec之前旧程序的页，会被释放 */
+void user_vaddr_claim(uint32_t vaddr, uint32_t pg_cnt)
+{
+    struct task_struct *cur = running_thread();
+    uint32_t bit_idx = (vaddr - cur->userproc_vaddr.vaddr_start) / PG_SIZE;
+    lock_acquire(&user_pool.lock);
+    while (pg_cnt-- > 0)
+    {
+        if ((*pde_ptr(vaddr) & PG_P_1) && (*pte_ptr(vaddr) & PG_P_1))
+        {
+            free_a_phy_page(*pte_ptr(vaddr) & 0xfffff000);
+            page_unmap(vaddr);
+        }
+        bitmap_set(&cur->userproc_vaddr.vaddr_bitmap, bit_idx++, 1);
+        vaddr += PG_SIZE;
+    }
+    lock_release(&user_pool.lock);
+}
+
+/* 归还get_user_vaddr申请的虚拟页 */
+void put_user_vaddr(void *vaddr, uint32_t pg_cnt)
+{
+    lock_acquire(&user_pool.lock);
+    vaddr_remove(PF_USER, vaddr, pg_cnt);
+    lock_release(&user_pool.lock);
+}
+
 /* 释放以vaddr为起始地址的cnt个物理页面 */
 void mfree_page(enum pool_flags pf, void *_vaddr, uint32_t pg_cnt)
 {
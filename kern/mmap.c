@@ -0,0 +1,298 @@
+#include "mmap.h"
+#include "page_cache.h"
+#include "memory.h"
+#include "interrupt.h"
+#include "string.h"
+#include "debug.h"
+#include "stdio_kern.h"
+#include "file.h"
+#include "fs.h"
+#include "pipe.h"
+#include "wait_exit.h"
+#include "print.h"
+#include "timer.h"
+
+/* 文件映射不在mmap时读入，进程第一次访问某页时触发#PF，
+   再把该页在页缓存中的物理页直接映射到进程，映射同一文件的进程共享这些物理页 */
+
+/* 查找pthread中包含vaddr的映射区，没有返回NULL */
+static struct vm_area *vm_area_find(struct task_struct *pthread, uint32_t vaddr)
+{
+    if (pthread->vm_areas == NULL) return NULL;
+    uint32_t area_idx = 0;
+    while (area_idx < VM_AREA_CNT)
+    {
+        struct vm_area *area = &pthread->vm_areas[area_idx];
+        if (area->inode != NULL && vaddr >= area->start && vaddr < area->start + area->pg_cnt * PG_SIZE) return area;
+        area_idx++;
+    }
+    return NULL;
+}
+
+/* vaddr所在的页在当前页表中是否有映射 */
+static int page_present(uint32_t vaddr)
+{
+    return (*pde_ptr(vaddr) & PG_P_1) && (*pte_ptr(vaddr) & PG_P_1);
+}
+
+/* 撤销当前进程中映射区area的所有映射，可写的映射把修改写回文件，并释放映射区 */
+static void vm_area_unmap(struct vm_area *area)
+{
+    uint32_t pg_idx = 0;
+    while (pg_idx < area->pg_cnt)
+    {
+        uint32_t vaddr = area->start + pg_idx * PG_SIZE;
+        if (page_present(vaddr))
+        {
+            struct cache_page *pg = page_cache_lookup(area->inode, area->pg_off + pg_idx);
+            ASSERT(pg != NULL && pg->map_cnt > 0);
+            pg->map_cnt--;
+            page_unmap(vaddr);
+        }
+        pg_idx++;
+    }
+
+    if (area->prot & PROT_WRITE) page_cache_writeback(area->inode, 0);
+    put_user_vaddr((void *)area->start, area->pg_cnt);
+    inode_close(area->inode);
+    area->inode = NULL;
+}
+
+/* 在当前进程的映射区表中找一个空闲项，表还没分配时先分配，失败返回NULL */
+static struct vm_area *vm_area_alloc(struct task_struct *cur)
+{
+    if (cur->vm_areas == NULL)
+    {
+        cur->vm_areas = get_kernel_pages(1);
+        if (cur->vm_areas == NULL) return NULL;
+    }
+    uint32_t area_idx = 0;
+    while (area_idx < VM_AREA_CNT)
+    {
+        if (cur->vm_areas[area_idx].inode == NULL) return &cur->vm_areas[area_idx];
+        area_idx++;
+    }
+    return NULL;
+}
+
+/* 把文件映射到当前进程的用户空间，成功返回映射的起始地址，失败返回NULL */
+void *sys_mmap(const struct mmap_args *args)
+{
+    struct task_struct *cur = running_thread();
+    int32_t fd = args->fd;
+
+    if (args->length == 0 || args->offset % PG_SIZE != 0)
+    {
+        printk("sys_mmap: length must not be 0 and offset must be page aligned\n");
+        return NULL;
+    }
+    if (args->flags != MAP_SHARED && args->flags != MAP_PRIVATE)
+    {
+        printk("sys_mmap: flags must be MAP_SHARED or MAP_PRIVATE\n");
+        return NULL;
+    }
+    /* 私有映射需要写时复制，目前只支持只读的私有映射 */
+    if (args->flags == MAP_PRIVATE && args->prot & PROT_WRITE)
+    {
+        printk("sys_mmap: writable private mapping is not supported\n");
+        return NULL;
+    }
+    if (fd <= stderr_no || fd >= MAX_FILES_OPEN_PER_PROC || cur->fd_table[fd] == -1 || is_pipe(fd))
+    {
+        printk("sys_mmap: fd %d is not a regular file\n", fd);
+        return NULL;
+    }
+
+    /* 映射要求文件可读，可写的映射还要求文件可写 */
+    struct file *file = &file_table[fd_local2global(fd)];
+    uint32_t access = file->fd_flag & (O_WRONLY | O_RDWR);
+    if (access == O_WRONLY || (args->prot & PROT_WRITE && access != O_RDWR))
+    {
+        printk("sys_mmap: fd %d is not opened with the required access\n", fd);
+        return NULL;
+    }
+
+    /* 压缩的文件写入时要重新压缩整块，只支持只读的映射 */
+    if (args->prot & PROT_WRITE && file->fd_inode->i_flags & INODE_COMPRESSED)
+    {
+        printk("sys_mmap: writable mapping of compressed file is not supported\n");
+        return NULL;
+    }
+
+    struct vm_area *area = vm_area_alloc(cur);
+    if (area == NULL)
+    {
+        printk("sys_mmap: too many mappings\n");
+        return NULL;
+    }
+
+    uint32_t pg_cnt = DIV_ROUND_UP(args->length, PG_SIZE);
+    void *vaddr = get_user_vaddr(pg_cnt);
+    if (vaddr == NULL) return NULL;
+
+    /* 映射区持有inode，关闭文件后映射依然有效 */
+    file->fd_inode->i_open_cnts++;
+
+    area->start = (uint32_t)vaddr;
+    area->pg_cnt = pg_cnt;
+    area->inode = file->fd_inode;
+    area->pg_off = args->offset / PG_SIZE;
+    area->prot = args->prot;
+    return vaddr;
+}
+
+/* exec时把程序文件inode从第pg_off页开始的pg_cnt页只读映射到固定地址vaddr，
+   运行同一程序的进程共享页缓存中的代码页，成功返回0，失败返回-1 */
+int32_t mmap_text(struct inode *inode, uint32_t vaddr, uint32_t pg_cnt, uint32_t pg_off)
+{
+    struct vm_area *area = vm_area_alloc(running_thread());
+    if (area == NULL) return -1;
+
+    user_vaddr_claim(vaddr, pg_cnt);
+    inode->i_open_cnts++;
+
+    area->start = vaddr;
+    area->pg_cnt = pg_cnt;
+    area->inode = inode;
+    area->pg_off = pg_off;
+    area->prot = PROT_READ;
+    return 0;
+}
+
+/* 撤销mmap建立的映射，addr和length必须是一次mmap的整个映射区，成功返回0，失败返回-1 */
+int32_t sys_munmap(void *addr, uint32_t length)
+{
+    struct vm_area *area = vm_area_find(running_thread(), (uint32_t)addr);
+    if (area == NULL || area->start != (uint32_t)addr || area->pg_cnt != DIV_ROUND_UP(length, PG_SIZE))
+    {
+        printk("sys_munmap: only a whole mapping can be unmapped\n");
+        return -1;
+    }
+    vm_area_unmap(area);
+    return 0;
+}
+
+/* 处理当前进程对vaddr的缺页，vaddr在映射区内时装入文件页，成功返回0，
+   不是映射区内的缺页或访问超出文件末尾返回-1 */
+int32_t mmap_fault(struct task_struct *cur, uint32_t vaddr)
+{
+    struct vm_area *area = vm_area_find(cur, vaddr);
+    if (area == NULL) return -1;
+
+    /* 页已经映射还产生异常，说明是写只读的映射 */
+    uint32_t pg_vaddr = vaddr & 0xfffff000;
+    if (page_present(pg_vaddr)) return -1;
+
+    uint32_t pg_idx = area->pg_off + (pg_vaddr - area->start) / PG_SIZE;
+    if (pg_idx * PG_SIZE >= area->inode->i_size) return -1;
+
+    struct cache_page *pg = page_cache_get(area->inode, pg_idx);
+    if (pg == NULL) return -1;
+
+    /* 不跟踪用户对页的写入，可写的映射从装入起就视为被修改 */
+    int writable = area->prot & PROT_WRITE;
+    page_map_user(pg_vaddr, addr_v2p((uint32_t)pg->kvaddr), writable);
+    if (writable && !pg->dirty)
+    {
+        pg->dirty = 1;
+        pg->dirty_ticks = ticks;
+    }
+    pg->map_cnt++;
+    return 0;
+}
+
+/* 把缓冲区[buf, buf + len)中落在映射区内、还没有装入的页预先装入。硬盘直接读写用户缓冲区之前调用，
+   否则传输途中缺页时page_cache_get会在持有通道锁的情况下向同一通道发出新命令。
+   write为1表示缓冲区会被写入，此时不允许只读的映射区。成功返回0，失败返回-1 */
+int32_t mmap_prefault(const void *buf, uint32_t len, int write)
+{
+    struct task_struct *cur = running_thread();
+    if (cur->vm_areas == NULL || len == 0) return 0;
+
+    uint32_t vaddr = (uint32_t)buf & 0xfffff000;
+    uint32_t end = (uint32_t)buf + len;
+    while (vaddr < end)
+    {
+        struct vm_area *area = vm_area_find(cur, vaddr);
+        if (area != NULL)
+        {
+            if (write && !(area->prot & PROT_WRITE)) return -1;
+            if (!page_present(vaddr) && mmap_fault(cur, vaddr) == -1) return -1;
+        }
+        vaddr += PG_SIZE;
+    }
+    return 0;
+}
+
+/* vaddr是否在pthread的某个映射区内 */
+int mmap_contains(struct task_struct *pthread, uint32_t vaddr)
+{
+    return vm_area_find(pthread, vaddr) != NULL;
+}
+
+/* fork时子进程继承父进程的所有映射区，子进程的页表为空，访问时再缺页装入，成功返回0，失败返回-1 */
+int32_t mmap_fork(struct task_struct *child, struct task_struct *parent)
+{
+    child->vm_areas = NULL;
+    if (parent->vm_areas == NULL) return 0;
+
+    child->vm_areas = get_kernel_pages(1);
+    if (child->vm_areas == NULL) return -1;
+    memcpy(child->vm_areas, parent->vm_areas, PG_SIZE);
+
+    uint32_t area_idx = 0;
+    while (area_idx < VM_AREA_CNT)
+    {
+        if (child->vm_areas[area_idx].inode != NULL) child->vm_areas[area_idx].inode->i_open_cnts++;
+        area_idx++;
+    }
+    return 0;
+}
+
+/* 撤销pthread的所有映射区，用于进程退出和exec，必须在pthread自己的页表下调用 */
+void mmap_release(struct task_struct *pthread)
+{
+    if (pthread->vm_areas == NULL) return;
+    uint32_t area_idx = 0;
+    while (area_idx < VM_AREA_CNT)
+    {
+        if (pthread->vm_areas[area_idx].inode != NULL) vm_area_unmap(&pthread->vm_areas[area_idx]);
+        area_idx++;
+    }
+    mfree_page(PF_KERNEL, pthread->vm_areas, 1);
+    pthread->vm_areas = NULL;
+}
+
+/* #PF错误码中的U/S位，置1表示异常发生在用户态 */
+#define PF_ERR_USER     4
+
+/* #PF异常处理程序，映射区内的缺页装入文件页，用户态的非法访问结束该进程，
+   内核态的非法访问一律PANIC，此时可能持有各种锁，不能在这里退出进程 */
+static void intr_page_fault_handler(uint8_t vec_nr UNUSED)
+{
+    /* cr2中是引起缺页的地址，要在可能再次缺页之前读出 */
+    uint32_t fault_vaddr;
+    asm volatile ("movl %%cr2, %0": "=r"(fault_vaddr));
+
+    /* intr_entry压入中断号后调用本函数，参数所在的位置就是struct intr_stack的开头 */
+    struct intr_stack *frame = (struct intr_stack *)((uint32_t)__builtin_frame_address(0) + 8);
+
+    struct task_struct *cur = running_thread();
+    if (mmap_fault(cur, fault_vaddr) == 0) return;
+
+    if (frame->err_code & PF_ERR_USER)
+    {
+        printk("%s: page fault at 0x%x, killed\n", cur->name, fault_vaddr);
+        sys_exit(-1);
+    }
+    printk("page fault addr is 0x%x\n", fault_vaddr);
+    PANIC("intr_page_fault_handler: page fault in kernel");
+}
+
+/* 注册#PF异常处理程序 */
+void mmap_init(void)
+{
+    put_str("mmap_init start...\n");
+    register_handler(0x0e, intr_page_fault_handler);
+    put_str("mmap_init done.\n");
+}
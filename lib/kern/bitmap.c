@@ -4,10 +4,14 @@
 #include "interrupt.h"
 #include "debug.h"
 
+/* 位图按32位字扫描，第n位位于第n/8个字节的第n%8位，
+   在小端序的x86上恰好就是第n/32个字的第n%32位 */
+
 /* 将位图初始化 */
 void bitmap_init(struct bitmap *btmp)
 {
     memset(btmp->bits, 0, btmp->btmp_bytes_len);
+    btmp->hint = 0;
 }
 
 /* 判断bit_idx位是否位1，若为1返回非0，否则返回0 */
@@ -20,48 +24,116 @@ int bitmap_scan_test(struct bitmap *btmp, uint32_t bit_idx)
     return (btmp->bits[byte_idx] & (BITMAP_MASK << bit_odd));
 }
 
-/* 在位图中申请连续cnt个位，成功则返回其起始下标，失败返回-1 */
-int bitmap_scan(struct bitmap *btmp, uint32_t cnt)
+/* 返回x中最低的为1的位的下标，x不能为0 */
+static inline uint32_t bit_first_one(uint32_t x)
+{
+    uint32_t idx;
+    asm ("bsfl %1, %0": "=r"(idx): "rm"(x));
+    return idx;
+}
+
+/* 读取位图的第word_idx个32位字，位图长度不是4的倍数时，末尾不存在的字节当作全1 */
+static uint32_t bitmap_word(struct bitmap *btmp, uint32_t word_idx)
 {
-    uint32_t idx_byte = 0;
-    /* 先逐个字节比较 */
-    while ((0xff == btmp->bits[idx_byte]) && (idx_byte < btmp->btmp_bytes_len)) idx_byte++;
+    uint32_t byte_idx = word_idx << 2;
+    if (byte_idx + 4 <= btmp->btmp_bytes_len) return *(uint32_t *)(btmp->bits + byte_idx);
 
-    ASSERT(idx_byte < btmp->btmp_bytes_len);
-    if (idx_byte == btmp->btmp_bytes_len)           // 找不到可用空间
+    uint32_t word = 0xffffffff;
+    uint32_t i = 0;
+    while (byte_idx + i < btmp->btmp_bytes_len)
     {
-        return -1;
+        word &= ~(0xffu << (i * 8));
+        word |= (uint32_t)btmp->bits[byte_idx + i] << (i * 8);
+        i++;
     }
+    return word;
+}
 
-    /* 在某个字节的位中找到空闲位置，逐位比较那个是空闲位 */
-    int idx_bit = 0;
-    while ((uint8_t)(BITMAP_MASK << idx_bit) & btmp->bits[idx_byte]) idx_bit++;
-    
-    // int bit_idx_start = idx_byte * 8 + idx_bit;
-    int bit_idx_start = (idx_byte << 3) + idx_bit;
-    if (cnt == 1)
+/* 从start位开始查找第一个值为value的位，找不到返回-1 */
+static int bitmap_find_next(struct bitmap *btmp, uint32_t start, int value)
+{
+    uint32_t bits_len = btmp->btmp_bytes_len << 3;
+    if (start >= bits_len) return -1;
+
+    uint32_t words_len = DIV_ROUND_UP(btmp->btmp_bytes_len, 4);
+    uint32_t word_idx = start >> 5;
+    /* 统一成找1，第一个字中start之前的位屏蔽掉 */
+    uint32_t word = bitmap_word(btmp, word_idx);
+    if (!value) word = ~word;
+    word &= 0xffffffff << (start & 31);
+
+    while (word == 0)
     {
-        return bit_idx_start;
+        if (++word_idx == words_len) return -1;
+        word = bitmap_word(btmp, word_idx);
+        if (!value) word = ~word;
     }
 
-    uint32_t bit_left = ((btmp->btmp_bytes_len << 3) - bit_idx_start);   
-    uint32_t next_bit = bit_idx_start + 1;
-    uint32_t count = 1;
+    uint32_t bit_idx = (word_idx << 5) + bit_first_one(word);
+    return bit_idx < bits_len ? (int)bit_idx : -1;
+}
 
-    bit_idx_start = -1;
-    while (bit_left-- > 0)
-    {
-        if (!(bitmap_scan_test(btmp, next_bit))) count++;       // 如果下一位为0
-        else count = 0;
+/* 从start位开始查找第一个空闲位，找不到返回-1 */
+int bitmap_find_next_zero(struct bitmap *btmp, uint32_t start)
+{
+    return bitmap_find_next(btmp, start, 0);
+}
+
+/* 从start位开始查找第一个已占用的位，找不到返回-1 */
+int bitmap_find_next_set(struct bitmap *btmp, uint32_t start)
+{
+    return bitmap_find_next(btmp, start, 1);
+}
 
-        if (count == cnt) 
+/* 统计位图中空闲位的个数 */
+uint32_t bitmap_count_zero(struct bitmap *btmp)
+{
+    uint32_t words_len = DIV_ROUND_UP(btmp->btmp_bytes_len, 4);
+    uint32_t word_idx = 0, cnt = 0;
+    while (word_idx < words_len)
+    {
+        uint32_t word = ~bitmap_word(btmp, word_idx);
+        /* 每次清掉最低的1 */
+        while (word)
         {
-            bit_idx_start = next_bit - cnt + 1;
-            break;
+            word &= word - 1;
+            cnt++;
         }
-        next_bit++;
+        word_idx++;
     }
-    return bit_idx_start;
+    return cnt;
+}
+
+/* 从start位开始查找连续cnt个空闲位，返回其起始下标，找不到返回-1，
+   每次跳过一整段空闲位或已占用位，不逐位测试 */
+int bitmap_find_next_zero_run(struct bitmap *btmp, uint32_t start, uint32_t cnt)
+{
+    uint32_t bits_len = btmp->btmp_bytes_len << 3;
+    int run_start = bitmap_find_next(btmp, start, 0);
+    while (run_start != -1)
+    {
+        int run_end = bitmap_find_next(btmp, run_start, 1);
+        if (run_end == -1) run_end = bits_len;
+        if ((uint32_t)(run_end - run_start) >= cnt) return run_start;
+        run_start = bitmap_find_next(btmp, run_end, 0);
+    }
+    return -1;
+}
+
+/* 在位图中申请连续cnt个位，成功则返回其起始下标，失败返回-1，
+   hint之前的位都已被占用，从hint开始查找，结果和从头查找相同 */
+int bitmap_scan(struct bitmap *btmp, uint32_t cnt)
+{
+    int first_zero = bitmap_find_next_zero(btmp, btmp->hint);
+    if (first_zero == -1)
+    {
+        btmp->hint = btmp->btmp_bytes_len << 3;
+        return -1;
+    }
+    btmp->hint = first_zero;
+
+    if (cnt == 1) return first_zero;
+    return bitmap_find_next_zero_run(btmp, first_zero, cnt);
 }
 
 /* 将位图btmp的bit_idx位置为value */
@@ -72,5 +144,10 @@ void bitmap_set(struct bitmap *btmp, uint32_t bit_idx, int8_t value)
     uint32_t bit_odd = bit_idx & 0x00000007;
     
     if (value) btmp->bits[byte_idx] |= (BITMAP_MASK << bit_odd);
-    else btmp->bits[byte_idx] &= ~(uint8_t)(BITMAP_MASK << bit_odd);
+    else
+    {
+        btmp->bits[byte_idx] &= ~(uint8_t)(BITMAP_MASK << bit_odd);
+        /* 释放的位在hint之前，下次从这里开始查找 */
+        if (bit_idx < btmp->hint) btmp->hint = bit_idx;
+    }
 }
@@ -0,0 +1,157 @@
+#include "lz4.h"
+#include "string.h"
+#include "global.h"
+
+/* LZ4块格式：由若干序列组成，每个序列是一个token，高4位是字面量长度，低4位是匹配长度减4，
+   等于15时后面跟着若干字节继续累加长度，每字节255表示还有下一字节；
+   token之后是字面量，再之后是2字节小端的匹配距离。最后一个序列只有字面量 */
+
+#define LZ4_MINMATCH        4
+#define LZ4_MFLIMIT         12          // 最后一个匹配必须在距离结尾12字节之前开始
+#define LZ4_LASTLITERALS    5           // 最后5个字节总是字面量
+#define LZ4_MAX_DISTANCE    65535
+
+static uint32_t lz4_read32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t lz4_hash(uint32_t seq)
+{
+    return (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/* 写入超过15的长度len - 15 */
+static uint8_t *lz4_put_len(uint8_t *op, uint32_t len)
+{
+    while (len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+/* 输出一个序列，match_len为0表示最后一个只有字面量的序列，dst放不下时返回NULL */
+static uint8_t *lz4_put_seq(uint8_t *op, uint8_t *oend, const uint8_t *lit, uint32_t lit_len, uint32_t distance, uint32_t match_len)
+{
+    if (op + 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1 > oend) return NULL;
+
+    uint8_t *token = op++;
+    *token = (lit_len >= 15 ? 15 : lit_len) << 4;
+    if (lit_len >= 15) op = lz4_put_len(op, lit_len - 15);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len == 0) return op;
+
+    *op++ = distance & 0xff;
+    *op++ = distance >> 8;
+    match_len -= LZ4_MINMATCH;
+    *token |= match_len >= 15 ? 15 : match_len;
+    if (match_len >= 15) op = lz4_put_len(op, match_len - 15);
+    return op;
+}
+
+/* 把src中的src_len个字节压缩到dst，src_len不能超过65535，hash_table是LZ4_HASH_SIZE项的工作区，
+   成功返回压缩后的字节数，超过dst_cap返回-1 */
+int32_t lz4_compress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint16_t *hash_table)
+{
+    const uint8_t *ip = src, *anchor = src;
+    const uint8_t *iend = src + src_len;
+    uint8_t *op = dst, *oend = dst + dst_cap;
+
+    /* 表项存放位置加1，0表示空 */
+    memset(hash_table, 0, LZ4_HASH_SIZE * sizeof(uint16_t));
+    if (src_len > LZ4_MFLIMIT)
+    {
+        const uint8_t *mflimit = iend - LZ4_MFLIMIT;
+        const uint8_t *matchlimit = iend - LZ4_LASTLITERALS;
+        while (ip < mflimit)
+        {
+            uint32_t seq = lz4_read32(ip);
+            uint32_t h = lz4_hash(seq);
+            uint32_t ref_pos = hash_table[h];
+            hash_table[h] = ip - src + 1;
+            const uint8_t *ref = src + ref_pos - 1;
+            if (ref_pos == 0 || ip - ref > LZ4_MAX_DISTANCE || lz4_read32(ref) != seq)
+            {
+                ip++;
+                continue;
+            }
+
+            /* 向后扩展匹配 */
+            uint32_t distance = ip - ref;
+            const uint8_t *match_end = ip + LZ4_MINMATCH;
+            while (match_end < matchlimit && *match_end == *(match_end - distance)) match_end++;
+
+            op = lz4_put_seq(op, oend, anchor, ip - anchor, distance, match_end - ip);
+            if (op == NULL) return -1;
+            ip = anchor = match_end;
+        }
+    }
+
+    op = lz4_put_seq(op, oend, anchor, iend - anchor, 0, 0);
+    if (op == NULL) return -1;
+    return op - dst;
+}
+
+/* 读取超过15的长度，越过src末尾返回-1 */
+static int32_t lz4_get_len(const uint8_t **ip, const uint8_t *iend)
+{
+    int32_t len = 0;
+    uint8_t byte;
+    do
+    {
+        if (*ip >= iend) return -1;
+        byte = *(*ip)++;
+        len += byte;
+    } while (byte == 255);
+    return len;
+}
+
+/* 把src中src_len字节的压缩数据解压到dst，成功返回解压后的字节数，数据损坏或超过dst_cap返回-1 */
+int32_t lz4_decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap)
+{
+    const uint8_t *ip = src, *iend = src + src_len;
+    uint8_t *op = dst, *oend = dst + dst_cap;
+
+    while (ip < iend)
+    {
+        uint8_t token = *ip++;
+        int32_t lit_len = token >> 4;
+        if (lit_len == 15)
+        {
+            int32_t extra = lz4_get_len(&ip, iend);
+            if (extra == -1) return -1;
+            lit_len += extra;
+        }
+        if (ip + lit_len > iend || op + lit_len > oend) return -1;
+        memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+
+        /* 最后一个序列没有匹配 */
+        if (ip == iend) break;
+
+        if (ip + 2 > iend) return -1;
+        uint32_t distance = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (distance == 0 || distance > (uint32_t)(op - dst)) return -1;
+
+        int32_t match_len = token & 15;
+        if (match_len == 15)
+        {
+            int32_t extra = lz4_get_len(&ip, iend);
+            if (extra == -1) return -1;
+            match_len += extra;
+        }
+        match_len += LZ4_MINMATCH;
+        if (op + match_len > oend) return -1;
+
+        /* 匹配可能与输出重叠，逐字节复制 */
+        const uint8_t *match = op - distance;
+        while (match_len-- > 0) *op++ = *match++;
+    }
+    return op - dst;
+}
@@ -1,27 +1,167 @@
 #include "string.h"
 #include "global.h"
 #include "debug.h"
+#include "cpu.h"
+#include "fpu.h"
 
-void memset(void *dst_, uint8_t value, uint32_t size) 
+#define SSE2_MIN_SIZE   512         // 小于此长度时保存FPU状态的开销大于SSE2带来的收益
+
+static int string_sse2 = 0;         // 是否使用SSE2版本，由string_init根据CPUID选择
+
+/* 检查32位字中是否有为0的字节 */
+#define HAS_ZERO_BYTE(V)    (((V) - 0x01010101) & ~(V) & 0x80808080)
+
+/* 调用者是否运行在0特权级 */
+static inline int in_kernel(void)
+{
+    uint32_t cs;
+    asm volatile ("movl %%cs, %0": "=r"(cs));
+    return (cs & 3) == 0;
+}
+
+/* 使用rep stosd填充，先按字节对齐dst */
+void memset_rep(void *dst_, uint8_t value, uint32_t size)
 {
-    ASSERT(dst_ != NULL);
     uint8_t *dst = (uint8_t *)dst_;
+    while (size > 0 && ((uint32_t)dst & 3))
+    {
+        *dst++ = value;
+        size--;
+    }
+
+    uint32_t pattern = value * 0x01010101;
+    uint32_t dwords = size >> 2;
+    asm volatile ("cld; rep stosl": "+D"(dst), "+c"(dwords): "a"(pattern): "memory");
+    size &= 3;
     while (size-- > 0) *dst++ = value;
 }
 
-void memcpy(void *dst_, const void *src_, uint32_t size)
+/* 使用rep movsd复制，先按字节对齐dst */
+void memcpy_rep(void *dst_, const void *src_, uint32_t size)
 {
-    ASSERT(dst_ != NULL && src_ != NULL);
     uint8_t *dst = (uint8_t *)dst_;
     const uint8_t *src = (const uint8_t *)src_;
+    while (size > 0 && ((uint32_t)dst & 3))
+    {
+        *dst++ = *src++;
+        size--;
+    }
+
+    uint32_t dwords = size >> 2;
+    asm volatile ("cld; rep movsl": "+D"(dst), "+S"(src), "+c"(dwords): : "memory");
+    size &= 3;
     while (size-- > 0) *dst++ = *src++;
 }
 
+/* 使用SSE2填充，调用前必须已经可以使用xmm寄存器 */
+static void memset_sse2_body(uint8_t *dst, uint8_t value, uint32_t size)
+{
+    while (size > 0 && ((uint32_t)dst & 15))
+    {
+        *dst++ = value;
+        size--;
+    }
+
+    uint32_t pattern = value * 0x01010101;
+    uint32_t blocks = size >> 6;
+    asm volatile ("movd %0, %%xmm0; pshufd $0, %%xmm0, %%xmm0": :"r"(pattern));
+    while (blocks-- > 0)
+    {
+        asm volatile ("movdqa %%xmm0, (%0); movdqa %%xmm0, 16(%0);"
+                      "movdqa %%xmm0, 32(%0); movdqa %%xmm0, 48(%0)": :"r"(dst): "memory");
+        dst += 64;
+    }
+    memset_rep(dst, value, size & 63);
+}
+
+/* 使用SSE2复制，每次64字节，dst按16字节对齐，src不要求对齐 */
+static void memcpy_sse2_body(uint8_t *dst, const uint8_t *src, uint32_t size)
+{
+    while (size > 0 && ((uint32_t)dst & 15))
+    {
+        *dst++ = *src++;
+        size--;
+    }
+
+    uint32_t blocks = size >> 6;
+    while (blocks-- > 0)
+    {
+        asm volatile ("movdqu (%1), %%xmm0; movdqu 16(%1), %%xmm1;"
+                      "movdqu 32(%1), %%xmm2; movdqu 48(%1), %%xmm3;"
+                      "movdqa %%xmm0, (%0); movdqa %%xmm1, 16(%0);"
+                      "movdqa %%xmm2, 32(%0); movdqa %%xmm3, 48(%0)": :"r"(dst), "r"(src): "memory");
+        dst += 64;
+        src += 64;
+    }
+    memcpy_rep(dst, src, size & 63);
+}
+
+/* SSE2版本的memset，内核中使用时要先借用FPU，
+   用户态按调用约定xmm寄存器都由调用者保存，可以直接使用 */
+void memset_sse2(void *dst_, uint8_t value, uint32_t size)
+{
+    if (in_kernel())
+    {
+        enum intr_status old_status = kernel_fpu_begin();
+        memset_sse2_body(dst_, value, size);
+        kernel_fpu_end(old_status);
+    }
+    else
+    {
+        memset_sse2_body(dst_, value, size);
+    }
+}
+
+/* SSE2版本的memcpy */
+void memcpy_sse2(void *dst_, const void *src_, uint32_t size)
+{
+    if (in_kernel())
+    {
+        enum intr_status old_status = kernel_fpu_begin();
+        memcpy_sse2_body(dst_, src_, size);
+        kernel_fpu_end(old_status);
+    }
+    else
+    {
+        memcpy_sse2_body(dst_, src_, size);
+    }
+}
+
+/* 根据CPU特性选择字符串函数的实现，在fpu_init之后调用 */
+void string_init(void)
+{
+    string_sse2 = fpu_has_sse2;
+}
+
+/* 是否选择了SSE2版本 */
+int string_sse2_enabled(void)
+{
+    return string_sse2;
+}
+
+void memset(void *dst_, uint8_t value, uint32_t size) 
+{
+    if (string_sse2 && size >= SSE2_MIN_SIZE) memset_sse2(dst_, value, size);
+    else memset_rep(dst_, value, size);
+}
+
+void memcpy(void *dst_, const void *src_, uint32_t size)
+{
+    if (string_sse2 && size >= SSE2_MIN_SIZE) memcpy_sse2(dst_, src_, size);
+    else memcpy_rep(dst_, src_, size);
+}
+
 int memcmp(const void *a_, const void *b_, uint32_t size)
 {
     const char *a = a_;
     const char *b = b_;
-    ASSERT(a != NULL && b != NULL);
+    /* 先按4字节比较跳过相同的部分，不同的字由下面逐字节确定大小 */
+    while (size >= 4 && *(const uint32_t *)a == *(const uint32_t *)b)
+    {
+        a += 4;
+        b += 4;
+        size -= 4;
+    }
     while (size-- > 0)
     {
         if (*a != *b) return *a > *b ? 1 : -1;
@@ -41,15 +181,33 @@ char *strcpy(char *dst_, const char *src_)
 
 uint32_t strlen(const char *str)
 {
-    ASSERT(str != NULL);
     const char *p = str;
-    while (*p++);
-    return (p - str -1);
+    /* 先逐字节走到4字节对齐，对齐的字不会跨页，可以安全地整字读取 */
+    while ((uint32_t)p & 3)
+    {
+        if (*p == 0) return p - str;
+        p++;
+    }
+    while (!HAS_ZERO_BYTE(*(const uint32_t *)p)) p += 4;
+    while (*p) p++;
+    return p - str;
 }
 
 int8_t strcmp(const char *a, const char *b)
 {
-    ASSERT(a != NULL && b != NULL);
+    /* 两个字符串对齐方式相同时，对齐后按4字节比较，直到遇到不同或含0的字 */
+    if (((uint32_t)a & 3) == ((uint32_t)b & 3))
+    {
+        while (((uint32_t)a & 3) && *a != 0 && *a == *b) { a++; b++; }
+        if (((uint32_t)a & 3) == 0)
+        {
+            while (*(const uint32_t *)a == *(const uint32_t *)b && !HAS_ZERO_BYTE(*(const uint32_t *)a))
+            {
+                a += 4;
+                b += 4;
+            }
+        }
+    }
     while (*a != 0 && *a == *b) { a++; b++; }
     return *a < *b ? -1 : *a > *b;
 }
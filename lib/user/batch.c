@@ -0,0 +1,50 @@
+#include "batch.h"
+#include "syscall.h"
+#include "string.h"
+#include "global.h"
+
+/* 初始化提交/完成环 */
+void batch_init(struct batch_ring *ring)
+{
+    memset(ring, 0, sizeof(struct batch_ring));
+}
+
+/* 获取一个空闲的提交队列项，队列满返回NULL */
+struct batch_sqe *batch_get_sqe(struct batch_ring *ring)
+{
+    if (ring->sq_tail - ring->sq_head == BATCH_ENTRIES) return NULL;
+    struct batch_sqe *sqe = &ring->sqes[ring->sq_tail & BATCH_MASK];
+    memset(sqe, 0, sizeof(struct batch_sqe));
+    /* 内核只在batch_enter中读取提交队列，可以提前推进sq_tail */
+    ring->sq_tail++;
+    return sqe;
+}
+
+/* 填写一个提交队列项 */
+void batch_prep_rw(struct batch_sqe *sqe, uint8_t opcode, int32_t fd, void *addr, uint32_t len, uint32_t user_data)
+{
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = addr;
+    sqe->len = len;
+    sqe->user_data = user_data;
+}
+
+/* 执行所有排队的操作，返回后结果都在完成队列中，返回执行的项数 */
+int32_t batch_submit(struct batch_ring *ring)
+{
+    return batch_enter(ring, ring->sq_tail - ring->sq_head);
+}
+
+/* 查看最早的完成队列项，没有返回NULL */
+struct batch_cqe *batch_peek_cqe(struct batch_ring *ring)
+{
+    if (ring->cq_head == ring->cq_tail) return NULL;
+    return &ring->cqes[ring->cq_head & BATCH_MASK];
+}
+
+/* 标记最早的完成队列项已处理 */
+void batch_cqe_seen(struct batch_ring *ring)
+{
+    ring->cq_head++;
+}
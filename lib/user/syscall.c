@@ -1,55 +1,81 @@
 #include "syscall.h"
 #include "thread.h"
 #include "fs.h"
+#include "vdso.h"
 
-/* 无参数系统调用 */
-#define _syscall0(NUMBER)                           \
+/* 系统调用入口桩，eax为子功能号，ebx、ecx、edx依次为参数，返回值在eax中
+   syscall_int80走中断门；syscall_sysenter走快速系统调用，
+   #2、#3参数和ebp压入用户栈，由内核通过ebp取出，sysexit返回到sysenter_ret */
+asm (
+    ".text\n"
+    ".globl syscall_int80\n"
+    "syscall_int80:\n"
+    "    int $0x80\n"
+    "    ret\n"
+    ".globl syscall_sysenter\n"
+    "syscall_sysenter:\n"
+    "    pushl %eax\n"
+    "    movl %cs, %eax\n"
+    "    testl $3, %eax\n"
+    "    popl %eax\n"
+    "    jz syscall_int80\n"        /* 0特权级的调用者（如main线程）不能用sysexit返回 */
+    "    pushl %ebp\n"
+    "    pushl %edx\n"
+    "    pushl %ecx\n"
+    "    movl %esp, %ebp\n"
+    "    sysenter\n"
+    ".globl sysenter_ret\n"
+    "sysenter_ret:\n"
+    "    popl %ecx\n"
+    "    popl %edx\n"
+    "    popl %ebp\n"
+    "    ret\n"
+);
+
+/* 当前使用的系统调用入口，syscall_init检测到cpu支持sysenter后切换为syscall_sysenter */
+syscall_stub *syscall_entry = syscall_int80;
+
+/* 通过入口桩ENTRY发起系统调用 */
+#define _syscall_via(ENTRY, NUMBER, ARG1, ARG2, ARG3)   \
 ({                                                  \
     int retval;                                     \
-    asm volatile ("int $0x80"                       \
+    asm volatile ("call *%1"                        \
                   :"=a"(retval)                     \
-                  :"a"(NUMBER)                      \
+                  :"r"(ENTRY), "a"(NUMBER),         \
+                   "b"(ARG1), "c"(ARG2), "d"(ARG3)  \
                   :"memory");                       \
     retval;                                         \
 })
 
+/* 无参数系统调用 */
+#define _syscall0(NUMBER)                           \
+    _syscall_via(syscall_entry, NUMBER, 0, 0, 0)
+
 /* 一个参数的系统调用 */
 #define _syscall1(NUMBER, ARG1)                     \
-({                                                  \
-    int retval;                                     \
-    asm volatile ("int $0x80"                       \
-                  :"=a"(retval)                     \
-                  :"a"(NUMBER), "b"(ARG1)           \
-                  :"memory");                       \
-    retval;                                         \
-})
+    _syscall_via(syscall_entry, NUMBER, ARG1, 0, 0)
 
 /* 两个参数的系统调用 */
-#define _syscall2(NUMBER, ARG1, ARG2)                \
-({                                                  \
-    int retval;                                     \
-    asm volatile ("int $0x80"                       \
-                  :"=a"(retval)                     \
-                  :"a"(NUMBER), "b"(ARG1), "c"(ARG2)\
-                  :"memory");                       \
-    retval;                                         \
-})
+#define _syscall2(NUMBER, ARG1, ARG2)               \
+    _syscall_via(syscall_entry, NUMBER, ARG1, ARG2, 0)
 
 /*三个参数的系统调用*/
 #define _syscall3(NUMBER, ARG1, ARG2, ARG3)         \
-({                                                  \
-    int retval;                                     \
-    asm volatile ("int $0x80"                       \
-                  :"=a"(retval)                     \
-                  :"a"(NUMBER), "b"(ARG1),          \
-                   "c"(ARG2), "d"(ARG3)             \
-                  :"memory");                       \
-    retval;                                         \
-})
+    _syscall_via(syscall_entry, NUMBER, ARG1, ARG2, ARG3)
+
+/* 经由入口桩entry执行一次最简单的系统调用，用于测量系统调用往返开销 */
+uint32_t syscall_roundtrip(syscall_stub *entry)
+{
+    return _syscall_via(entry, SYS_GETPID, 0, 0, 0);
+}
 
 /* 获取当前进程的PID */
 uint32_t getpid()
 {
+    /* 用户进程直接从vdso页读取，内核线程没有映射vdso页，仍走系统调用 */
+    uint32_t cs;
+    asm volatile ("movl %%cs, %0": "=r"(cs));
+    if (cs & 3) return VDSO->pid;
     return _syscall0(SYS_GETPID);
 }
 
@@ -207,3 +233,121 @@ void dup2(uint32_t fd1, uint32_t fd2)
 {
     _syscall2(SYS_DUP2, fd1, fd2);
 }
+
+/* 同步执行ring中最多to_submit个排队的操作，返回执行的项数 */
+int32_t batch_enter(struct batch_ring *ring, uint32_t to_submit)
+{
+    return _syscall2(SYS_BATCH_ENTER, ring, to_submit);
+}
+
+/* 获取path所在文件系统的统计信息 */
+int32_t statfs(const char *path, struct statfs *buf)
+{
+    return _syscall2(SYS_STATFS, path, buf);
+}
+
+/* 把文件fd从offset开始的length个字节映射到用户空间，失败返回NULL */
+void *mmap(void *addr, uint32_t length, uint32_t prot, uint32_t flags, int32_t fd, uint32_t offset)
+{
+    struct mmap_args args = {addr, length, prot, flags, fd, offset};
+    return (void *)_syscall1(SYS_MMAP, &args);
+}
+
+/* 撤销mmap建立的映射 */
+int32_t munmap(void *addr, uint32_t length)
+{
+    return _syscall2(SYS_MUNMAP, addr, length);
+}
+
+/* 在内核中把文件in_fd当前位置开始的最多count个字节发送到out_fd */
+int32_t sendfile(int32_t out_fd, int32_t in_fd, uint32_t count)
+{
+    return _syscall3(SYS_SENDFILE, out_fd, in_fd, count);
+}
+
+/* 在管道和其它文件描述符之间搬运最多count个字节 */
+int32_t splice(int32_t fd_in, int32_t fd_out, uint32_t count)
+{
+    return _syscall3(SYS_SPLICE, fd_in, fd_out, count);
+}
+
+/* 从fd读取数据依次填满iov中的iovcnt个缓冲区 */
+int32_t readv(int32_t fd, const struct iovec *iov, uint32_t iovcnt)
+{
+    return _syscall3(SYS_READV, fd, iov, iovcnt);
+}
+
+/* 把iov中iovcnt个缓冲区的数据依次写入fd */
+int32_t writev(int32_t fd, const struct iovec *iov, uint32_t iovcnt)
+{
+    return _syscall3(SYS_WRITEV, fd, iov, iovcnt);
+}
+
+/* 从文件fd的offset处读取count个字节，不改变文件的当前位置 */
+int32_t pread(int32_t fd, void *buf, uint32_t count, uint32_t offset)
+{
+    struct pio_args args = {fd, buf, count, offset};
+    return _syscall1(SYS_PREAD, &args);
+}
+
+/* 向文件fd的offset处写入count个字节，不改变文件的当前位置 */
+int32_t pwrite(int32_t fd, const void *buf, uint32_t count, uint32_t offset)
+{
+    struct pio_args args = {fd, (void *)buf, count, offset};
+    return _syscall1(SYS_PWRITE, &args);
+}
+
+/* 从目录dir一次读出最多count个目录项到buf，flags带GETDENTS_STAT时同时返回文件大小 */
+int32_t getdents(struct dir *dir, struct dirent *buf, uint32_t count, uint32_t flags)
+{
+    struct getdents_args args = {dir, buf, count, flags};
+    return _syscall1(SYS_GETDENTS, &args);
+}
+
+/* 获取已打开文件fd的属性 */
+int32_t fstat(int32_t fd, struct stat *buf)
+{
+    return _syscall2(SYS_FSTAT, fd, buf);
+}
+
+/* 以flag方式打开目录dir下的文件pathname，dir为NULL时与open相同 */
+int32_t openat(struct dir *dir, const char *pathname, uint8_t flag)
+{
+    return _syscall3(SYS_OPENAT, dir, pathname, flag);
+}
+
+/* 获取目录dir下文件path的属性，dir为NULL时与stat相同 */
+int32_t fstatat(struct dir *dir, const char *path, struct stat *buf)
+{
+    return _syscall3(SYS_FSTATAT, dir, path, buf);
+}
+
+/* 删除目录dir下的文件pathname，dir为NULL时与unlink相同 */
+int32_t unlinkat(struct dir *dir, const char *pathname)
+{
+    return _syscall2(SYS_UNLINKAT, dir, pathname);
+}
+
+/* 在目录dir下创建目录pathname，dir为NULL时与mkdir相同 */
+int32_t mkdirat(struct dir *dir, const char *pathname)
+{
+    return _syscall2(SYS_MKDIRAT, dir, pathname);
+}
+
+/* 把文件fd的数据和inode写入硬盘 */
+int32_t fsync(int32_t fd)
+{
+    return _syscall1(SYS_FSYNC, fd);
+}
+
+/* 把文件fd的数据写入硬盘，inode只在必要时写回 */
+int32_t fdatasync(int32_t fd)
+{
+    return _syscall1(SYS_FDATASYNC, fd);
+}
+
+/* 把所有缓存中的修改写入硬盘 */
+void sync(void)
+{
+    _syscall0(SYS_SYNC);
+}
@@ -0,0 +1,21 @@
+#include "vdso.h"
+
+/* 以下函数直接读取映射在USER_VDSO_VADDR的只读页，不需要陷入内核，只能由用户进程调用 */
+
+/* 获取父进程PID */
+int16_t getppid(void)
+{
+    return VDSO->parent_pid;
+}
+
+/* 获取系统滴答数 */
+uint32_t get_ticks(void)
+{
+    return VDSO->ticks;
+}
+
+/* 获取系统运行的毫秒数 */
+uint32_t uptime_ms(void)
+{
+    return VDSO->ticks * (1000 / VDSO->hz);
+}
@@ -7,6 +7,7 @@
 #include "dir.h"
 #include "shell.h"
 #include "assert.h"
+#include "cpu.h"
 
 /* ls命令内建函数 */
 void buildin_ls(uint32_t argc, char **argv)
@@ -82,44 +83,30 @@ void buildin_ls(uint32_t argc, char **argv)
     if (file_stat.st_filetype == FT_DIRECTORY)
     {
         struct dir *dir = opendir(pathname);
-        struct dir_entry *dir_e = NULL;
-        char sub_pathname[MAX_PATH_LEN] = {0, };
-        uint32_t pathname_len = strlen(pathname);
-        uint32_t last_char_idx = pathname_len - 1;
-        memcpy(sub_pathname, pathname, pathname_len);
-        
-        if (sub_pathname[last_char_idx] != '/')
-        {
-            sub_pathname[pathname_len] = '/';
-            pathname_len++;
-        }
+        /* 一次取回多个目录项，-l时文件大小也一并返回，不用逐项stat */
+        struct dirent dents[16];
+        int32_t dent_cnt, dent_idx;
         rewinddir(dir);
         if (long_info)
         {
             char ftype;
             printf("total: %d\n", file_stat.st_size);
 
-            while ((dir_e = readdir(dir)))
+            while ((dent_cnt = getdents(dir, dents, 16, GETDENTS_STAT)) > 0)
             {
-                ftype = 'd';
-                if (dir_e->f_type == FT_REGULAR) ftype = '-';
-                sub_pathname[pathname_len] = 0;
-                strcat(sub_pathname, dir_e->filename);
-                memset(&file_stat, 0, sizeof(struct stat));
-                
-                if (stat(sub_pathname, &file_stat) == -1)
+                for (dent_idx = 0; dent_idx < dent_cnt; dent_idx++)
                 {
-                    printf("ls: cannot access %s: No such file or directory\n", dir_e->filename);
-                    return;
+                    ftype = 'd';
+                    if (dents[dent_idx].d_type == FT_REGULAR) ftype = '-';
+                    printf("%c  %d  %d  %s\n", ftype, dents[dent_idx].d_ino, dents[dent_idx].d_size, dents[dent_idx].d_name);
                 }
-                printf("%c  %d  %d  %s\n", ftype, dir_e->i_no, file_stat.st_size, dir_e->filename);
             }
         }
         else
         {
-            while ((dir_e = readdir(dir)))
+            while ((dent_cnt = getdents(dir, dents, 16, 0)) > 0)
             {
-                printf("%s ", dir_e->filename);
+                for (dent_idx = 0; dent_idx < dent_cnt; dent_idx++) printf("%s ", dents[dent_idx].d_name);
             }
             printf("\n");
         }
@@ -321,15 +308,7 @@ void buildin_cat(uint32_t argc, char **argv)
         return;
     }
 
-    int buf_size = 1024;
     char abs_path[MAX_PATH_LEN] = {0, };
-    void *buf = malloc(buf_size);
-    if (buf == NULL) 
-    {
-        printf("cat: malloc memory failed\n");
-        return;
-    }
-
     if (argv[1][0] != '/')
     {
         getcwd(abs_path, MAX_PATH_LEN);
@@ -348,15 +327,9 @@ void buildin_cat(uint32_t argc, char **argv)
         return;
     }
 
-    int read_bytes = 0;
-    while (1)
-    {
-        read_bytes = read(fd, buf, buf_size);
-        if (read_bytes == -1) break;
-        write(1, buf, read_bytes);
-    }
+    /* 文件内容在内核中直接送到标准输出，不经过用户缓冲区 */
+    while (sendfile(1, fd, 4096) > 0);
     
-    free(buf);
     close(fd);
 }
 
@@ -420,6 +393,304 @@ void buildin_echo(uint32_t argc, char **argv)
     }
 }
 
+/* 测量经由入口桩entry的系统调用往返耗时，返回每次调用的平均时钟周期数 */
+static uint32_t bench_syscall_cycles(syscall_stub *entry, uint32_t loops)
+{
+    uint32_t loop_idx = 0;
+    uint64_t start = rdtsc();
+    while (loop_idx < loops)
+    {
+        syscall_roundtrip(entry);
+        loop_idx++;
+    }
+    /* 没有64位除法，循环次数保证差值不会超过32位 */
+    return (uint32_t)(rdtsc() - start) / loops;
+}
+
+/* 测量通过vdso页获取PID的平均周期数 */
+static uint32_t bench_vdso_cycles(uint32_t loops)
+{
+    uint32_t loop_idx = 0;
+    uint64_t start = rdtsc();
+    while (loop_idx < loops)
+    {
+        getpid();
+        loop_idx++;
+    }
+    return (uint32_t)(rdtsc() - start) / loops;
+}
+
+typedef void memcpy_func(void *dst_, const void *src_, uint32_t size);
+typedef void memset_func(void *dst_, uint8_t value, uint32_t size);
+
+/* 逐字节复制，作为对比的基准 */
+static void memcpy_byte(void *dst_, const void *src_, uint32_t size)
+{
+    uint8_t *dst = dst_;
+    const uint8_t *src = src_;
+    while (size-- > 0) *dst++ = *src++;
+}
+
+/* 逐字节填充，作为对比的基准 */
+static void memset_byte(void *dst_, uint8_t value, uint32_t size)
+{
+    uint8_t *dst = dst_;
+    while (size-- > 0) *dst++ = value;
+}
+
+/* 测量copy复制size字节的平均周期数 */
+static uint32_t bench_memcpy_cycles(memcpy_func *copy, void *dst, const void *src, uint32_t size, uint32_t loops)
+{
+    uint32_t loop_idx = 0;
+    uint64_t start = rdtsc();
+    while (loop_idx++ < loops) copy(dst, src, size);
+    return (uint32_t)(rdtsc() - start) / loops;
+}
+
+/* 测量set填充size字节的平均周期数 */
+static uint32_t bench_memset_cycles(memset_func *set, void *dst, uint32_t size, uint32_t loops)
+{
+    uint32_t loop_idx = 0;
+    uint64_t start = rdtsc();
+    while (loop_idx++ < loops) set(dst, 0x5a, size);
+    return (uint32_t)(rdtsc() - start) / loops;
+}
+
+typedef int memcmp_func(const void *a_, const void *b_, uint32_t size);
+typedef uint32_t strlen_func(const char *str);
+typedef int8_t strcmp_func(const char *a, const char *b);
+
+/* 逐字节比较，作为对比的基准 */
+static int memcmp_byte(const void *a_, const void *b_, uint32_t size)
+{
+    const uint8_t *a = a_;
+    const uint8_t *b = b_;
+    while (size-- > 0)
+    {
+        if (*a != *b) return *a > *b ? 1 : -1;
+        a++;
+        b++;
+    }
+    return 0;
+}
+
+/* 逐字节求长度，作为对比的基准 */
+static uint32_t strlen_byte(const char *str)
+{
+    const char *p = str;
+    while (*p) p++;
+    return p - str;
+}
+
+/* 逐字节比较字符串，作为对比的基准 */
+static int8_t strcmp_byte(const char *a, const char *b)
+{
+    while (*a != 0 && *a == *b)
+    {
+        a++;
+        b++;
+    }
+    return *a < *b ? -1 : *a > *b;
+}
+
+/* 测量cmp比较两块相同的size字节内存的平均周期数，相同时要比较到末尾 */
+static uint32_t bench_memcmp_cycles(memcmp_func *cmp, const void *a, const void *b, uint32_t size, uint32_t loops)
+{
+    uint32_t loop_idx = 0;
+    uint64_t start = rdtsc();
+    while (loop_idx++ < loops) cmp(a, b, size);
+    return (uint32_t)(rdtsc() - start) / loops;
+}
+
+/* 测量len求长度为size的字符串长度的平均周期数 */
+static uint32_t bench_strlen_cycles(strlen_func *len, const char *str, uint32_t loops)
+{
+    uint32_t loop_idx = 0;
+    uint64_t start = rdtsc();
+    while (loop_idx++ < loops) len(str);
+    return (uint32_t)(rdtsc() - start) / loops;
+}
+
+/* 测量cmp比较两个相同字符串的平均周期数 */
+static uint32_t bench_strcmp_cycles(strcmp_func *cmp, const char *a, const char *b, uint32_t loops)
+{
+    uint32_t loop_idx = 0;
+    uint64_t start = rdtsc();
+    while (loop_idx++ < loops) cmp(a, b);
+    return (uint32_t)(rdtsc() - start) / loops;
+}
+
+/* 比较memcpy/memset/memcmp/strlen/strcmp各个实现在16B~64KB上的周期数 */
+static void bench_string(void)
+{
+    uint32_t max_size = 64 * 1024;
+    /* 多申请一些，让目的地址和源地址错开，避开恰好对齐的情况 */
+    uint8_t *src = malloc(max_size + 16);
+    uint8_t *dst = malloc(max_size + 16);
+    if (src == NULL || dst == NULL)
+    {
+        printf("bench: malloc failed\n");
+        if (src) free(src);
+        if (dst) free(dst);
+        return;
+    }
+    memset(src, 0xa5, max_size + 16);
+    int sse2 = string_sse2_enabled();
+    /* strcmp只在两个字符串对齐方式相同时才按字比较，为它准备两块都按4字节对齐的缓冲区 */
+    uint8_t *src_al = (uint8_t *)(((uint32_t)src + 3) & ~3);
+    uint8_t *dst_al = (uint8_t *)(((uint32_t)dst + 3) & ~3);
+
+    printf("size      memcpy byte/rep/sse2      memset byte/rep/sse2 (cycles)\n");
+    printf("          memcmp/strlen/strcmp byte/word\n");
+    uint32_t size = 16;
+    while (size <= max_size)
+    {
+        /* 每个尺寸总共处理约256KB，保证周期数不会超过32位 */
+        uint32_t loops = (256 * 1024) / size;
+        if (loops > 1000) loops = 1000;
+        printf("%d    %d/%d/", size,
+               bench_memcpy_cycles(memcpy_byte, dst + 1, src, size, loops),
+               bench_memcpy_cycles(memcpy_rep, dst + 1, src, size, loops));
+        if (sse2) printf("%d", bench_memcpy_cycles(memcpy_sse2, dst + 1, src, size, loops));
+        else printf("-");
+        printf("    %d/%d/", bench_memset_cycles(memset_byte, dst, size, loops),
+               bench_memset_cycles(memset_rep, dst, size, loops));
+        if (sse2) printf("%d\n", bench_memset_cycles(memset_sse2, dst, size, loops));
+        else printf("-\n");
+
+        /* 两块内容相同、以0结尾的字符串，目的地址错开一个字节 */
+        memcpy(dst + 1, src, size);
+        src[size] = 0;
+        dst[size + 1] = 0;
+        printf("          memcmp %d/%d  strlen %d/%d",
+               bench_memcmp_cycles(memcmp_byte, dst + 1, src, size, loops),
+               bench_memcmp_cycles(memcmp, dst + 1, src, size, loops),
+               bench_strlen_cycles(strlen_byte, (char *)src, loops),
+               bench_strlen_cycles(strlen, (char *)src, loops));
+        src[size] = 0xa5;
+
+        src_al[size] = 0;
+        memcpy(dst_al, src_al, size + 1);
+        printf("  strcmp %d/%d\n",
+               bench_strcmp_cycles(strcmp_byte, (char *)dst_al, (char *)src_al, loops),
+               bench_strcmp_cycles(strcmp, (char *)dst_al, (char *)src_al, loops));
+        src_al[size] = 0xa5;
+        size *= 4;
+    }
+
+    free(src);
+    free(dst);
+}
+
+/* 以flags打开path，写入再读回size字节，打印两者耗费的千周期数 */
+static void bench_file_io(const char *path, uint8_t flags, void *buf, uint32_t size)
+{
+    unlink(path);
+    uint64_t start = rdtsc();
+    int32_t fd = open((char *)path, O_CREAT | O_RDWR | flags);
+    if (fd == -1)
+    {
+        printf("bench: open %s failed\n", path);
+        return;
+    }
+    int32_t written = write(fd, buf, size);
+    close(fd);                          // 缓冲的数据在关闭时才写入硬盘，一并计入
+    uint32_t write_kcycles = (uint32_t)((rdtsc() - start) >> 10);
+
+    start = rdtsc();
+    fd = open((char *)path, O_RDONLY | flags);
+    int32_t read_bytes = read(fd, buf, size);
+    close(fd);
+    uint32_t read_kcycles = (uint32_t)((rdtsc() - start) >> 10);
+
+    if (written != (int32_t)size || read_bytes != (int32_t)size)
+        printf("bench: %s io failed, write %d read %d\n", path, written, read_bytes);
+    else
+        printf("    %s  write %d  read %d (kcycles)\n", flags & O_DIRECT ? "direct  " : "buffered", write_kcycles, read_kcycles);
+    unlink(path);
+}
+
+/* 比较普通读写和O_DIRECT读写整块文件的耗时 */
+static void bench_direct(void)
+{
+    struct statfs st;
+    if (statfs("/", &st) == -1)
+    {
+        printf("bench: statfs failed\n");
+        return;
+    }
+    uint32_t size = st.f_bsize * 32;
+    uint8_t *buf = malloc(size);
+    if (buf == NULL)
+    {
+        printf("bench: malloc failed\n");
+        return;
+    }
+    memset(buf, 0xa5, size);
+
+    printf("file io, %d bytes in %d byte blocks:\n", size, st.f_bsize);
+    bench_file_io("/bench_direct", 0, buf, size);
+    bench_file_io("/bench_direct", O_DIRECT, buf, size);
+    free(buf);
+}
+
+/* bench命令内建函数，微基准测试 */
+void buildin_bench(uint32_t argc, char **argv)
+{
+    if (argc == 2 && !strcmp("string", argv[1]))
+    {
+        bench_string();
+        return;
+    }
+    if (argc == 2 && !strcmp("direct", argv[1]))
+    {
+        bench_direct();
+        return;
+    }
+    if (argc != 2 || strcmp("syscall", argv[1]))
+    {
+        printf("usage: bench syscall|string|direct\n");
+        return;
+    }
+
+    uint32_t loops = 10000;
+    printf("syscall round trip, %d loops:\n", loops);
+    printf("    int 0x80: %d cycles\n", bench_syscall_cycles(syscall_int80, loops));
+    if (syscall_entry == syscall_sysenter)
+        printf("    sysenter: %d cycles\n", bench_syscall_cycles(syscall_sysenter, loops));
+    else
+        printf("    sysenter: not supported\n");
+    printf("    vdso getpid: %d cycles\n", bench_vdso_cycles(loops));
+}
+
+/* df命令内建函数，显示文件系统的块和inode使用情况 */
+void buildin_df(uint32_t argc, char **argv)
+{
+    if (argc > 2)
+    {
+        printf("df: only support 1 argument!\n");
+        return;
+    }
+
+    if (argc == 2) make_clear_abs_path(argv[1], final_path);
+    else strcpy(final_path, "/");
+
+    struct statfs fs_stat;
+    if (statfs(final_path, &fs_stat) == -1)
+    {
+        printf("df: cannot stat %s\n", final_path);
+        return;
+    }
+
+    uint32_t used = fs_stat.f_blocks - fs_stat.f_bfree;
+    uint32_t iused = fs_stat.f_files - fs_stat.f_ffree;
+    printf("block size: %d bytes\n", fs_stat.f_bsize);
+    printf("blocks: %d total, %d used, %d free, %d percent used\n", fs_stat.f_blocks, used, fs_stat.f_bfree, 
+            fs_stat.f_blocks ? used * 100 / fs_stat.f_blocks : 0);
+    printf("inodes: %d total, %d used, %d free, %d percent used\n", fs_stat.f_files, iused, fs_stat.f_ffree, 
+            fs_stat.f_files ? iused * 100 / fs_stat.f_files : 0);
+}
+
 /* 将路径old_abs_path中的.和..转化为绝对路径存入new_abs_path */
 static void wash_path(char *old_abs_path, char *new_abs_path)
 {
@@ -139,6 +139,8 @@ static void help(void)
     printf("        pwd: show current work directory\n");
     printf("        ps: show process and thread information\n");
     printf("        clear: clear screen\n");
+    printf("        bench: run micro benchmarks\n");
+    printf("        df: show free disk space\n");
     printf("        help: show this message\n");
     printf(" shortcut key:\n");
     printf("        ctrl+l: clear screen\n");
@@ -168,6 +170,8 @@ static void cmd_execute(int argc, char *argv[])
     else if (!strcmp("rm", argv[0])) buildin_rm(argc, argv);
     else if (!strcmp("cat", argv[0])) buildin_cat(argc, argv);
     else if (!strcmp("echo", argv[0])) buildin_echo(argc, argv);
+    else if (!strcmp("bench", argv[0])) buildin_bench(argc, argv);
+    else if (!strcmp("df", argv[0])) buildin_df(argc, argv);
     else if (!strcmp("help", argv[0])) help();
     else printf("my_shell: command not found: %s\n", argv[0]);
 }
@@ -11,6 +11,7 @@
 #include "stdio.h"
 #include "file.h"
 #include "fs.h"
+#include "fpu.h"
 
 /* PID位图，最大支持1024个PID */
 uint8_t pid_bitmap_bits[128] = {0, };
@@ -27,17 +28,32 @@ struct task_struct *main_thread;        // 主线程PCB
 struct task_struct *idle_thread;        // idle线程
 struct list thread_ready_list;          // 就绪队列
 struct list thread_all_list;            // 所有任务队列
+static struct list thread_dead_list;    // 已经结束、等待回收PCB的内核线程
 static struct list_elem *thread_tag;    // 用于保存队列中的线程节点
 
 extern void switch_to(struct task_struct *cur, struct task_struct *next);
 extern void init(void);
 
+/* 回收待回收队列中已经结束的内核线程 */
+static void thread_reap(void)
+{
+    enum intr_status old_status = intr_disable();
+    while (!list_empty(&thread_dead_list))
+    {
+        struct task_struct *dead = elem2entry(struct task_struct, general_tag, list_pop(&thread_dead_list));
+        thread_exit(dead, 0);
+    }
+    intr_set_status(old_status);
+}
+
 /* 系统空闲时运行的线程 */
 static void idle(void *arg UNUSED)
 {
     while (1) 
     {
         thread_block(TASK_BLOCKED);
+        /* 空闲时顺便回收结束的内核线程 */
+        thread_reap();
         // 执行hlt时必须保证IF位为1,不然接收不到中断就无法调度线程
         asm volatile ("sti; hlt": : :"memory");
     }
@@ -51,11 +67,24 @@ struct task_struct *running_thread()
     return (struct task_struct *)(esp & 0xfffff000);
 }
 
+/* 内核线程函数返回后结束线程。线程还在PCB所在的页上使用栈，不能自己回收，
+   挂到待回收队列后换下处理器，由idle线程调用thread_exit回收 */
+static void thread_retire(void)
+{
+    intr_disable();
+    struct task_struct *cur = running_thread();
+    cur->status = TASK_DIED;
+    list_append(&thread_dead_list, &cur->general_tag);
+    schedule();
+    PANIC("thread_retire: should not be here\n");
+}
+
 static void kernel_thread(thread_func *function, void *func_arg)
 {
     /* 执行线程前开中断，避免接收不到中断而导致其他线程无法被调度 */
     intr_enable();
     function(func_arg);
+    thread_retire();
 }
 
 /* 初始化PID池 */
@@ -204,6 +233,7 @@ void schedule()
     next->status = TASK_RUNNING;
     /* 激活即将运行的程序的ESP和页表 */
     process_activate(next);
+    fpu_switch(next);
     switch_to(cur, next);
 }
 
@@ -332,6 +362,12 @@ void thread_exit(struct task_struct *thread_over, int need_schedule)
         /* 是进程，回收页表 */
         mfree_page(PF_KERNEL, thread_over->pgdir, 1);
     }
+    if (thread_over->vdso)
+    {
+        /* 回收vdso页，用户页表中的映射在release_proc_resource中被跳过 */
+        mfree_page(PF_KERNEL, thread_over->vdso, 1);
+    }
+    fpu_release(thread_over);
 
     /* 从全局任务列表中删除 */
     list_remove(&thread_over->all_list_tag);
@@ -376,6 +412,7 @@ void thread_init(void)
 
     list_init(&thread_ready_list);
     list_init(&thread_all_list);
+    list_init(&thread_dead_list);
     pid_pool_init();
 
     /* 创建第一个用户进程init */
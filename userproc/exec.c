@@ -5,6 +5,9 @@
 #include "string.h"
 #include "global.h"
 #include "memory.h"
+#include "fpu.h"
+#include "mmap.h"
+#include "file.h"
 
 extern void intr_exit(void);
 
@@ -55,6 +58,11 @@ enum segment_type
     PT_PHDR             // 程序头表
 };
 
+/* 段权限p_flags中的标志 */
+#define PF_X    1           // 可执行
+#define PF_W    2           // 可写
+#define PF_R    4           // 可读
+
 /* 将文件描述符fd指向的文件中, 盘以为offset，大小为filesz的段加载到虚拟地址vaddr */
 static int segment_load(int32_t fd, uint32_t offset, uint32_t filesz, int32_t vaddr)
 {
@@ -79,7 +87,7 @@ static int segment_load(int32_t fd, uint32_t offset, uint32_t filesz, int32_t va
     while (page_idx < occupy_pages)
     {
         uint32_t *pde = pde_ptr(vaddr_page);
-        uint32_t *pte = pde_ptr(vaddr_page);
+        uint32_t *pte = pte_ptr(vaddr_page);
         
         /* 如果pde不存在或者pte不存在就分配内存
            pde判断一定要在pte之前，否则很容易触发#PF */
@@ -97,6 +105,28 @@ static int segment_load(int32_t fd, uint32_t offset, uint32_t filesz, int32_t va
     return 1;
 }
 
+/* 加载只读的段，段中完整的页映射程序文件的页缓存，运行同一程序的进程共享这些物理页，
+   首尾不满一页的部分可能和其它段共用一页，仍然复制到私有页中 */
+static int segment_share(int32_t fd, uint32_t offset, uint32_t filesz, uint32_t vaddr)
+{
+    uint32_t share_start = DIV_ROUND_UP(vaddr, PG_SIZE) * PG_SIZE;
+    uint32_t share_end = (vaddr + filesz) & 0xfffff000;
+    if (share_start >= share_end) return segment_load(fd, offset, filesz, vaddr);
+
+    if (share_start > vaddr && !segment_load(fd, offset, share_start - vaddr, vaddr)) return 0;
+    if (share_end < vaddr + filesz && \
+        !segment_load(fd, offset + (share_end - vaddr), vaddr + filesz - share_end, share_end)) return 0;
+
+    struct inode *inode = file_table[fd_local2global(fd)].fd_inode;
+    uint32_t share_offset = offset + (share_start - vaddr);
+    if (mmap_text(inode, share_start, (share_end - share_start) / PG_SIZE, share_offset / PG_SIZE) == -1)
+    {
+        /* 映射区用完了，退回到复制 */
+        return segment_load(fd, share_offset, share_end - share_start, share_start);
+    }
+    return 1;
+}
+
 /* 从文件系统上加载用户程序pathname，成功返回程序起始地址，否则返回-1 */
 static int32_t load(const char *pathname)
 {
@@ -147,10 +177,16 @@ static int32_t load(const char *pathname)
             goto done;
         }
 
-        /* 如果是可加载就调用segment_load加载到内存 */
+        /* 如果是可加载就调用segment_load加载到内存，文件内容和内存映像逐页对应的只读段共享页缓存 */
         if (PT_LOAD == prog_header.p_type)
         {
-            if (!segment_load(fd, prog_header.p_offset, prog_header.p_filesz, prog_header.p_vaddr))
+            int loaded;
+            if (!(prog_header.p_flags & PF_W) && prog_header.p_filesz == prog_header.p_memsz && \
+                prog_header.p_offset % PG_SIZE == prog_header.p_vaddr % PG_SIZE)
+                loaded = segment_share(fd, prog_header.p_offset, prog_header.p_filesz, prog_header.p_vaddr);
+            else
+                loaded = segment_load(fd, prog_header.p_offset, prog_header.p_filesz, prog_header.p_vaddr);
+            if (!loaded)
             {
                 ret = -1;
                 goto done;
@@ -173,6 +209,9 @@ int32_t sys_execv(const char *path, const char *argv[])
     uint32_t argc = 0;
     while (argv[argc]) argc++;
 
+    /* 旧程序的文件映射不再有效，新程序的段也可能落在映射区中 */
+    mmap_release(running_thread());
+
     int32_t entry_point = load(path);
     if (entry_point == -1) return -1;
 
@@ -180,6 +219,8 @@ int32_t sys_execv(const char *path, const char *argv[])
     /* 修改进程名 */
     memcpy(cur->name, path, TASK_NAME_LEN);
     cur->name[TASK_NAME_LEN - 1] = 0;
+    /* 新程序从初始的FPU状态开始 */
+    fpu_release(cur);
 
     struct intr_stack *intr_0_stack = (struct intr_stack *)((uint32_t)cur + PG_SIZE - sizeof(struct intr_stack));
     /* 参数传递给用户进程 */
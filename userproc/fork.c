@@ -8,6 +8,8 @@
 #include "string.h"
 #include "file.h"
 #include "pipe.h"
+#include "fpu.h"
+#include "mmap.h"
 
 extern void intr_exit(void);
 
@@ -59,10 +61,10 @@ static void copy_body_stack3(struct task_struct *child_thread, struct task_struc
             while (idx_bit < 8)
             {
                 /* 1位（一页）比较 */
-                if ((BITMAP_MASK << idx_bit) & vaddr_btmp[idx_byte])
+                proc_vaddr = (idx_byte * 8 + idx_bit) * PG_SIZE + vaddr_start;
+                /* 文件映射区的页不复制，子进程访问时从页缓存映射 */
+                if ((BITMAP_MASK << idx_bit) & vaddr_btmp[idx_byte] && !mmap_contains(parent_thread, proc_vaddr))
                 {
-                    proc_vaddr = (idx_byte * 8 + idx_bit) * PG_SIZE + vaddr_start;
-                    
                     /* 把父进程的用户空间数据通过内核空间中转，复制到子进程的用户空间 */
                     
                     /* Step 1：将父进程的用户数据页拷贝到内核页 */
@@ -151,6 +153,12 @@ static int32_t copy_process(struct task_struct *child_thread, struct task_struct
     /* 复制父进程的PCB，虚拟地址位图，内核栈给子进程 */
     if (copy_pcb_vaddrbitmap_stack0(child_thread, parent_thread) == -1) return -1;
 
+    /* 子进程需要自己的FPU状态保存区 */
+    if (fpu_fork(child_thread, parent_thread) == -1) return -1;
+
+    /* 子进程继承父进程的文件映射 */
+    if (mmap_fork(child_thread, parent_thread) == -1) return -1;
+
     /* 为子进程创建页表（仅包含内核空间） */
     child_thread->pgdir = create_page_dir();
     if (child_thread->pgdir == NULL) return -1;
@@ -158,6 +166,15 @@ static int32_t copy_process(struct task_struct *child_thread, struct task_struct
     /* 复制父进程用户空间给子进程 */
     copy_body_stack3(child_thread, parent_thread, buf_page);
 
+    /* 子进程需要自己的vdso页，不能和父进程共享 */
+    child_thread->vdso = NULL;
+    if (parent_thread->vdso)
+    {
+        page_dir_activate(child_thread);
+        vdso_install(child_thread);
+        page_dir_activate(parent_thread);
+    }
+
     /* 构建子进程thread_stack和修改返回地址及返回PID */
     build_child_stack(child_thread);
 
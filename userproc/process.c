@@ -8,6 +8,8 @@
 #include "interrupt.h"
 #include "string.h"
 #include "console.h"
+#include "vdso.h"
+#include "timer.h"
 
 extern void intr_exit(void);
 
@@ -47,6 +49,7 @@ void start_process(void *filename_)
     proc_stack->eflags = (EFLAGS_IOPL_0 | EFLAGS_MBS | EFLAGS_IF_1);
     proc_stack->esp = (void *)((uint32_t)get_a_page(PF_USER, USER_STACK3_VADDR) + PG_SIZE);
     proc_stack->ss = SELECTOR_U_DATA;
+    vdso_install(cur);
     asm volatile ("movl %0, %%esp; jmp intr_exit": :"g"(proc_stack): "memory");
 }
 
@@ -60,6 +63,35 @@ void process_activate(struct task_struct *p_thread)
     
     /* 内核本身就在特权级0下运行，在任务切换时不会从TSS中获取0特权级的栈 */
     if (p_thread->pgdir) update_tss_esp(p_thread);
+
+    /* 进程没有运行期间vdso页中的滴答数不会更新，父进程也可能因为退出而变成init */
+    if (p_thread->vdso)
+    {
+        p_thread->vdso->ticks = ticks;
+        p_thread->vdso->parent_pid = p_thread->parent_pid;
+    }
+}
+
+/* 为进程p_thread分配vdso页并映射到当前页表的USER_VDSO_VADDR处，
+   调用前当前页表必须是p_thread的页表，成功返回0，失败返回-1 */
+int32_t vdso_install(struct task_struct *p_thread)
+{
+    /* vdso页由内核维护，在内核空间中申请，用户进程只能通过只读映射访问 */
+    struct vdso_data *vdso = get_kernel_pages(1);
+    if (vdso == NULL)
+    {
+        console_put_str("vdso_install: get_kernel_page failed!\n");
+        p_thread->vdso = NULL;
+        return -1;
+    }
+    vdso->ticks = ticks;
+    vdso->hz = IRQ0_FREQUENCY;
+    vdso->pid = p_thread->pid;
+    vdso->parent_pid = p_thread->parent_pid;
+
+    page_map_readonly(USER_VDSO_VADDR, addr_v2p((uint32_t)vdso));
+    p_thread->vdso = vdso;
+    return 0;
 }
 
 /* 激活页表 */
@@ -11,18 +11,62 @@
 #include "exec.h"
 #include "wait_exit.h"
 #include "pipe.h"
+#include "cpu.h"
+#include "tss.h"
+#include "global.h"
+#include "mmap.h"
 
-#define syscall_nr  32
+#define syscall_nr  64
 typedef void*       syscall;
 
+/* sysenter相关的MSR */
+#define MSR_SYSENTER_CS     0x174
+#define MSR_SYSENTER_ESP    0x175
+#define MSR_SYSENTER_EIP    0x176
+
 syscall syscall_table[syscall_nr];
 
+extern void sysenter_handler(void);
+
 /* 返回用户当前任务pid */
 uint32_t sys_getpid(void)
 {
     return running_thread()->pid;
 }
 
+/* 判断cpu是否支持sysenter/sysexit */
+static int sysenter_supported(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    if (eax < 1) return 0;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEAT_EDX_SEP)) return 0;
+
+    /* 早期的Pentium Pro（family 6，model和stepping都小于3）会错误地报告SEP */
+    uint32_t family = (eax >> 8) & 0xf, model = (eax >> 4) & 0xf, stepping = eax & 0xf;
+    if (family == 6 && model < 3 && stepping < 3) return 0;
+    return 1;
+}
+
+/* 设置sysenter的MSR，并把用户的系统调用入口切换为快速入口，不支持时保留int 0x80 */
+static void sysenter_init(void)
+{
+    if (!sysenter_supported())
+    {
+        put_str("    sysenter not supported, use int 0x80\n");
+        return;
+    }
+
+    wrmsr(MSR_SYSENTER_CS, SELECTOR_SYSENTER_CS);
+    /* esp指向TSS的esp0字段，任务切换时只需更新TSS，入口处再从中取出真正的栈顶 */
+    wrmsr(MSR_SYSENTER_ESP, tss_esp0_addr());
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_handler);
+    syscall_entry = syscall_sysenter;
+    put_str("    sysenter enabled\n");
+}
+
 /* 初始化系统调用 */
 void syscall_init(void)
 {
@@ -54,5 +98,25 @@ void syscall_init(void)
     syscall_table[SYS_WAIT]         = sys_wait;
     syscall_table[SYS_PIPE]         = sys_pipe;
     syscall_table[SYS_DUP2]         = sys_dup2;
+    syscall_table[SYS_BATCH_ENTER]  = sys_batch_enter;
+    syscall_table[SYS_STATFS]       = sys_statfs;
+    syscall_table[SYS_MMAP]         = sys_mmap;
+    syscall_table[SYS_MUNMAP]       = sys_munmap;
+    syscall_table[SYS_SENDFILE]     = sys_sendfile;
+    syscall_table[SYS_SPLICE]       = sys_splice;
+    syscall_table[SYS_READV]        = sys_readv;
+    syscall_table[SYS_WRITEV]       = sys_writev;
+    syscall_table[SYS_PREAD]        = sys_pread;
+    syscall_table[SYS_PWRITE]       = sys_pwrite;
+    syscall_table[SYS_GETDENTS]     = sys_getdents;
+    syscall_table[SYS_FSTAT]        = sys_fstat;
+    syscall_table[SYS_OPENAT]       = sys_openat;
+    syscall_table[SYS_FSTATAT]      = sys_fstatat;
+    syscall_table[SYS_UNLINKAT]     = sys_unlinkat;
+    syscall_table[SYS_MKDIRAT]      = sys_mkdirat;
+    syscall_table[SYS_FSYNC]        = sys_fsync;
+    syscall_table[SYS_FDATASYNC]    = sys_fdatasync;
+    syscall_table[SYS_SYNC]         = sys_sync;
+    sysenter_init();
     put_str("syscall_init done.\n");
 }
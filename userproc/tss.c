@@ -44,6 +44,12 @@ void update_tss_esp(struct task_struct *pthread)
     tss.esp0 = (uint32_t *)((uint32_t)pthread + PG_SIZE);
 }
 
+/* 返回TSS中esp0字段的地址，sysenter入口从这里取得当前任务的0特权级栈 */
+uint32_t tss_esp0_addr(void)
+{
+    return (uint32_t)&tss.esp0;
+}
+
 static struct gdt_desc make_gdt_desc(uint32_t *desc_addr, uint32_t limit, uint8_t attr_low, uint8_t attr_high)
 {
     uint32_t desc_base = (uint32_t)desc_addr;
@@ -76,9 +82,15 @@ void tss_init()
     /* 把特权级3的代码段和数据段描述符的界限改为0x00000000～0xbfffffff，使其不能访问内核的数据 */
     // *((struct gdt_desc *)0xc0000928) = make_gdt_desc((uint32_t *)0, 0xbffff, GDT_CODE_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
     // *((struct gdt_desc *)0xc0000930) = make_gdt_desc((uint32_t *)0, 0xbffff, GDT_DATA_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
+
+    /* 第7～10项给sysenter/sysexit使用，依次为内核代码段、内核数据段、用户代码段、用户数据段 */
+    *((struct gdt_desc *)0xc0000938) = *((struct gdt_desc *)0xc0000908);
+    *((struct gdt_desc *)0xc0000940) = *((struct gdt_desc *)0xc0000910);
+    *((struct gdt_desc *)0xc0000948) = *((struct gdt_desc *)0xc0000928);
+    *((struct gdt_desc *)0xc0000950) = *((struct gdt_desc *)0xc0000930);
     
     /* 重新加载GDTR寄存器和加载TR寄存器 */
-    uint64_t gdt_operand = ((8 * 7 - 1) | ((uint64_t)(uint32_t)0xc0000900 << 16));
+    uint64_t gdt_operand = ((8 * GDT_DESC_CNT - 1) | ((uint64_t)(uint32_t)0xc0000900 << 16));
     asm volatile ("lgdt %0": :"m"(gdt_operand));
     asm volatile ("ltr %w0": :"r"(SELECTOR_TSS));
 
@@ -9,6 +9,8 @@
 #include "fs.h"
 #include "file.h"
 #include "pipe.h"
+#include "vdso.h"
+#include "mmap.h"
 
 /* 释放用户进程资源
    1 页表中对应的物理页
@@ -29,6 +31,9 @@ static void release_proc_resource(struct task_struct *release_thread)
     uint32_t *first_pte_vaddr_in_pde = NULL;
     uint32_t pg_phy_addr = 0;
 
+    /* 先撤销文件映射，映射的物理页属于页缓存，不能在下面释放 */
+    mmap_release(release_thread);
+
     /* 回收页表用户空间的页面 */      
     while (pde_idx < user_pde_nr)
     {
@@ -43,7 +48,8 @@ static void release_proc_resource(struct task_struct *release_thread)
             {
                 v_pte_ptr = first_pte_vaddr_in_pde + pte_idx;
                 pte = *v_pte_ptr;
-                if (pte & 0x00000001)
+                /* vdso页属于内核内存池，由thread_exit回收 */
+                if ((pte & 0x00000001) && (uint32_t)pde_idx * 0x400000 + pte_idx * PG_SIZE != USER_VDSO_VADDR)
                 {
                     /* 页表项P为为1 */
                     pg_phy_addr = pte & 0xfffff000;